@@ -0,0 +1,193 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+enum class activationKind { custom, sigmoid, fastSigmoid, approximateSigmoid, tanh, relu };
+enum class errorKind { custom, mse, crossEntropy, softmaxCrossEntropy };
+enum class regularizationKind { custom, L2 };
+
+enum class expAccuracy { exact, fast, fastest };
+
+// exact uses std::exp, fast is a range-reduced polynomial (~2e-7 relative error) and
+// fastest is Schraudolph's bit trick (~4% relative error).
+template <expAccuracy accuracy>
+inline float approximateExp(float x) {
+    if constexpr (accuracy == expAccuracy::exact) {
+        return std::exp(x);
+    } else if constexpr (accuracy == expAccuracy::fast) {
+        x = std::min(std::max(x, -87.0f), 88.0f);
+
+        const float n = std::nearbyint(x * 1.44269504088896341f);
+        const float r = x - n * 0.693359375f + n * 2.12194440e-4f;
+
+        float p = 1.9875691500e-4f;
+        p = p * r + 1.3981999507e-3f;
+        p = p * r + 8.3334519073e-3f;
+        p = p * r + 4.1665795894e-2f;
+        p = p * r + 1.6666665459e-1f;
+        p = p * r + 5.0000001201e-1f;
+        p = p * r * r + r + 1.0f;
+
+        const int32_t exponentBits = ((int32_t)n + 127) << 23;
+        float scale;
+        std::memcpy(&scale, &exponentBits, sizeof(float));
+
+        return p * scale;
+    } else {
+        x = std::min(std::max(x, -87.0f), 88.0f);
+
+        const int32_t bits = (int32_t)(12102203.0f * x + 1064866805.0f);
+        float result;
+        std::memcpy(&result, &bits, sizeof(float));
+
+        return result;
+    }
+}
+
+// Activation policies give f(z) and f'(z), where f' may use the already computed a = f(z).
+template <expAccuracy accuracy>
+struct sigmoidPolicy {
+    float f(const float z) const { return 1.0f / (1.0f + approximateExp<accuracy>(-z)); }
+    float fPrime(const float, const float a) const { return a * (1.0f - a); }
+};
+
+struct tanhPolicy {
+    float f(const float z) const { return std::tanh(z); }
+    float fPrime(const float, const float a) const { return 1.0f - a * a; }
+};
+
+struct reluPolicy {
+    float f(const float z) const { return z > 0.0f ? z : 0.0f; }
+    float fPrime(const float z, const float) const { return z > 0.0f ? 1.0f : 0.0f; }
+};
+
+// Loss policies give the per-output error and its derivative with respect to the activation.
+struct msePolicy {
+    float f(const float a, const float t, const int n) const { return (1/(float)n) * (a - t) * (a - t); }
+    float fPrime(const float a, const float t, const int n) const { return (1/(float)n) * 2 * (a - t); }
+};
+
+struct crossEntropyPolicy {
+    static constexpr float epsilon = 1e-7f;
+
+    float f(const float a, const float t, const int n) const {
+        const float clamped = std::min(std::max(a, epsilon), 1.0f - epsilon);
+        return -(1/(float)n) * (t * std::log(clamped) + (1.0f - t) * std::log(1.0f - clamped));
+    }
+
+    float fPrime(const float a, const float t, const int n) const {
+        const float clamped = std::min(std::max(a, epsilon), 1.0f - epsilon);
+        return (1/(float)n) * (clamped - t) / (clamped * (1.0f - clamped));
+    }
+};
+
+// Categorical cross-entropy over a softmax output layer. The two are only ever used together, so
+// the output layer skips the network's activation and fPrime is the gradient with respect to the
+// logits, a - t. The batched path is softmaxCrossEntropyForward below.
+struct softmaxCrossEntropyPolicy {
+    static constexpr float epsilon = 1e-7f;
+
+    float f(const float a, const float t, const int) const { return -t * std::log(std::max(a, epsilon)); }
+    float fPrime(const float a, const float t, const int) const { return a - t; }
+};
+
+template <typename Activation>
+inline void activationForward(const Activation activation, const float* z, float* a, const int n) {
+    for (int i = 0; i < n; i++) a[i] = activation.f(z[i]);
+}
+
+// delta *= f'(z)
+template <typename Activation>
+inline void activationBackward(const Activation activation, const float* z, const float* a, float* delta, const int n) {
+    for (int i = 0; i < n; i++) delta[i] *= activation.fPrime(z[i], a[i]);
+}
+
+// delta = dE/da * f'(z), with sigmoid followed by cross-entropy collapsing to (a - t) / outputs
+// and softmax cross-entropy, whose outputs aren't produced by the activation, to a - t
+template <typename Activation, typename Loss>
+inline void outputDeltas(const Activation activation, const Loss loss, const float* z, const float* a, const float* t, float* delta, const int n, const int outputs) {
+    if constexpr (std::is_same_v<Loss, softmaxCrossEntropyPolicy>) {
+        for (int i = 0; i < n; i++) delta[i] = a[i] - t[i];
+    } else if constexpr (std::is_same_v<Loss, crossEntropyPolicy> &&
+                  (std::is_same_v<Activation, sigmoidPolicy<expAccuracy::exact>> ||
+                   std::is_same_v<Activation, sigmoidPolicy<expAccuracy::fast>> ||
+                   std::is_same_v<Activation, sigmoidPolicy<expAccuracy::fastest>>)) {
+        const float scale = 1/(float)outputs;
+        for (int i = 0; i < n; i++) delta[i] = scale * (a[i] - t[i]);
+    } else {
+        for (int i = 0; i < n; i++) delta[i] = loss.fPrime(a[i], t[i], outputs) * activation.fPrime(z[i], a[i]);
+    }
+}
+
+template <typename Loss>
+inline float lossSum(const Loss loss, const float* a, const float* t, const int n, const int outputs) {
+    float sum = 0;
+    for (int i = 0; i < n; i++) sum += loss.f(a[i], t[i], outputs);
+    return sum;
+}
+
+// Index of the largest value in each column of a rows x cols row major block (one example per
+// column), sweeping a row at a time so the comparisons vectorize across examples. best is cols floats of scratch.
+inline void columnArgmax(const float* a, const int rows, const int cols, int* indices, float* best) {
+    for (int e = 0; e < cols; e++) {
+        best[e] = a[e];
+        indices[e] = 0;
+    }
+
+    for (int i = 1; i < rows; i++) {
+        const float* row = a + (long)i * cols;
+
+        for (int e = 0; e < cols; e++) {
+            const bool larger = row[e] > best[e];
+            best[e] = larger ? row[e] : best[e];
+            indices[e] = larger ? i : indices[e];
+        }
+    }
+}
+
+// Softmax of the logits z into a for every column, using the max-shifted log-sum-exp so large
+// logits can't overflow, storing each column's argmax on the way. The same call optionally writes
+// the output deltas a - t and adds the cross-entropy -sum(t * log a) to *loss; t, delta and loss
+// may be null (t only when delta and loss are). a may alias z when loss is null. scratch holds
+// 2 * cols floats.
+inline void softmaxCrossEntropyForward(const float* z, float* a, const float* t, float* delta, float* loss, int* argmax, const int rows, const int cols, float* scratch) {
+    float* logSumExp = scratch;
+    float* inverseSum = scratch + cols;
+
+    columnArgmax(z, rows, cols, argmax, logSumExp);
+
+    for (int e = 0; e < cols; e++) inverseSum[e] = 0;
+
+    for (int i = 0; i < rows; i++) {
+        const float* zRow = z + (long)i * cols;
+        float* aRow = a + (long)i * cols;
+
+        for (int e = 0; e < cols; e++) {
+            aRow[e] = approximateExp<expAccuracy::fast>(zRow[e] - logSumExp[e]);
+            inverseSum[e] += aRow[e];
+        }
+    }
+
+    for (int e = 0; e < cols; e++) {
+        logSumExp[e] += std::log(inverseSum[e]);
+        inverseSum[e] = 1 / inverseSum[e];
+    }
+
+    float lossSum = 0;
+
+    for (int i = 0; i < rows; i++) {
+        const float* zRow = z + (long)i * cols;
+        const float* tRow = t ? t + (long)i * cols : nullptr;
+        float* aRow = a + (long)i * cols;
+        float* deltaRow = delta ? delta + (long)i * cols : nullptr;
+
+        for (int e = 0; e < cols; e++) aRow[e] *= inverseSum[e];
+        if (deltaRow) for (int e = 0; e < cols; e++) deltaRow[e] = aRow[e] - tRow[e];
+        if (loss) for (int e = 0; e < cols; e++) lossSum -= tRow[e] * (zRow[e] - logSumExp[e]);
+    }
+
+    if (loss) *loss += lossSum;
+}
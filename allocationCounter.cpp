@@ -0,0 +1,24 @@
+#include "metrics.h"
+#include <cstdlib>
+#include <new>
+
+// Replaces the global operator new with one that counts every allocation for getAllocationCount.
+// The library links it in when it's built with NN_COUNT_ALLOCATIONS; a program can also link it
+// in itself to count allocations with the default library.
+
+static const bool counting = (metricsDetail::countingAllocations.store(true, std::memory_order_relaxed), true);
+
+void* operator new(std::size_t size) {
+    metricsDetail::allocations.fetch_add(1, std::memory_order_relaxed);
+
+    if (void* memory = std::malloc(size ? size : 1)) return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
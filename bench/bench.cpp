@@ -0,0 +1,390 @@
+#include "../neuralNetwork.h"
+#include "../fixedNetwork.h"
+#include "../matrix/kernels.h"
+#include "../matrix/sparseColumns.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define SAMPLES 5
+#define LATENCY_RUNS 2000
+#define SYNTHETIC_EXAMPLES 10000
+#define MNIST_INPUTS 784
+#define MNIST_CLASSES 10
+
+struct benchResult {
+    std::string name;
+    std::string unit;
+    double value;
+    bool higherIsBetter;
+};
+
+struct benchOptions {
+    double minSeconds = 0.1;
+    int threads = 1;
+    std::string filter;
+    std::string outputFile;
+    std::string baselineFile;
+    double threshold = 0.10;
+};
+
+// MNIST shaped examples generated from a fixed seed: mostly blank pixels and a uniform label.
+class syntheticMNIST : public dataSource {
+private:
+    std::vector<unsigned char> pixels;
+    std::vector<unsigned char> labels;
+
+public:
+    syntheticMNIST(int count) : pixels((size_t)count * MNIST_INPUTS), labels(count) {
+        std::mt19937 generator(1234);
+
+        for (unsigned char& pixel : pixels) pixel = generator() % 5 == 0 ? generator() % 256 : 0;
+        for (unsigned char& label : labels) label = generator() % MNIST_CLASSES;
+    }
+
+    int size() const override { return labels.size(); }
+    int inputSize() const override { return MNIST_INPUTS; }
+    int targetSize() const override { return MNIST_CLASSES; }
+
+    void assembleBatch(const int* indices, int count, matrix& inputs, matrix& targets) const override {
+        inputs.resize(MNIST_INPUTS, count);
+        targets.resize(MNIST_CLASSES, count);
+        targets.fill(0);
+
+        for (int example = 0; example < count; example++) {
+            const unsigned char* image = pixels.data() + (size_t)indices[example] * MNIST_INPUTS;
+
+            for (int i = 0; i < MNIST_INPUTS; i++) inputs(i, example) = image[i] * (1.0f / 255);
+            targets(labels.at(indices[example]), example) = 1;
+        }
+    }
+};
+
+// Median over SAMPLES of the mean time per call, each sample repeating body for at least minSeconds.
+template <typename Body>
+static double nanosecondsPerCall(const benchOptions& options, Body body) {
+    using clock = std::chrono::steady_clock;
+
+    body();
+
+    long iterations = 1;
+    while (true) {
+        const auto start = clock::now();
+        for (long i = 0; i < iterations; i++) body();
+        const double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+        if (elapsed >= options.minSeconds / SAMPLES) break;
+        iterations *= elapsed > 0 ? std::max(2.0, std::min(10.0, options.minSeconds / SAMPLES / elapsed * 1.5)) : 10;
+    }
+
+    std::vector<double> samples;
+    for (int sample = 0; sample < SAMPLES; sample++) {
+        const auto start = clock::now();
+        for (long i = 0; i < iterations; i++) body();
+        samples.push_back(std::chrono::duration<double, std::nano>(clock::now() - start).count() / iterations);
+    }
+
+    std::sort(samples.begin(), samples.end());
+    return samples.at(SAMPLES / 2);
+}
+
+static void randomize(matrix& m, std::mt19937& generator) {
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    m.applyFunction([&](float) { return distribution(generator); });
+}
+
+static bool selected(const benchOptions& options, const std::string& name) {
+    return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+static void benchMatrixProduct(const benchOptions& options, std::vector<benchResult>& results) {
+    std::mt19937 generator(1);
+    const int shapes[][3] = { {32, 32, 32}, {64, 64, 64}, {128, 128, 128}, {256, 256, 256}, {512, 512, 512}, {30, 784, 1}, {30, 784, 10}, {30, 784, 256} };
+
+    for (const auto& shape : shapes) {
+        const std::string name = "matrix_product/" + std::to_string(shape[0]) + "x" + std::to_string(shape[1]) + "x" + std::to_string(shape[2]);
+        if (!selected(options, name)) continue;
+
+        matrix a(shape[0], shape[1]), b(shape[1], shape[2]), c;
+        randomize(a, generator);
+        randomize(b, generator);
+
+        const double ns = nanosecondsPerCall(options, [&] { c = a * b; });
+        results.push_back({ name, "gflops", 2.0 * shape[0] * shape[1] * shape[2] / ns, true });
+    }
+}
+
+// The first layer's forward product and weight gradient on MNIST shaped inputs, dense against the
+// compressed inputs the training pipeline builds off the critical path.
+static void benchFirstLayer(const benchOptions& options, std::vector<benchResult>& results) {
+    std::mt19937 generator(3);
+
+    for (int batchSize : { 1, 10, 64 }) {
+        syntheticMNIST data(batchSize);
+        std::vector<int> indices(batchSize);
+        for (int i = 0; i < batchSize; i++) indices.at(i) = i;
+
+        matrix inputs, targets;
+        data.assembleBatch(indices.data(), batchSize, inputs, targets);
+
+        matrix weights(30, MNIST_INPUTS), deltas(30, batchSize), nodes(30, batchSize), gradients(30, MNIST_INPUTS);
+        randomize(weights, generator);
+        randomize(deltas, generator);
+
+        sparseColumns sparseInputs;
+        sparseInputs.compress(inputs, false, 1.0f);
+
+        const std::string name = "first_layer/784x30/batch" + std::to_string(batchSize);
+
+        if (selected(options, name + "/dense")) {
+            const double ns = nanosecondsPerCall(options, [&] {
+                nodes.multiply(weights, inputs, 1.0f, 1.0f);
+                gradients.multiply(deltas, inputs, 1.0f, 0.0f, false, true);
+            });
+            results.push_back({ name + "/dense", "ns_per_example", ns / batchSize, false });
+        }
+
+        if (selected(options, name + "/sparse")) {
+            const double ns = nanosecondsPerCall(options, [&] {
+                sparseGemm(30, batchSize, weights.getDataPointer(), MNIST_INPUTS, sparseInputs.getOffsets(), sparseInputs.getIndices(), sparseInputs.getValues(), nodes.getDataPointer(), batchSize);
+                gradients.fill(0);
+                sparseGemmTransposed(30, batchSize, deltas.getDataPointer(), batchSize, sparseInputs.getOffsets(), sparseInputs.getIndices(), sparseInputs.getValues(), gradients.getDataPointer(), MNIST_INPUTS);
+            });
+            results.push_back({ name + "/sparse", "ns_per_example", ns / batchSize, false });
+        }
+    }
+}
+
+static void benchElementwise(const benchOptions& options, std::vector<benchResult>& results) {
+    std::mt19937 generator(2);
+
+    for (int size : { 1024, 65536, 1048576 }) {
+        matrix a(size, 1), b(size, 1), c(size, 1);
+        randomize(a, generator);
+        randomize(b, generator);
+
+        auto run = [&](const std::string& operation, auto body) {
+            const std::string name = operation + "/" + std::to_string(size);
+            if (selected(options, name)) results.push_back({ name, "ns_per_element", nanosecondsPerCall(options, body) / size, false });
+        };
+
+        run("apply_function", [&] { c.applyFunction([](float x) { return 1.0f / (1.0f + std::exp(-x)); }); });
+        run("add", [&] { c = a + b; });
+        run("add_scaled", [&] { c = a + b * 0.5f; });
+        run("add_assign", [&] { c += a; });
+        run("scale_assign", [&] { c *= -1.0f; });
+        run("axpy", [&] { c.axpy(0.5f, a); });
+    }
+}
+
+template <typename Network>
+static void recordLatencies(const std::string& name, Network& network, const std::vector<matrix>& inputs, std::vector<benchResult>& results) {
+    for (int i = 0; i < LATENCY_RUNS / 10; i++) network.feedfoward(inputs.at(i));
+
+    std::vector<double> latencies;
+    for (const matrix& input : inputs) {
+        const auto start = std::chrono::steady_clock::now();
+        network.feedfoward(input);
+        latencies.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    for (int percentile : { 50, 90, 99 })
+        results.push_back({ name + "/p" + std::to_string(percentile), "ns", latencies.at(latencies.size() * percentile / 100), false });
+}
+
+static std::vector<matrix> latencyInputs(const syntheticMNIST& data) {
+    std::vector<matrix> inputs;
+    matrix targets;
+    for (int i = 0; i < LATENCY_RUNS; i++) {
+        inputs.push_back(matrix());
+        data.assembleBatch(&i, 1, inputs.back(), targets);
+    }
+
+    return inputs;
+}
+
+static void benchFeedforward(const benchOptions& options, std::vector<benchResult>& results) {
+    const std::vector<std::vector<int>> shapes = { {MNIST_INPUTS, 30, MNIST_CLASSES}, {MNIST_INPUTS, 128, 64, MNIST_CLASSES} };
+    syntheticMNIST data(LATENCY_RUNS);
+
+    for (const std::vector<int>& shape : shapes) {
+        std::string name = "feedforward/";
+        for (int layer = 0; layer < shape.size(); layer++) name += (layer ? "-" : "") + std::to_string(shape.at(layer));
+        if (!selected(options, name)) continue;
+
+        neuralNetwork nn(shape);
+        recordLatencies(name, nn, latencyInputs(data), results);
+    }
+
+    // The same model with its shape fixed at compile time, on the heap since its parameters are large for a stack.
+    if (selected(options, "feedforward/fixed/784-30-10")) {
+        std::unique_ptr<fixedNetwork<MNIST_INPUTS, 30, MNIST_CLASSES>> fixed(new fixedNetwork<MNIST_INPUTS, 30, MNIST_CLASSES>());
+        recordLatencies("feedforward/fixed/784-30-10", *fixed, latencyInputs(data), results);
+    }
+}
+
+// Construction draws every parameter once; initialization alone is timed on the bench's thread count.
+static void benchInitialization(const benchOptions& options, std::vector<benchResult>& results) {
+    const std::vector<std::vector<int>> shapes = { {MNIST_INPUTS, 30, MNIST_CLASSES}, {MNIST_INPUTS, 1024, 1024, MNIST_CLASSES}, {4096, 4096, 4096, MNIST_CLASSES} };
+
+    for (const std::vector<int>& shape : shapes) {
+        std::string shapeName;
+        long parameterCount = 0;
+        for (int layer = 0; layer < shape.size(); layer++) {
+            shapeName += (layer ? "-" : "") + std::to_string(shape.at(layer));
+            if (layer) parameterCount += (long)shape.at(layer) * (shape.at(layer - 1) + 1);
+        }
+
+        if (selected(options, "construct/" + shapeName))
+            results.push_back({ "construct/" + shapeName, "ns_per_parameter", nanosecondsPerCall(options, [&] { neuralNetwork nn(shape); }) / parameterCount, false });
+
+        for (initializationScheme scheme : { initializationScheme::uniform, initializationScheme::heNormal }) {
+            const std::string name = "initialize/" + shapeName + (scheme == initializationScheme::uniform ? "/uniform" : "/heNormal") + "/threads" + std::to_string(options.threads);
+            if (!selected(options, name)) continue;
+
+            neuralNetwork nn(shape);
+            nn.setThreadCount(options.threads);
+
+            initializerSettings settings;
+            settings.scheme = scheme;
+            settings.seed = 1;
+
+            results.push_back({ name, "ns_per_parameter", nanosecondsPerCall(options, [&] { nn.initialize(settings); }) / parameterCount, false });
+        }
+    }
+}
+
+static void benchTraining(const benchOptions& options, std::vector<benchResult>& results) {
+    syntheticMNIST data(SYNTHETIC_EXAMPLES);
+
+    for (bool softmax : { false, true })
+    for (int miniBatchSize : { 10, 64 }) {
+        const std::string name = std::string("train/784-30-10") + (softmax ? "-softmax" : "") + "/batch" + std::to_string(miniBatchSize) + "/threads" + std::to_string(options.threads);
+        if (!selected(options, name)) continue;
+
+        neuralNetwork nn({MNIST_INPUTS, 30, MNIST_CLASSES}, softmax ? 0.05f : 0.5f, neuralNetwork::sigmoid, softmax ? neuralNetwork::softmaxCrossEntropy : neuralNetwork::mse, neuralNetwork::L2, 0.01f);
+        nn.setThreadCount(options.threads);
+        // The cost train logs every epoch would interleave with the JSON on stdout.
+        nn.setVerbose(false);
+
+        const auto start = std::chrono::steady_clock::now();
+        nn.train(data, 1, miniBatchSize, false);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        results.push_back({ name, "examples_per_second", data.size() / seconds, true });
+    }
+}
+
+static std::string toJson(const std::vector<benchResult>& results, const benchOptions& options) {
+    std::ostringstream json;
+    json << "{\n";
+    json << "  \"kernel_isa\": \"" << getKernelIsaName() << "\",\n";
+    json << "  \"threads\": " << options.threads << ",\n";
+    json << "  \"results\": [\n";
+
+    // One result per line, which is also the layout readBaseline expects.
+    for (int i = 0; i < results.size(); i++) {
+        const benchResult& result = results.at(i);
+        json << "    {\"name\": \"" << result.name << "\", \"unit\": \"" << result.unit << "\", \"value\": " << result.value
+             << ", \"higher_is_better\": " << (result.higherIsBetter ? "true" : "false") << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    json << "  ]\n}\n";
+    return json.str();
+}
+
+static std::vector<benchResult> readBaseline(const std::string& fileName) {
+    std::ifstream file(fileName);
+    if (!file) throw std::runtime_error("Can't open baseline " + fileName);
+
+    std::vector<benchResult> baseline;
+    std::string line;
+
+    while (std::getline(file, line)) {
+        const size_t name = line.find("\"name\": \"");
+        const size_t value = line.find("\"value\": ");
+        if (name == std::string::npos || value == std::string::npos) continue;
+
+        benchResult result;
+        result.name = line.substr(name + 9, line.find('"', name + 9) - name - 9);
+        result.value = std::strtod(line.c_str() + value + 9, nullptr);
+        result.higherIsBetter = line.find("\"higher_is_better\": true") != std::string::npos;
+        baseline.push_back(result);
+    }
+
+    return baseline;
+}
+
+// Prints every shared result with its relative change and returns how many got worse by more than the threshold.
+static int compareWithBaseline(const std::vector<benchResult>& results, const benchOptions& options) {
+    const std::vector<benchResult> baseline = readBaseline(options.baselineFile);
+    int regressions = 0;
+
+    for (const benchResult& result : results) {
+        auto previous = std::find_if(baseline.begin(), baseline.end(), [&](const benchResult& b) { return b.name == result.name; });
+        if (previous == baseline.end() || previous->value == 0) continue;
+
+        const double change = (result.value - previous->value) / previous->value;
+        const bool regressed = result.higherIsBetter ? change < -options.threshold : change > options.threshold;
+        if (regressed) regressions++;
+
+        std::fprintf(stderr, "%-48s %14.4g -> %14.4g %-20s %+7.1f%%%s\n", result.name.c_str(), previous->value, result.value, result.unit.c_str(), change * 100, regressed ? "  REGRESSION" : "");
+    }
+
+    std::fprintf(stderr, "%d regression(s) beyond %.0f%%\n", regressions, options.threshold * 100);
+    return regressions;
+}
+
+static void printUsage() {
+    std::cerr << "Usage: bench [--quick] [--filter text] [--threads n] [--isa scalar|avx2|avx512] [--out file.json] [--compare baseline.json] [--threshold fraction]" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    benchOptions options;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string argument = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if (argument == "--quick") options.minSeconds = 0.02;
+        else if (argument == "--filter" && hasValue) options.filter = argv[++i];
+        else if (argument == "--threads" && hasValue) options.threads = std::max(1, std::atoi(argv[++i]));
+        else if (argument == "--out" && hasValue) options.outputFile = argv[++i];
+        else if (argument == "--compare" && hasValue) options.baselineFile = argv[++i];
+        else if (argument == "--threshold" && hasValue) options.threshold = std::atof(argv[++i]);
+        else if (argument == "--isa" && hasValue) {
+            const std::string isa = argv[++i];
+            setKernelIsa(isa == "scalar" ? kernelIsa::scalar : isa == "avx2" ? kernelIsa::avx2 : isa == "avx512" ? kernelIsa::avx512 : kernelIsa::automatic);
+        } else {
+            printUsage();
+            return 2;
+        }
+    }
+
+    std::vector<benchResult> results;
+    benchMatrixProduct(options, results);
+    benchElementwise(options, results);
+    benchFirstLayer(options, results);
+    benchFeedforward(options, results);
+    benchInitialization(options, results);
+    benchTraining(options, results);
+
+    const std::string json = toJson(results, options);
+    if (options.outputFile.empty()) std::cout << json;
+    else std::ofstream(options.outputFile) << json;
+
+    if (!options.baselineFile.empty() && compareWithBaseline(results, options) > 0) return 1;
+
+    return 0;
+}
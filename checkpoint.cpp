@@ -0,0 +1,201 @@
+#include "checkpoint.h"
+#include "modelFile.h"
+#include "mappedFile.h"
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+template <typename T>
+static void appendBytes(std::vector<unsigned char>& bytes, const T* values, size_t count) {
+    const unsigned char* begin = (const unsigned char*)values;
+    bytes.insert(bytes.end(), begin, begin + count * sizeof(T));
+}
+
+template <typename T>
+static const unsigned char* takeBytes(const unsigned char* position, const unsigned char* end, T* values, size_t count) {
+    if ((size_t)(end - position) / sizeof(T) < count) throw std::runtime_error("Truncated checkpoint file");
+
+    std::memcpy(values, position, count * sizeof(T));
+    return position + count * sizeof(T);
+}
+
+void writeCheckpoint(const std::string& fileName, const trainingSnapshot& snapshot) {
+    std::vector<unsigned char> bytes(sizeof(checkpointFileHeader));
+
+    for (int layerSize : snapshot.shape) {
+        const uint32_t size = layerSize;
+        appendBytes(bytes, &size, 1);
+    }
+    appendBytes(bytes, snapshot.parameters.data(), snapshot.parameters.size());
+    appendBytes(bytes, snapshot.optimizerState.data(), snapshot.optimizerState.size());
+    appendBytes(bytes, snapshot.order.data(), snapshot.order.size());
+    appendBytes(bytes, snapshot.generatorState.data(), snapshot.generatorState.size());
+
+    checkpointFileHeader header = {};
+    std::memcpy(header.magic, CHECKPOINT_FILE_MAGIC, sizeof(CHECKPOINT_FILE_MAGIC));
+    header.version = CHECKPOINT_FILE_VERSION;
+    header.layerCount = snapshot.shape.size();
+    header.epochs = snapshot.epochs;
+    header.miniBatchSize = snapshot.miniBatchSize;
+    header.epoch = snapshot.epoch;
+    header.batch = snapshot.batch;
+    header.shuffleData = snapshot.shuffleData;
+    header.optimizerKind = snapshot.optimizerKind;
+    header.optimizerSteps = snapshot.optimizerSteps;
+    header.parameterCount = snapshot.parameters.size();
+    header.optimizerStateCount = snapshot.optimizerState.size();
+    header.orderCount = snapshot.order.size();
+    header.generatorBytes = snapshot.generatorState.size();
+    header.checksum = modelFile::checksum(bytes.data() + sizeof(header), bytes.size() - sizeof(header));
+    std::memcpy(bytes.data(), &header, sizeof(header));
+
+    const std::string temporaryName = fileName + ".tmp";
+    const int descriptor = open(temporaryName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (descriptor < 0) throw std::runtime_error("Can't create checkpoint file " + temporaryName);
+
+    bool written = true;
+    for (size_t offset = 0; written && offset < bytes.size();) {
+        const ssize_t count = ::write(descriptor, bytes.data() + offset, bytes.size() - offset);
+        if (count < 0 && errno == EINTR) continue;
+
+        written = count > 0;
+        offset += written ? count : 0;
+    }
+
+    written = written && fsync(descriptor) == 0;
+    written = close(descriptor) == 0 && written;
+
+    if (!written || std::rename(temporaryName.c_str(), fileName.c_str()) != 0) {
+        unlink(temporaryName.c_str());
+        throw std::runtime_error("Can't write checkpoint file " + fileName);
+    }
+}
+
+trainingSnapshot readCheckpoint(const char* fileName) {
+    mappedFile file(fileName);
+    const unsigned char* position = file.getData();
+    const unsigned char* end = position + file.getSize();
+
+    checkpointFileHeader header;
+    if (file.getSize() < sizeof(header) || std::memcmp(position, CHECKPOINT_FILE_MAGIC, sizeof(CHECKPOINT_FILE_MAGIC)) != 0)
+        throw std::runtime_error(std::string("Not a checkpoint file: ") + fileName);
+    position = takeBytes(position, end, &header, 1);
+
+    if (header.version != CHECKPOINT_FILE_VERSION) throw std::runtime_error(std::string("Unsupported checkpoint file version in ") + fileName);
+    if (header.checksum != modelFile::checksum(position, end - position)) throw std::runtime_error(std::string("Checkpoint file checksum mismatch in ") + fileName);
+
+    trainingSnapshot snapshot;
+    snapshot.epochs = header.epochs;
+    snapshot.miniBatchSize = header.miniBatchSize;
+    snapshot.epoch = header.epoch;
+    snapshot.batch = header.batch;
+    snapshot.shuffleData = header.shuffleData;
+    snapshot.optimizerKind = header.optimizerKind;
+    snapshot.optimizerSteps = header.optimizerSteps;
+
+    std::vector<uint32_t> shape(header.layerCount);
+    position = takeBytes(position, end, shape.data(), shape.size());
+    snapshot.shape.assign(shape.begin(), shape.end());
+
+    snapshot.parameters.resize(header.parameterCount);
+    position = takeBytes(position, end, snapshot.parameters.data(), snapshot.parameters.size());
+    snapshot.optimizerState.resize(header.optimizerStateCount);
+    position = takeBytes(position, end, snapshot.optimizerState.data(), snapshot.optimizerState.size());
+    snapshot.order.resize(header.orderCount);
+    position = takeBytes(position, end, snapshot.order.data(), snapshot.order.size());
+    snapshot.generatorState.resize(header.generatorBytes);
+    position = takeBytes(position, end, &snapshot.generatorState[0], snapshot.generatorState.size());
+
+    if (position != end) throw std::runtime_error(std::string("Checkpoint file size does not match its header in ") + fileName);
+
+    return snapshot;
+}
+
+checkpointWriter::checkpointWriter(const std::string& checkpointFileName) : fileName(checkpointFileName) {
+    writer = std::thread(&checkpointWriter::write, this);
+}
+
+checkpointWriter::~checkpointWriter() {
+    {
+        std::unique_lock<std::mutex> lock(stateMutex);
+        changed.wait(lock, [&] { return states[0] != bufferState::pending && states[0] != bufferState::writing && states[1] != bufferState::pending && states[1] != bufferState::writing; });
+        stopping = true;
+    }
+    changed.notify_all();
+
+    writer.join();
+}
+
+void checkpointWriter::write() {
+    while (true) {
+        int buffer;
+        {
+            std::unique_lock<std::mutex> lock(stateMutex);
+            changed.wait(lock, [&] { return stopping || states[0] == bufferState::pending || states[1] == bufferState::pending; });
+            if (stopping) return;
+
+            buffer = states[0] == bufferState::pending ? 0 : 1;
+            states[buffer] = bufferState::writing;
+        }
+
+        std::exception_ptr writeFailure;
+        try {
+            writeCheckpoint(fileName, buffers[buffer]);
+        } catch (...) {
+            writeFailure = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            if (writeFailure) failure = writeFailure;
+            states[buffer] = bufferState::free;
+        }
+        changed.notify_all();
+    }
+}
+
+trainingSnapshot* checkpointWriter::acquire() {
+    std::lock_guard<std::mutex> lock(stateMutex);
+
+    if (failure) std::rethrow_exception(failure);
+
+    for (int buffer = 0; buffer < 2; buffer++) {
+        if (states[buffer] == bufferState::free) {
+            states[buffer] = bufferState::filling;
+            return &buffers[buffer];
+        }
+    }
+
+    skipped++;
+    return nullptr;
+}
+
+void checkpointWriter::submit(trainingSnapshot* snapshot) {
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        const int buffer = snapshot - buffers;
+
+        // A snapshot still waiting behind a write is superseded by this newer one.
+        if (states[1 - buffer] == bufferState::pending) {
+            states[1 - buffer] = bufferState::free;
+            skipped++;
+        }
+
+        states[buffer] = bufferState::pending;
+    }
+    changed.notify_all();
+}
+
+void checkpointWriter::flush() {
+    std::unique_lock<std::mutex> lock(stateMutex);
+    changed.wait(lock, [&] { return states[0] != bufferState::pending && states[0] != bufferState::writing && states[1] != bufferState::pending && states[1] != bufferState::writing; });
+
+    if (failure) std::rethrow_exception(failure);
+}
+
+long checkpointWriter::getSkippedCount() const {
+    return skipped;
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstdint>
+
+#define CHECKPOINT_FILE_MAGIC "NNCKPT"
+#define CHECKPOINT_FILE_VERSION 1
+
+struct checkpointSettings {
+    // Empty disables checkpointing.
+    std::string fileName;
+    // A checkpoint every this many mini-batches, or 0 for one at the end of every epoch only.
+    int intervalBatches = 0;
+};
+
+// Everything a train call needs to carry on from a batch boundary exactly as it would have:
+// the parameters and optimizer state, the shuffle generator and the epoch's order, and the
+// position of the next batch.
+struct trainingSnapshot {
+    std::vector<int> shape;
+    // Every weight matrix and then every bias vector, in layer order.
+    std::vector<float> parameters;
+    uint32_t optimizerKind = 0;
+    std::vector<float> optimizerState;
+    long optimizerSteps = 0;
+    // The std::mt19937 used for shuffling, in its textual stream form.
+    std::string generatorState;
+    std::vector<int> order;
+
+    int epochs = 0;
+    int miniBatchSize = 0;
+    bool shuffleData = false;
+    int epoch = 0;
+    int batch = 0;
+};
+
+// Fixed-size little-endian prefix of a checkpoint file, followed by layerCount uint32 layer sizes,
+// the float32 parameters, the float32 optimizer state, the int32 order and the generator state.
+// The checksum is FNV-1a over all bytes after the header.
+struct checkpointFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t layerCount;
+    uint32_t epochs;
+    uint32_t miniBatchSize;
+    uint32_t epoch;
+    uint32_t batch;
+    uint32_t shuffleData;
+    uint32_t optimizerKind;
+    uint64_t optimizerSteps;
+    uint64_t parameterCount;
+    uint64_t optimizerStateCount;
+    uint64_t orderCount;
+    uint64_t generatorBytes;
+    uint64_t checksum;
+};
+
+// Writes to fileName.tmp, flushes it to disk and renames it over fileName, so a crash at any
+// point leaves either the previous checkpoint or the new one.
+void writeCheckpoint(const std::string& fileName, const trainingSnapshot& snapshot);
+trainingSnapshot readCheckpoint(const char* fileName);
+
+// Writes snapshots on a background thread. There are two snapshot buffers: while one is being
+// written the other can be filled, and when neither is free the checkpoint is skipped, so the
+// training thread only ever pays for copying its state.
+class checkpointWriter {
+private:
+    enum class bufferState { free, filling, pending, writing };
+
+    const std::string fileName;
+
+    trainingSnapshot buffers[2];
+    bufferState states[2] = { bufferState::free, bufferState::free };
+    long skipped = 0;
+    bool stopping = false;
+    std::exception_ptr failure;
+
+    std::mutex stateMutex;
+    std::condition_variable changed;
+    std::thread writer;
+
+    void write();
+
+public:
+    checkpointWriter(const std::string& checkpointFileName);
+    // Waits for the snapshots already submitted to be written.
+    ~checkpointWriter();
+
+    checkpointWriter(const checkpointWriter&) = delete;
+    checkpointWriter& operator=(const checkpointWriter&) = delete;
+
+    // A buffer to fill and then submit, or nullptr while both are busy. Rethrows a failed write.
+    trainingSnapshot* acquire();
+    void submit(trainingSnapshot* snapshot);
+    // Blocks until everything submitted is on disk, then rethrows a failed write.
+    void flush();
+
+    long getSkippedCount() const;
+};
@@ -0,0 +1,120 @@
+#include "batchPipeline.h"
+#include "../metrics.h"
+#include <stdexcept>
+#include <algorithm>
+
+batchPipeline::batchPipeline(const dataSource& dataSource, int miniBatchSize, int sliceCount, float sparseInputDensity, int depth)
+    : source(dataSource), batchSize(miniBatchSize), slices(sliceCount), sparseDensity(sparseInputDensity), batches(depth), slots(depth, slotState::free), slotBatches(depth, -1) {
+    if (depth < 1 || sliceCount < 1 || sliceCount > miniBatchSize) throw std::logic_error("Bad batch pipeline configuration");
+
+    for (preparedBatch& batch : batches) {
+        batch.inputs.resize(slices);
+        batch.targets.resize(slices);
+        batch.sparseInputs.resize(slices);
+    }
+
+    producer = std::thread(&batchPipeline::produce, this);
+}
+
+batchPipeline::~batchPipeline() {
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    slotFreed.notify_all();
+
+    producer.join();
+}
+
+void batchPipeline::startEpoch(const std::vector<int>& exampleOrder, int firstBatch) {
+    std::lock_guard<std::mutex> lock(stateMutex);
+
+    if (consumed != epochBatches) throw std::logic_error("Previous epoch has not been fully consumed");
+
+    failure = nullptr;
+    order = exampleOrder.data();
+    epochBatches = exampleOrder.size() / batchSize;
+    produced = std::min(firstBatch, epochBatches);
+    consumed = produced;
+    epoch++;
+
+    slotFreed.notify_all();
+}
+
+void batchPipeline::produce() {
+    unsigned long producedEpoch = 0;
+
+    while (true) {
+        int batchIndex;
+        preparedBatch* batch;
+        {
+            std::unique_lock<std::mutex> lock(stateMutex);
+            slotFreed.wait(lock, [&] {
+                if (stopping) return true;
+                if (epoch != producedEpoch && produced < epochBatches) return slots.at(produced % slots.size()) == slotState::free;
+                return false;
+            });
+            if (stopping) return;
+
+            batchIndex = produced;
+            batch = &batches.at(batchIndex % slots.size());
+        }
+
+        try {
+            NN_TIMED_SCOPE(batchAssembly);
+            const int* batchOrder = order + (long)batchIndex * batchSize;
+
+            for (int slice = 0; slice < slices; slice++) {
+                const int sliceBegin = slice * batchSize / slices;
+                const int sliceEnd = (slice + 1) * batchSize / slices;
+                source.assembleBatch(batchOrder + sliceBegin, sliceEnd - sliceBegin, batch->inputs.at(slice), batch->targets.at(slice));
+
+                if (sparseDensity > 0) batch->sparseInputs.at(slice).compress(batch->inputs.at(slice), false, sparseDensity);
+                else batch->sparseInputs.at(slice).clear();
+            }
+            batch->count = batchSize;
+            batch->index = batchIndex;
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            failure = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> lock(stateMutex);
+        slots.at(batchIndex % slots.size()) = slotState::ready;
+        slotBatches.at(batchIndex % slots.size()) = batchIndex;
+        if (++produced == epochBatches || failure) {
+            produced = epochBatches;
+            producedEpoch = epoch;
+        }
+        batchReady.notify_all();
+    }
+}
+
+preparedBatch* batchPipeline::acquire() {
+    NN_TIMED_SCOPE(batchWait);
+    std::unique_lock<std::mutex> lock(stateMutex);
+
+    if (failure) std::rethrow_exception(failure);
+    if (consumed == epochBatches) return nullptr;
+
+    const int batchIndex = consumed++;
+    const int slot = batchIndex % slots.size();
+    batchReady.wait(lock, [&] { return failure || (slots.at(slot) == slotState::ready && slotBatches.at(slot) == batchIndex); });
+
+    if (failure) std::rethrow_exception(failure);
+
+    slots.at(slot) = slotState::inUse;
+
+    return &batches.at(slot);
+}
+
+void batchPipeline::release(preparedBatch* batch) {
+    std::lock_guard<std::mutex> lock(stateMutex);
+
+    slots.at(batch - batches.data()) = slotState::free;
+    slotFreed.notify_all();
+}
+
+int batchPipeline::batchesPerEpoch() const {
+    return epochBatches;
+}
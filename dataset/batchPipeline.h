@@ -0,0 +1,70 @@
+#pragma once
+#include "dataSource.h"
+#include "../matrix/sparseColumns.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+// A mini-batch assembled ahead of time, split into consecutive column slices (one per worker).
+struct preparedBatch {
+    std::vector<matrix> inputs;
+    std::vector<matrix> targets;
+    // Compressed copies of the input slices, left empty for slices that are too dense
+    std::vector<sparseColumns> sparseInputs;
+    int count = 0;
+    // Position of the batch within its epoch
+    int index = 0;
+};
+
+// Background producer that assembles the mini-batches of an epoch from a permutation of example
+// indices while the previous ones are being trained on. Batches go through a ring of `depth`
+// reusable buffers, so steady-state operation neither allocates nor copies the dataset.
+class batchPipeline {
+private:
+    enum class slotState { free, ready, inUse };
+
+    const dataSource& source;
+    const int batchSize;
+    const int slices;
+    const float sparseDensity;
+
+    std::vector<preparedBatch> batches;
+    std::vector<slotState> slots;
+    std::vector<int> slotBatches;
+
+    const int* order = nullptr;
+    int epochBatches = 0;
+    int produced = 0;
+    int consumed = 0;
+    unsigned long epoch = 0;
+    bool stopping = false;
+    std::exception_ptr failure;
+
+    std::mutex stateMutex;
+    std::condition_variable slotFreed;
+    std::condition_variable batchReady;
+    std::thread producer;
+
+    void produce();
+
+public:
+    // Slices whose inputs have at most sparseInputDensity non-zeros also get a compressed copy,
+    // built here off the training threads. 0 disables it.
+    batchPipeline(const dataSource& dataSource, int miniBatchSize, int sliceCount, float sparseInputDensity = 0, int depth = 3);
+    ~batchPipeline();
+
+    batchPipeline(const batchPipeline&) = delete;
+    batchPipeline& operator=(const batchPipeline&) = delete;
+
+    // Starts producing every full mini-batch of `exampleOrder` from firstBatch on; the order must
+    // stay unchanged until they are all acquired.
+    void startEpoch(const std::vector<int>& exampleOrder, int firstBatch = 0);
+
+    // Returns the next batch in order, or nullptr once the epoch is exhausted. Safe to call from several threads.
+    preparedBatch* acquire();
+    void release(preparedBatch* batch);
+
+    int batchesPerEpoch() const;
+};
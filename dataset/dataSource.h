@@ -0,0 +1,16 @@
+#pragma once
+#include "../matrix/matrix.h"
+
+// A read-only collection of examples that can be gathered into batches on demand.
+// assembleBatch may be called concurrently from several threads.
+class dataSource {
+public:
+    virtual ~dataSource() {};
+
+    virtual int size() const = 0;
+    virtual int inputSize() const = 0;
+    virtual int targetSize() const = 0;
+
+    // Writes the examples at indices[0..count) as the columns of inputs (inputSize x count) and targets (targetSize x count).
+    virtual void assembleBatch(const int* indices, int count, matrix& inputs, matrix& targets) const = 0;
+};
@@ -0,0 +1,59 @@
+#include "idxDataset.h"
+#include <stdexcept>
+
+idxDataset::idxDataset(const char* inputsFileName, const char* labelsFileName, float scale, int classCount) : inputs(inputsFileName), labels(labelsFileName) {
+    if (inputs.getType() != idxType::unsignedByte || labels.getType() != idxType::unsignedByte)
+        throw std::runtime_error("IDX dataset needs unsigned byte inputs and labels");
+    if (labels.getDimensionCount() != 1) throw std::runtime_error("IDX labels must be one dimensional");
+    if (inputs.getDimension(0) != labels.getDimension(0)) throw std::runtime_error("IDX inputs and labels have different example counts");
+
+    examples = inputs.getDimension(0);
+    exampleSize = inputs.getElementCount() / (examples > 0 ? examples : 1);
+    inputScale = scale;
+
+    int largestLabel = 0;
+    for (int example = 0; example < examples; example++)
+        if (labels.getData()[example] > largestLabel) largestLabel = labels.getData()[example];
+
+    classes = classCount > 0 ? classCount : largestLabel + 1;
+    if (largestLabel >= classes) throw std::runtime_error("IDX label out of range for class count");
+}
+
+int idxDataset::size() const {
+    return examples;
+}
+
+int idxDataset::inputSize() const {
+    return exampleSize;
+}
+
+int idxDataset::targetSize() const {
+    return classes;
+}
+
+void idxDataset::assembleBatch(const int* indices, int count, matrix& batchInputs, matrix& batchTargets) const {
+    batchInputs.resize(exampleSize, count);
+    batchTargets.resize(classes, count);
+    batchTargets.fill(0.0f);
+
+    float* inputData = batchInputs.getDataPointer();
+    float* targetData = batchTargets.getDataPointer();
+
+    for (int example = 0; example < count; example++) {
+        const int index = indices[example];
+        if (index < 0 || index >= examples) throw std::logic_error("Example index out of range");
+
+        const unsigned char* pixels = getInput(index);
+        for (int i = 0; i < exampleSize; i++) inputData[i * count + example] = pixels[i] * inputScale;
+
+        targetData[getLabel(index) * count + example] = 1.0f;
+    }
+}
+
+const unsigned char* idxDataset::getInput(int index) const {
+    return inputs.getData() + (size_t)index * exampleSize;
+}
+
+int idxDataset::getLabel(int index) const {
+    return labels.getData()[index];
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "dataSource.h"
+#include "idxFile.h"
+
+// Classification dataset backed by a pair of memory-mapped IDX files: unsigned byte inputs
+// (N x d1 x ... x dk) and unsigned byte labels (N). Inputs stay as bytes on disk and in the
+// page cache; they are scaled into floats and labels are one-hot encoded only when a batch is assembled.
+class idxDataset : public dataSource {
+private:
+    idxFile inputs;
+    idxFile labels;
+
+    int examples;
+    int exampleSize;
+    int classes;
+    float inputScale;
+
+public:
+    idxDataset(const char* inputsFileName, const char* labelsFileName, float inputScale = 1.0f / 255, int classCount = 0);
+
+    int size() const override;
+    int inputSize() const override;
+    int targetSize() const override;
+
+    void assembleBatch(const int* indices, int count, matrix& batchInputs, matrix& batchTargets) const override;
+
+    const unsigned char* getInput(int index) const;
+    int getLabel(int index) const;
+};
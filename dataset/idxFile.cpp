@@ -0,0 +1,60 @@
+#include "idxFile.h"
+#include <stdexcept>
+#include <string>
+
+static unsigned int readBigEndian(const unsigned char* bytes) {
+    return ((unsigned int)bytes[0] << 24) | ((unsigned int)bytes[1] << 16) | ((unsigned int)bytes[2] << 8) | (unsigned int)bytes[3];
+}
+
+idxFile::idxFile(const char* fileName) : file(fileName) {
+    const unsigned char* bytes = file.getData();
+
+    if (file.getSize() < 4 || bytes[0] != 0 || bytes[1] != 0) throw std::runtime_error(std::string("Bad IDX magic number in ") + fileName);
+
+    switch (bytes[2]) {
+        case 0x08: case 0x09: case 0x0B: case 0x0C: case 0x0D: case 0x0E: type = (idxType)bytes[2]; break;
+        default: throw std::runtime_error(std::string("Unknown IDX element type in ") + fileName);
+    }
+
+    const int dimensionCount = bytes[3];
+    headerSize = 4 + 4 * (size_t)dimensionCount;
+
+    if (dimensionCount == 0 || file.getSize() < headerSize) throw std::runtime_error(std::string("Truncated IDX header in ") + fileName);
+
+    for (int dimension = 0; dimension < dimensionCount; dimension++)
+        dimensions.push_back(readBigEndian(bytes + 4 + 4 * dimension));
+
+    if (file.getSize() != headerSize + getElementCount() * getElementSize(type))
+        throw std::runtime_error(std::string("IDX header does not match file size in ") + fileName);
+}
+
+idxType idxFile::getType() const {
+    return type;
+}
+
+int idxFile::getDimensionCount() const {
+    return dimensions.size();
+}
+
+int idxFile::getDimension(int dimension) const {
+    return dimensions.at(dimension);
+}
+
+size_t idxFile::getElementCount() const {
+    size_t count = 1;
+    for (int dimension : dimensions) count *= dimension;
+    return count;
+}
+
+size_t idxFile::getElementSize(idxType type) {
+    switch (type) {
+        case idxType::shortInt: return 2;
+        case idxType::integer: case idxType::singleFloat: return 4;
+        case idxType::doubleFloat: return 8;
+        default: return 1;
+    }
+}
+
+const unsigned char* idxFile::getData() const {
+    return file.getData() + headerSize;
+}
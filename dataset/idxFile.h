@@ -0,0 +1,29 @@
+#pragma once
+#include "../mappedFile.h"
+#include <vector>
+#include <cstddef>
+
+enum class idxType { unsignedByte = 0x08, signedByte = 0x09, shortInt = 0x0B, integer = 0x0C, singleFloat = 0x0D, doubleFloat = 0x0E };
+
+// Read-only memory mapping of an IDX file (the format used by MNIST and its relatives).
+// The header is validated against the file size on open; elements are left in place.
+class idxFile {
+private:
+    mappedFile file;
+
+    idxType type;
+    std::vector<int> dimensions;
+    size_t headerSize;
+
+public:
+    idxFile(const char* fileName);
+
+    idxType getType() const;
+    int getDimensionCount() const;
+    int getDimension(int dimension) const;
+    size_t getElementCount() const;
+    static size_t getElementSize(idxType type);
+
+    // Elements in file order; multi-byte types are big-endian as stored on disk.
+    const unsigned char* getData() const;
+};
@@ -0,0 +1,28 @@
+#include "subsetSource.h"
+#include <vector>
+#include <stdexcept>
+
+subsetSource::subsetSource(const dataSource& dataSource, int firstExample, int exampleCount) : source(dataSource), first(firstExample), count(exampleCount) {
+    if (first < 0 || count < 0 || first + count > source.size()) throw std::logic_error("Subset is out of the source's range");
+}
+
+int subsetSource::size() const {
+    return count;
+}
+
+int subsetSource::inputSize() const {
+    return source.inputSize();
+}
+
+int subsetSource::targetSize() const {
+    return source.targetSize();
+}
+
+void subsetSource::assembleBatch(const int* indices, int batchCount, matrix& inputs, matrix& targets) const {
+    thread_local std::vector<int> sourceIndices;
+
+    sourceIndices.resize(batchCount);
+    for (int i = 0; i < batchCount; i++) sourceIndices[i] = first + indices[i];
+
+    source.assembleBatch(sourceIndices.data(), batchCount, inputs, targets);
+}
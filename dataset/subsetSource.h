@@ -0,0 +1,20 @@
+#pragma once
+#include "dataSource.h"
+
+// A contiguous range of another source's examples, e.g. to hold the end of a training set out
+// for validation without copying it.
+class subsetSource : public dataSource {
+private:
+    const dataSource& source;
+    int first;
+    int count;
+
+public:
+    subsetSource(const dataSource& dataSource, int firstExample, int exampleCount);
+
+    int size() const override;
+    int inputSize() const override;
+    int targetSize() const override;
+
+    void assembleBatch(const int* indices, int batchCount, matrix& inputs, matrix& targets) const override;
+};
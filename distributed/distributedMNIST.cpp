@@ -0,0 +1,46 @@
+#include "../neuralNetwork.h"
+#include "../dataset/idxDataset.h"
+#include "../metrics.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+
+// Data-parallel MNIST training, one process per rank: run it through nnLaunch, or directly to
+// train alone. Every rank reports its test accuracy, which is the same on all of them.
+int main(int argc, char** argv) {
+    if (argc < 5) {
+        std::cerr << "usage: distributedMNIST trainImages trainLabels testImages testLabels [epochs] [miniBatchSize per rank]\n";
+        return 2;
+    }
+
+    const int epochs = argc > 5 ? std::atoi(argv[5]) : 2;
+    const int miniBatchSize = argc > 6 ? std::atoi(argv[6]) : 10;
+
+    idxDataset trainingData(argv[1], argv[2], 1.0f / 255, 10);
+    idxDataset testingData(argv[3], argv[4], 1.0f / 255, 10);
+
+    try {
+        std::shared_ptr<processGroup> processes = std::make_shared<processGroup>(processGroupSettings::fromEnvironment());
+
+        neuralNetwork nn({784, 30, 10}, 0.05f, nn.sigmoid, nn.softmaxCrossEntropy, nn.L2, 0.01f);
+        nn.setProcessGroup(processes);
+
+        setMetricsEnabled(true);
+
+        const auto trainingStart = std::chrono::steady_clock::now();
+        nn.train(trainingData, epochs, miniBatchSize, true);
+        const std::chrono::duration<double> trainingTime = std::chrono::steady_clock::now() - trainingStart;
+
+        std::cout << "Rank " << processes->getRank() << " of " << processes->getSize() << ": accuracy over testing data " << nn.getAccuracyOverExamples(testingData)
+                  << ", training time " << trainingTime.count() << "s" << std::endl;
+        if (processes->getRank() == 0) std::cout << "Training metrics: " << metricsToJson(getMetrics()) << std::endl;
+
+        processes->barrier();
+    } catch (const std::exception& failure) {
+        std::cerr << failure.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
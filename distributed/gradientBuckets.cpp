@@ -0,0 +1,125 @@
+#include "gradientBuckets.h"
+#include "../metrics.h"
+#include <algorithm>
+#include <cstring>
+
+gradientBuckets::gradientBuckets(processGroup& processes, const std::vector<int>& shape, size_t bucketFloats) : group(processes), layerBuckets(shape.size() - 1) {
+    size_t bucketSize = bucketFloats;
+
+    for (int layer = shape.size() - 1; layer > 0; layer--) {
+        const size_t layerSize = (size_t)shape.at(layer) * shape.at(layer - 1) + shape.at(layer);
+
+        if (bucketSize >= bucketFloats) {
+            buckets.push_back(bucket());
+            bucketSize = 0;
+        }
+
+        buckets.back().layers.push_back(layer - 1);
+        layerBuckets.at(layer - 1) = buckets.size() - 1;
+        bucketSize += layerSize;
+    }
+
+    for (bucket& layerBucket : buckets) {
+        size_t values = 0;
+        for (int layer : layerBucket.layers) values += (size_t)shape.at(layer + 1) * shape.at(layer) + shape.at(layer + 1);
+        layerBucket.values.resize(values);
+        layerBucket.reduced = true;
+    }
+    nextBucket = buckets.size();
+
+    communicator = std::thread(&gradientBuckets::communicate, this);
+}
+
+gradientBuckets::~gradientBuckets() {
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    changed.notify_all();
+
+    communicator.join();
+}
+
+void gradientBuckets::begin(std::vector<matrix>& stepWeightsGradients, std::vector<matrix>& stepBiasesGradients) {
+    std::lock_guard<std::mutex> lock(stateMutex);
+
+    if (failure) std::rethrow_exception(failure);
+
+    weightsGradients = &stepWeightsGradients;
+    biasesGradients = &stepBiasesGradients;
+
+    for (bucket& layerBucket : buckets) {
+        layerBucket.pendingLayers = layerBucket.layers.size();
+        layerBucket.reduced = false;
+    }
+    nextBucket = 0;
+}
+
+void gradientBuckets::layerReady(int layer) {
+    bool bucketReady;
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        bucketReady = --buckets.at(layerBuckets.at(layer)).pendingLayers == 0;
+    }
+
+    if (bucketReady) changed.notify_all();
+}
+
+void gradientBuckets::waitForLayer(int layer) {
+    std::unique_lock<std::mutex> lock(stateMutex);
+    const bucket& layerBucket = buckets.at(layerBuckets.at(layer));
+
+    changed.wait(lock, [&] { return failure || layerBucket.reduced; });
+    if (failure) std::rethrow_exception(failure);
+}
+
+void gradientBuckets::communicate() {
+    while (true) {
+        bucket* current;
+        {
+            std::unique_lock<std::mutex> lock(stateMutex);
+            changed.wait(lock, [&] { return stopping || (nextBucket < buckets.size() && buckets.at(nextBucket).pendingLayers == 0); });
+            if (stopping) return;
+
+            current = &buckets.at(nextBucket);
+        }
+
+        try {
+            NN_TIMED_SCOPE(gradientAllReduce);
+
+            float* position = current->values.data();
+            for (int layer : current->layers) {
+                const matrix& layerWeights = weightsGradients->at(layer);
+                const matrix& layerBiases = biasesGradients->at(layer);
+
+                position = std::copy(layerWeights.getDataPointer(), layerWeights.getDataPointer() + (size_t)layerWeights.rows * layerWeights.cols, position);
+                position = std::copy(layerBiases.getDataPointer(), layerBiases.getDataPointer() + layerBiases.rows, position);
+            }
+
+            group.allReduce(current->values.data(), current->values.size());
+
+            position = current->values.data();
+            for (int layer : current->layers) {
+                matrix& layerWeights = weightsGradients->at(layer);
+                matrix& layerBiases = biasesGradients->at(layer);
+
+                std::memcpy(layerWeights.getDataPointer(), position, (size_t)layerWeights.rows * layerWeights.cols * sizeof(float));
+                position += (size_t)layerWeights.rows * layerWeights.cols;
+                std::memcpy(layerBiases.getDataPointer(), position, layerBiases.rows * sizeof(float));
+                position += layerBiases.rows;
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            failure = std::current_exception();
+            changed.notify_all();
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            current->reduced = true;
+            nextBucket++;
+        }
+        changed.notify_all();
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "processGroup.h"
+#include "../matrix/matrix.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+// Sums a network's gradients over a process group while backpropagation is still running. Layers
+// are grouped into buckets of about bucketFloats values, output layer first since that is the
+// order their gradients are finished in, and a communication thread all-reduces each bucket as soon
+// as its last layer is ready. Earlier layers' gradients, and the updates of buckets already
+// reduced, are computed in the meantime.
+class gradientBuckets {
+private:
+    struct bucket {
+        std::vector<int> layers;
+        std::vector<float> values;
+        int pendingLayers = 0;
+        bool reduced = false;
+    };
+
+    processGroup& group;
+    std::vector<bucket> buckets;
+    std::vector<int> layerBuckets;
+
+    std::vector<matrix>* weightsGradients = nullptr;
+    std::vector<matrix>* biasesGradients = nullptr;
+    int nextBucket = 0;
+    bool stopping = false;
+    std::exception_ptr failure;
+
+    std::mutex stateMutex;
+    std::condition_variable changed;
+    std::thread communicator;
+
+    void communicate();
+
+public:
+    gradientBuckets(processGroup& processes, const std::vector<int>& shape, size_t bucketFloats);
+    ~gradientBuckets();
+
+    gradientBuckets(const gradientBuckets&) = delete;
+    gradientBuckets& operator=(const gradientBuckets&) = delete;
+
+    // Starts a step whose gradients are summed into these matrices, one of each per layer.
+    void begin(std::vector<matrix>& stepWeightsGradients, std::vector<matrix>& stepBiasesGradients);
+    // The layer's gradients are final on this rank and won't be touched until waitForLayer.
+    void layerReady(int layer);
+    // Blocks until the layer's gradients hold their sum over every rank, rethrowing a failed reduction.
+    void waitForLayer(int layer);
+};
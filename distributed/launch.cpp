@@ -0,0 +1,120 @@
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Starts one copy of a program per rank with NN_RANK, NN_WORLD_SIZE and NN_RENDEZVOUS set, as
+// processGroupSettings::fromEnvironment reads them. The first rank to fail is reported and the
+// others are stopped, since the ring can't go on without it.
+
+static void printUsage() {
+    std::cerr << "usage: nnLaunch --processes n [--rendezvous unix:<directory>|tcp:<host>:<port>] -- program [arguments...]\n"
+                 "The default rendezvous is a fresh directory under /tmp.\n";
+}
+
+static std::string describeStatus(int status) {
+    if (WIFSIGNALED(status)) return std::string("was killed by signal ") + std::to_string(WTERMSIG(status)) + " (" + strsignal(WTERMSIG(status)) + ")";
+    return "exited with status " + std::to_string(WEXITSTATUS(status));
+}
+
+int main(int argc, char** argv) {
+    int processes = 0;
+    std::string rendezvous;
+    int programArgument = -1;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string argument = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if (argument == "--processes" && hasValue) processes = std::atoi(argv[++i]);
+        else if (argument == "--rendezvous" && hasValue) rendezvous = argv[++i];
+        else if (argument == "--") {
+            programArgument = i + 1;
+            break;
+        } else {
+            printUsage();
+            return 2;
+        }
+    }
+
+    if (processes < 1 || programArgument < 0 || programArgument >= argc) {
+        printUsage();
+        return 2;
+    }
+
+    std::string createdDirectory;
+    if (rendezvous.empty()) {
+        createdDirectory = "/tmp/nn-ring-" + std::to_string(getpid());
+        if (mkdir(createdDirectory.c_str(), 0700) != 0 && errno != EEXIST) {
+            std::perror("Can't create rendezvous directory");
+            return 1;
+        }
+        rendezvous = "unix:" + createdDirectory;
+    }
+
+    std::vector<pid_t> ranks(processes, -1);
+    for (int rank = 0; rank < processes; rank++) {
+        const pid_t child = fork();
+        if (child < 0) {
+            std::perror("fork");
+            for (pid_t started : ranks) if (started > 0) kill(started, SIGTERM);
+            return 1;
+        }
+
+        if (child == 0) {
+            setenv("NN_RANK", std::to_string(rank).c_str(), 1);
+            setenv("NN_WORLD_SIZE", std::to_string(processes).c_str(), 1);
+            setenv("NN_RENDEZVOUS", rendezvous.c_str(), 1);
+
+            execvp(argv[programArgument], argv + programArgument);
+            std::perror("Can't start program");
+            _exit(127);
+        }
+
+        ranks[rank] = child;
+    }
+
+    int running = processes;
+    int failedRank = -1;
+
+    while (running > 0) {
+        int status;
+        const pid_t finished = waitpid(-1, &status, 0);
+        if (finished < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        int rank = 0;
+        while (rank < processes && ranks[rank] != finished) rank++;
+        if (rank == processes) continue;
+
+        ranks[rank] = -1;
+        running--;
+
+        const bool failed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+        if (!failed) continue;
+
+        std::cerr << "nnLaunch: rank " << rank << " " << describeStatus(status) << "\n";
+        if (failedRank < 0) {
+            failedRank = rank;
+            for (pid_t other : ranks) if (other > 0) kill(other, SIGTERM);
+        }
+    }
+
+    if (!createdDirectory.empty()) rmdir(createdDirectory.c_str());
+
+    if (failedRank >= 0) {
+        std::cerr << "nnLaunch: stopped all ranks after rank " << failedRank << " failed\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,267 @@
+#include "processGroup.h"
+#include "../matrix/kernels.h"
+#include <stdexcept>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <cstdint>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define RING_HELLO_MAGIC 0x4E4E5247u
+#define BROADCAST_CHUNK_BYTES (1 << 20)
+
+using ringClock = std::chrono::steady_clock;
+
+struct ringHello {
+    uint32_t magic;
+    uint32_t rank;
+    uint32_t size;
+};
+
+// Where a rank listens, as a sockaddr for either transport.
+struct ringAddress {
+    sockaddr_storage address = {};
+    socklen_t length = 0;
+    int family = AF_UNIX;
+    std::string path;
+};
+
+static ringAddress resolveAddress(const std::string& rendezvous, int rank) {
+    ringAddress result;
+
+    if (rendezvous.compare(0, 5, "unix:") == 0) {
+        result.path = rendezvous.substr(5) + "/rank" + std::to_string(rank) + ".sock";
+
+        sockaddr_un* address = (sockaddr_un*)&result.address;
+        if (result.path.size() >= sizeof(address->sun_path)) throw std::runtime_error("Rendezvous socket path too long: " + result.path);
+
+        address->sun_family = AF_UNIX;
+        std::strcpy(address->sun_path, result.path.c_str());
+        result.length = sizeof(sockaddr_un);
+        return result;
+    }
+
+    const size_t portSeparator = rendezvous.rfind(':');
+    if (rendezvous.compare(0, 4, "tcp:") != 0 || portSeparator <= 4) throw std::runtime_error("Bad rendezvous, expected unix:<directory> or tcp:<host>:<port>: " + rendezvous);
+
+    const std::string host = rendezvous.substr(4, portSeparator - 4);
+    const std::string port = std::to_string(std::atoi(rendezvous.c_str() + portSeparator + 1) + rank);
+
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0 || !found) throw std::runtime_error("Can't resolve rendezvous host " + host);
+
+    std::memcpy(&result.address, found->ai_addr, found->ai_addrlen);
+    result.length = found->ai_addrlen;
+    result.family = AF_INET;
+    freeaddrinfo(found);
+
+    return result;
+}
+
+static bool transferFully(int socket, void* buffer, size_t size, bool sending) {
+    char* position = (char*)buffer;
+
+    while (size > 0) {
+        const ssize_t moved = sending ? send(socket, position, size, MSG_NOSIGNAL) : recv(socket, position, size, 0);
+        if (moved < 0 && errno == EINTR) continue;
+        if (moved <= 0) return false;
+
+        position += moved;
+        size -= moved;
+    }
+
+    return true;
+}
+
+processGroupSettings processGroupSettings::fromEnvironment() {
+    processGroupSettings settings;
+
+    if (const char* rank = std::getenv("NN_RANK")) settings.rank = std::atoi(rank);
+    if (const char* size = std::getenv("NN_WORLD_SIZE")) settings.size = std::atoi(size);
+    if (const char* rendezvous = std::getenv("NN_RENDEZVOUS")) settings.rendezvous = rendezvous;
+
+    return settings;
+}
+
+processGroup::processGroup(const processGroupSettings& settings) : rank(settings.rank), size(settings.size), timeoutMilliseconds(settings.timeoutSeconds * 1000) {
+    if (size < 1 || rank < 0 || rank >= size) throw std::logic_error("Rank must be in [0, size)");
+    if (size == 1) return;
+
+    const int leftRank = (rank + size - 1) % size;
+    const int rightRank = (rank + 1) % size;
+    const ringClock::time_point deadline = ringClock::now() + std::chrono::milliseconds(timeoutMilliseconds);
+
+    const ringAddress own = resolveAddress(settings.rendezvous, rank);
+    const int listener = socket(own.family, SOCK_STREAM, 0);
+    const int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (!own.path.empty()) unlink(own.path.c_str());
+
+    if (listener < 0 || bind(listener, (sockaddr*)&own.address, own.length) != 0 || listen(listener, 1) != 0) {
+        if (listener >= 0) close(listener);
+        throw std::runtime_error("Rank " + std::to_string(rank) + ": can't listen for rank " + std::to_string(leftRank));
+    }
+    listenerPath = own.path;
+
+    // The right neighbour may not be listening yet, so keep trying until the deadline.
+    const ringAddress neighbour = resolveAddress(settings.rendezvous, rightRank);
+    while (right < 0) {
+        right = socket(neighbour.family, SOCK_STREAM, 0);
+        if (connect(right, (sockaddr*)&neighbour.address, neighbour.length) == 0) break;
+
+        close(right);
+        right = -1;
+        if (ringClock::now() > deadline) {
+            close(listener);
+            fail("timed out connecting to", rightRank);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    ringHello hello = { RING_HELLO_MAGIC, (uint32_t)rank, (uint32_t)size };
+    if (!transferFully(right, &hello, sizeof(hello), true)) {
+        close(listener);
+        fail("lost connection to", rightRank);
+    }
+
+    pollfd waiting = { listener, POLLIN, 0 };
+    const int remaining = std::max<long>(0, std::chrono::duration_cast<std::chrono::milliseconds>(deadline - ringClock::now()).count());
+    if (poll(&waiting, 1, remaining) == 1) left = accept(listener, nullptr, nullptr);
+    close(listener);
+    if (left < 0) fail("timed out waiting for", leftRank);
+
+    if (!transferFully(left, &hello, sizeof(hello), false)) fail("lost connection to", leftRank);
+    if (hello.magic != RING_HELLO_MAGIC || hello.rank != (uint32_t)leftRank || hello.size != (uint32_t)size) fail("got an unexpected hello instead of", leftRank);
+
+    for (int peer : { left, right }) {
+        if (own.family == AF_INET) setsockopt(peer, IPPROTO_TCP, TCP_NODELAY, &reuse, sizeof(reuse));
+        fcntl(peer, F_SETFL, fcntl(peer, F_GETFL) | O_NONBLOCK);
+    }
+}
+
+processGroup::~processGroup() {
+    if (left >= 0) close(left);
+    if (right >= 0) close(right);
+    if (!listenerPath.empty()) unlink(listenerPath.c_str());
+}
+
+void processGroup::fail(const std::string& what, int peer) const {
+    throw std::runtime_error("Rank " + std::to_string(rank) + " " + what + " rank " + std::to_string(peer));
+}
+
+int processGroup::getRank() const {
+    return rank;
+}
+
+int processGroup::getSize() const {
+    return size;
+}
+
+void processGroup::exchange(const void* sendBuffer, size_t sendBytes, void* receiveBuffer, size_t receiveBytes) {
+    const char* sendPosition = (const char*)sendBuffer;
+    char* receivePosition = (char*)receiveBuffer;
+
+    while (sendBytes > 0 || receiveBytes > 0) {
+        // A finished direction is left out of the poll, so a neighbour's hangup there can't wake it.
+        pollfd peers[2] = { { sendBytes > 0 ? right : -1, POLLOUT, 0 }, { receiveBytes > 0 ? left : -1, POLLIN, 0 } };
+
+        const int ready = poll(peers, 2, timeoutMilliseconds);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready == 0) fail(sendBytes > 0 ? "timed out sending to" : "timed out receiving from", sendBytes > 0 ? (rank + 1) % size : (rank + size - 1) % size);
+
+        if (sendBytes > 0 && peers[0].revents) {
+            const ssize_t sent = send(right, sendPosition, sendBytes, MSG_NOSIGNAL);
+            if (sent < 0 && errno != EAGAIN && errno != EINTR) fail("lost connection to", (rank + 1) % size);
+            if (sent > 0) {
+                sendPosition += sent;
+                sendBytes -= sent;
+            }
+        }
+
+        if (receiveBytes > 0 && peers[1].revents) {
+            const ssize_t got = recv(left, receivePosition, receiveBytes, 0);
+            if (got == 0 || (got < 0 && errno != EAGAIN && errno != EINTR)) fail("lost connection to", (rank + size - 1) % size);
+            if (got > 0) {
+                receivePosition += got;
+                receiveBytes -= got;
+            }
+        }
+    }
+}
+
+void processGroup::allReduce(float* values, size_t count) {
+    if (size == 1) return;
+
+    auto sliceBegin = [&](int slice) { return count * slice / size; };
+    auto sliceSize = [&](int slice) { return sliceBegin(slice + 1) - sliceBegin(slice); };
+    received.resize(count / size + 1);
+
+    // Reduce-scatter: after size - 1 steps rank r holds the full sum of slice r + 1.
+    for (int step = 0; step < size - 1; step++) {
+        const int sendSlice = (rank - step + size) % size;
+        const int receiveSlice = (rank - step - 1 + 2 * size) % size;
+
+        exchange(values + sliceBegin(sendSlice), sliceSize(sendSlice) * sizeof(float), received.data(), sliceSize(receiveSlice) * sizeof(float));
+        axpy(sliceSize(receiveSlice), 1.0f, received.data(), values + sliceBegin(receiveSlice));
+    }
+
+    // All-gather: the finished slices go once around the ring.
+    for (int step = 0; step < size - 1; step++) {
+        const int sendSlice = (rank + 1 - step + size) % size;
+        const int receiveSlice = (rank - step + size) % size;
+
+        exchange(values + sliceBegin(sendSlice), sliceSize(sendSlice) * sizeof(float), values + sliceBegin(receiveSlice), sliceSize(receiveSlice) * sizeof(float));
+    }
+}
+
+void processGroup::allReduce(double* values, size_t count) {
+    if (size == 1) return;
+
+    // Rank r's values end up in slot r on every rank.
+    std::vector<double> gathered(count * size);
+    std::copy(values, values + count, gathered.begin() + count * rank);
+
+    for (int step = 0; step < size - 1; step++) {
+        const int sendSlot = (rank - step + size) % size;
+        const int receiveSlot = (rank - step - 1 + size) % size;
+
+        exchange(gathered.data() + count * sendSlot, count * sizeof(double), gathered.data() + count * receiveSlot, count * sizeof(double));
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        double sum = 0;
+        for (int slot = 0; slot < size; slot++) sum += gathered[count * slot + i];
+        values[i] = sum;
+    }
+}
+
+void processGroup::broadcast(void* bytes, size_t count) {
+    if (size == 1) return;
+
+    // Passed along the ring in chunks, so later ranks start forwarding before the end arrives.
+    char* data = (char*)bytes;
+    for (size_t offset = 0; offset < count; offset += BROADCAST_CHUNK_BYTES) {
+        const size_t chunk = std::min<size_t>(BROADCAST_CHUNK_BYTES, count - offset);
+
+        if (rank != 0) exchange(nullptr, 0, data + offset, chunk);
+        if (rank != size - 1) exchange(data + offset, chunk, nullptr, 0);
+    }
+}
+
+void processGroup::barrier() {
+    std::vector<float> tokens(size, 0.0f);
+    allReduce(tokens.data(), tokens.size());
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Rank r of size listens on "<directory>/rank<r>.sock" for unix:<directory>, or on basePort + r
+// for tcp:<host>:<basePort>. The launcher passes all three through NN_RANK, NN_WORLD_SIZE and
+// NN_RENDEZVOUS.
+struct processGroupSettings {
+    int rank = 0;
+    int size = 1;
+    std::string rendezvous = "unix:/tmp/nn-ring";
+    // How long to wait for the neighbours at startup, and for any single transfer afterwards.
+    double timeoutSeconds = 60;
+
+    static processGroupSettings fromEnvironment();
+};
+
+// The processes of a data-parallel run, connected in a ring: every rank sends to rank + 1 and
+// receives from rank - 1. A lost or silent neighbour makes every collective throw a runtime_error
+// naming both ranks, so one failure brings the whole run down instead of hanging it.
+class processGroup {
+private:
+    int rank;
+    int size;
+    int timeoutMilliseconds;
+    int left = -1;
+    int right = -1;
+    std::string listenerPath;
+    std::vector<float> received;
+
+    // Sends to the right and receives from the left at the same time, so neither end can block
+    // the ring on a full socket buffer.
+    void exchange(const void* sendBuffer, size_t sendBytes, void* receiveBuffer, size_t receiveBytes);
+    [[noreturn]] void fail(const std::string& what, int peer) const;
+
+public:
+    processGroup(const processGroupSettings& settings);
+    ~processGroup();
+
+    processGroup(const processGroup&) = delete;
+    processGroup& operator=(const processGroup&) = delete;
+
+    int getRank() const;
+    int getSize() const;
+
+    // Ring all-reduce: sums values over every rank in place. Each slice is summed in one fixed
+    // order along the ring and then passed around, so every rank ends up with identical bits.
+    void allReduce(float* values, size_t count);
+    // For a handful of totals that must stay exact, like an epoch's loss and example counts: every
+    // rank's values go once around the ring and are added in rank order, in double precision.
+    void allReduce(double* values, size_t count);
+    // Replaces bytes on every rank with rank 0's.
+    void broadcast(void* bytes, size_t count);
+    void barrier();
+};
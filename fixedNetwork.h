@@ -0,0 +1,394 @@
+#pragma once
+#include "neuralNetwork.h"
+#include "functionPolicies.h"
+#include "modelFile.h"
+#include "initializer.h"
+#include <array>
+#include <algorithm>
+#include <vector>
+#include <random>
+#include <utility>
+#include <cstring>
+#include <stdexcept>
+
+// target_clones only takes string literals, so this one stays a macro; it's undefined again at the
+// end of the header.
+#define FIXED_NETWORK_TARGETS "avx512f", "avx2", "default"
+
+// A network whose shape is a compile-time constant, e.g. fixedNetwork<784, 30, 10>. Parameters
+// are stored inline in the object and every layer runs a kernel instantiated for its exact
+// dimensions, so small models unroll and vectorize without touching the heap. Weights, biases
+// and model files are laid out as in neuralNetwork, whose outputs it reproduces up to summation
+// order. Training is single threaded mini-batch SGD; large shapes are best allocated on the heap.
+template <int... Shape>
+class fixedNetwork {
+    static_assert(sizeof...(Shape) >= 2, "A network needs an input and an output layer");
+    static_assert(((Shape > 0) && ...), "Layer sizes must be positive");
+
+public:
+        static constexpr int layerCount = sizeof...(Shape);
+        static constexpr std::array<int, layerCount> shape = { Shape... };
+        static constexpr int inputs = shape[0];
+        static constexpr int outputs = shape[layerCount - 1];
+
+    private:
+        // Layers with at least this many weights run kernels cloned per instruction set. Smaller ones
+        // are inlined, since the dispatch would cost more than their arithmetic.
+        static constexpr int clonedWeights = 1024;
+        static constexpr int lanes = 16;
+
+        typedef float vector __attribute__((vector_size(lanes * sizeof(float)), aligned(sizeof(float)), may_alias));
+
+        // Every layer's weights (shape[layer] x shape[layer - 1]) followed by its biases.
+        static constexpr long weightsOffset(const int layer) {
+            long offset = 0;
+            for (int i = 1; i < layer; i++) offset += (long)shape[i] * (shape[i - 1] + 1);
+            return offset;
+        }
+
+        static constexpr long biasesOffset(const int layer) { return weightsOffset(layer) + (long)shape[layer] * shape[layer - 1]; }
+
+        // Position of a layer's nodes in buffers holding every layer, the inputs included.
+        static constexpr int nodeOffset(const int layer) {
+            int offset = 0;
+            for (int i = 0; i < layer; i++) offset += shape[i];
+            return offset;
+        }
+
+        static constexpr long parameterCount = weightsOffset(layerCount);
+        static constexpr int nodeCount = nodeOffset(layerCount);
+
+        alignas(64) std::array<float, parameterCount> parameters;
+        alignas(64) std::array<float, parameterCount> gradients;
+
+        activationFunction activation;
+        errorFunction error;
+        regularizationFunction regularization;
+        float learningRate;
+        float lambda;
+
+        bool softmaxOutput() const { return error.kind == errorKind::softmaxCrossEntropy; }
+
+        // z = W * x + b, four rows at a time so that every vector of x feeds four products.
+        template <int Rows, int Cols>
+        __attribute__((always_inline)) static void layerForwardKernel(const float* __restrict weights, const float* __restrict biases, const float* __restrict x, float* __restrict z) {
+            constexpr int laneCols = Cols / lanes * lanes;
+
+            int i = 0;
+            if constexpr (laneCols > 0) {
+                for (; i + 4 <= Rows; i += 4) {
+                    const float* row = weights + (long)i * Cols;
+                    vector sums0 = {}, sums1 = {}, sums2 = {}, sums3 = {};
+
+                    for (int j = 0; j < laneCols; j += lanes) {
+                        const vector xs = *(const vector*)(x + j);
+                        sums0 += *(const vector*)(row + j) * xs;
+                        sums1 += *(const vector*)(row + Cols + j) * xs;
+                        sums2 += *(const vector*)(row + 2 * Cols + j) * xs;
+                        sums3 += *(const vector*)(row + 3 * Cols + j) * xs;
+                    }
+
+                    const vector* sums[4] = { &sums0, &sums1, &sums2, &sums3 };
+                    for (int k = 0; k < 4; k++) {
+                        float sum = 0;
+                        for (int lane = 0; lane < lanes; lane++) sum += (*sums[k])[lane];
+                        for (int j = laneCols; j < Cols; j++) sum += row[k * Cols + j] * x[j];
+                        z[i + k] = biases[i + k] + sum;
+                    }
+                }
+            }
+
+            // Remaining rows, and every row of layers narrower than a vector
+            for (; i < Rows; i++) {
+                const float* row = weights + (long)i * Cols;
+                float sum = 0;
+
+                if constexpr (laneCols > 0) {
+                    vector sums = {};
+                    for (int j = 0; j < laneCols; j += lanes) sums += *(const vector*)(row + j) * *(const vector*)(x + j);
+                    for (int lane = 0; lane < lanes; lane++) sum += sums[lane];
+                }
+
+                for (int j = laneCols; j < Cols; j++) sum += row[j] * x[j];
+                z[i] = biases[i] + sum;
+            }
+        }
+
+        // Gradients += delta * x^T, and with previousDelta also previousDelta = W^T * delta
+        template <int Rows, int Cols>
+        __attribute__((always_inline)) static void layerBackwardKernel(const float* __restrict weights, const float* __restrict delta, const float* __restrict x, float* __restrict weightsGradients,
+                                                                       float* __restrict biasesGradients, float* __restrict previousDelta) {
+            if (previousDelta) std::fill(previousDelta, previousDelta + Cols, 0.0f);
+
+            for (int i = 0; i < Rows; i++) {
+                const float* row = weights + (long)i * Cols;
+                float* gradientRow = weightsGradients + (long)i * Cols;
+                const float d = delta[i];
+
+                biasesGradients[i] += d;
+                for (int j = 0; j < Cols; j++) gradientRow[j] += d * x[j];
+                if (previousDelta) for (int j = 0; j < Cols; j++) previousDelta[j] += d * row[j];
+            }
+        }
+
+        template <int Rows, int Cols>
+        __attribute__((target_clones(FIXED_NETWORK_TARGETS))) static void clonedLayerForward(const float* weights, const float* biases, const float* x, float* z) {
+            layerForwardKernel<Rows, Cols>(weights, biases, x, z);
+        }
+
+        template <int Rows, int Cols>
+        __attribute__((target_clones(FIXED_NETWORK_TARGETS))) static void clonedLayerBackward(const float* weights, const float* delta, const float* x, float* weightsGradients, float* biasesGradients, float* previousDelta) {
+            layerBackwardKernel<Rows, Cols>(weights, delta, x, weightsGradients, biasesGradients, previousDelta);
+        }
+
+        template <int Rows, int Cols>
+        static void layerForward(const float* weights, const float* biases, const float* x, float* z) {
+            if constexpr (Rows * Cols >= clonedWeights) clonedLayerForward<Rows, Cols>(weights, biases, x, z);
+            else layerForwardKernel<Rows, Cols>(weights, biases, x, z);
+        }
+
+        template <int Rows, int Cols>
+        static void layerBackward(const float* weights, const float* delta, const float* x, float* weightsGradients, float* biasesGradients, float* previousDelta) {
+            if constexpr (Rows * Cols >= clonedWeights) clonedLayerBackward<Rows, Cols>(weights, delta, x, weightsGradients, biasesGradients, previousDelta);
+            else layerBackwardKernel<Rows, Cols>(weights, delta, x, weightsGradients, biasesGradients, previousDelta);
+        }
+
+        template <int Layer, typename Activation>
+        void forwardLayer(const Activation activationPolicy, float* nodes, float* activations) const {
+            constexpr int rows = shape[Layer];
+            float* z = nodes + nodeOffset(Layer);
+            float* a = activations + nodeOffset(Layer);
+
+            layerForward<rows, shape[Layer - 1]>(parameters.data() + weightsOffset(Layer), parameters.data() + biasesOffset(Layer), activations + nodeOffset(Layer - 1), z);
+
+            if (Layer == layerCount - 1 && softmaxOutput()) {
+                float scratch[2];
+                int prediction;
+                softmaxCrossEntropyForward(z, a, nullptr, nullptr, nullptr, &prediction, rows, 1, scratch);
+            } else {
+                activationForward(activationPolicy, z, a, rows);
+            }
+        }
+
+        template <int Layer, typename Activation>
+        void backwardLayer(const Activation activationPolicy, const float* nodes, const float* activations, float* deltas) {
+            constexpr int cols = shape[Layer - 1];
+            float* previousDelta = Layer > 1 ? deltas + nodeOffset(Layer - 1) : nullptr;
+
+            layerBackward<shape[Layer], cols>(parameters.data() + weightsOffset(Layer), deltas + nodeOffset(Layer), activations + nodeOffset(Layer - 1),
+                                              gradients.data() + weightsOffset(Layer), gradients.data() + biasesOffset(Layer), previousDelta);
+
+            if (previousDelta) activationBackward(activationPolicy, nodes + nodeOffset(Layer - 1), activations + nodeOffset(Layer - 1), previousDelta, cols);
+        }
+
+        // Leaves every layer's z and activations in nodes and activations, whose first inputs floats hold the input.
+        template <typename Activation, size_t... Layers>
+        void forwardPass(const Activation activationPolicy, float* nodes, float* activations, std::index_sequence<Layers...>) const {
+            (forwardLayer<Layers + 1>(activationPolicy, nodes, activations), ...);
+        }
+
+        template <typename Activation, size_t... Layers>
+        void backwardPass(const Activation activationPolicy, const float* nodes, const float* activations, float* deltas, std::index_sequence<Layers...>) {
+            (backwardLayer<layerCount - 1 - Layers>(activationPolicy, nodes, activations, deltas), ...);
+        }
+
+        static void gather(constMatrixView column, float* values) {
+            for (int i = 0; i < column.rows; i++) values[i] = column(i, 0);
+        }
+
+        void applyGradients(const float gradientScale) {
+            const float decay = regularization.kind == regularizationKind::L2 ? lambda / outputs : 0.0f;
+
+            for (int layer = 1; layer < layerCount; layer++) {
+                float* weights = parameters.data() + weightsOffset(layer);
+                const float* weightsGradients = gradients.data() + weightsOffset(layer);
+                const long weightCount = biasesOffset(layer) - weightsOffset(layer);
+
+                if (regularization.kind == regularizationKind::L2) {
+                    for (long i = 0; i < weightCount; i++) weights[i] -= learningRate * (weightsGradients[i] * gradientScale + decay * weights[i]);
+                } else {
+                    for (long i = 0; i < weightCount; i++) weights[i] -= learningRate * (weightsGradients[i] * gradientScale + regularization.fPrime(weights[i], outputs, lambda));
+                }
+
+                float* biases = parameters.data() + biasesOffset(layer);
+                const float* biasesGradients = gradients.data() + biasesOffset(layer);
+                for (int i = 0; i < shape[layer]; i++) biases[i] -= learningRate * biasesGradients[i] * gradientScale;
+            }
+
+            gradients.fill(0.0f);
+        }
+
+        template <typename Activation, typename Loss>
+        void runEpochs(const Activation activationPolicy, const Loss errorPolicy, const dataSource& source, int epochs, int miniBatchSize, bool shuffleData,
+                       std::mt19937& generator, std::vector<int>& order) {
+            constexpr int outputOffset = nodeOffset(layerCount - 1);
+
+            float nodes[nodeCount];
+            float activations[nodeCount];
+            float deltas[nodeCount];
+            float targets[outputs];
+            matrix batchInputs;
+            matrix batchTargets;
+
+            for (int epoch = 0; epoch < epochs; epoch++) {
+                if (shuffleData) std::shuffle(order.begin(), order.end(), generator);
+
+                for (int batch = 0; batch + miniBatchSize <= order.size(); batch += miniBatchSize) {
+                    source.assembleBatch(order.data() + batch, miniBatchSize, batchInputs, batchTargets);
+
+                    for (int example = 0; example < miniBatchSize; example++) {
+                        gather(batchInputs.column(example), activations);
+                        gather(batchTargets.column(example), targets);
+
+                        forwardPass(activationPolicy, nodes, activations, std::make_index_sequence<layerCount - 1>());
+                        outputDeltas(activationPolicy, errorPolicy, nodes + outputOffset, activations + outputOffset, targets, deltas + outputOffset, outputs, outputs);
+                        backwardPass(activationPolicy, nodes, activations, deltas, std::make_index_sequence<layerCount - 1>());
+                    }
+
+                    applyGradients(1.0f / miniBatchSize);
+                }
+            }
+        }
+
+        std::vector<matrix> layerViews(bool biases) {
+            std::vector<matrix> views;
+            for (int layer = 1; layer < layerCount; layer++)
+                views.push_back(matrix::wrap(parameters.data() + (biases ? biasesOffset(layer) : weightsOffset(layer)), shape[layer], biases ? 1 : shape[layer - 1]));
+
+            return views;
+        }
+
+        static std::vector<int> shapeVector() { return std::vector<int>(shape.begin(), shape.end()); }
+public:
+        fixedNetwork(float networkLearningRate = 0.005f, activationFunction networkActivation = neuralNetwork::sigmoid, errorFunction networkError = neuralNetwork::mse,
+                     regularizationFunction networkRegularization = neuralNetwork::L2, float regularizationLambda = 0.01f)
+            : activation(networkActivation), error(networkError), regularization(networkRegularization), learningRate(networkLearningRate), lambda(regularizationLambda) {
+            gradients.fill(0.0f);
+            initialize();
+        }
+
+        // Draws the parameters exactly as neuralNetwork::initialize does, so a seed gives both the same network.
+        uint64_t initialize(const initializerSettings& settings = initializerSettings()) {
+            const parameterInitializer initializer(settings);
+
+            for (int layer = 1; layer < layerCount; layer++) {
+                initializer.fill(layer - 1, false, shape[layer - 1], shape[layer], 0, biasesOffset(layer) - weightsOffset(layer), parameters.data() + weightsOffset(layer));
+                initializer.fill(layer - 1, true, shape[layer - 1], shape[layer], 0, shape[layer], parameters.data() + biasesOffset(layer));
+            }
+
+            return initializer.getSeed();
+        }
+
+        // output receives the outputs floats of one example.
+        void predict(const float* input, float* output) const {
+            float nodes[nodeCount];
+            float activations[nodeCount];
+            std::copy(input, input + inputs, activations);
+
+            withActivationPolicy(activation, [&](auto activationPolicy) {
+                forwardPass(activationPolicy, nodes, activations, std::make_index_sequence<layerCount - 1>());
+            });
+
+            std::copy(activations + nodeOffset(layerCount - 1), activations + nodeCount, output);
+        }
+
+        int predictClass(const float* input) const {
+            float output[outputs];
+            predict(input, output);
+
+            return std::max_element(output, output + outputs) - output;
+        }
+
+        matrix feedfoward(constMatrixView input) const {
+            if (input.cols != 1 || input.rows != inputs) throw std::logic_error("Bad input dimensions");
+
+            float values[inputs];
+            gather(input, values);
+
+            matrix out(outputs, 1);
+            predict(values, out.getDataPointer());
+
+            return out;
+        }
+
+        void train(const std::vector<trainingExample>& examples, int epochs, int miniBatchSize = 5, bool shuffleData = true) {
+            train(exampleSource(examples), epochs, miniBatchSize, shuffleData);
+        }
+
+        void train(const dataSource& source, int epochs, int miniBatchSize = 5, bool shuffleData = true) {
+            if (miniBatchSize > source.size()) throw std::logic_error("Minibatch size can't be bigger than number of examples");
+            if (source.inputSize() != inputs) throw std::logic_error("Example must be same dimensions as first layer in network.");
+            if (source.targetSize() != outputs) throw std::logic_error("Example target must be same dimensions as last layer in network.");
+
+            std::random_device seedGenerator;
+            std::mt19937 generator(seedGenerator());
+
+            std::vector<int> order(source.size());
+            for (int i = 0; i < order.size(); i++) order.at(i) = i;
+
+            // The functions are resolved once, leaving the whole loop specialized for them.
+            withActivationPolicy(activation, [&](auto activationPolicy) {
+                withErrorPolicy(error, [&](auto errorPolicy) {
+                    runEpochs(activationPolicy, errorPolicy, source, epochs, miniBatchSize, shuffleData, generator, order);
+                });
+            });
+        }
+
+        float getAccuracyOverExamples(const std::vector<trainingExample>& examples) {
+            return getAccuracyOverExamples(exampleSource(examples));
+        }
+
+        float getAccuracyOverExamples(const dataSource& source) {
+            if (source.inputSize() != inputs || source.targetSize() != outputs) throw std::logic_error("Examples don't match the network shape");
+
+            const int chunkSize = 256;
+            std::vector<int> indices(chunkSize);
+            matrix chunkInputs;
+            matrix chunkTargets;
+            float input[inputs];
+            int assertCount = 0;
+
+            for (int begin = 0; begin < source.size(); begin += chunkSize) {
+                const int count = std::min(chunkSize, source.size() - begin);
+                for (int i = 0; i < count; i++) indices.at(i) = begin + i;
+
+                source.assembleBatch(indices.data(), count, chunkInputs, chunkTargets);
+
+                for (int example = 0; example < count; example++) {
+                    gather(chunkInputs.column(example), input);
+                    if (predictClass(input) == neuralNetwork::oneHotIndex(chunkTargets, example)) assertCount++;
+                }
+            }
+
+            return ((float)assertCount / source.size()) * 100;
+        }
+
+        void save(const char* fileName) {
+            modelDescription description;
+            description.shape = shapeVector();
+            description.activation = activation.kind;
+            description.error = error.kind;
+            description.regularization = regularization.kind;
+
+            modelFile::write(fileName, description, layerViews(false), layerViews(true));
+        }
+
+        void load(const char* fileName) {
+            modelFile model(fileName, shapeVector());
+            const modelDescription& description = model.getDescription();
+
+            if (description.shape != shapeVector()) throw std::logic_error("Model file shape does not match the network shape");
+            if (!model.isLegacy() && description.activation != activation.kind) throw std::logic_error("Model file activation does not match the network activation");
+            if (!model.isLegacy() && description.error != error.kind) throw std::logic_error("Model file error function does not match the network error function");
+
+            for (int layer = 1; layer < layerCount; layer++) {
+                std::memcpy(parameters.data() + weightsOffset(layer), model.getWeights(layer - 1), (biasesOffset(layer) - weightsOffset(layer)) * sizeof(float));
+                std::memcpy(parameters.data() + biasesOffset(layer), model.getBiases(layer - 1), shape[layer] * sizeof(float));
+            }
+        }
+
+        float* getWeights(int layer) { return parameters.data() + weightsOffset(layer + 1); }
+        float* getBiases(int layer) { return parameters.data() + biasesOffset(layer + 1); }
+};
+
+#undef FIXED_NETWORK_TARGETS
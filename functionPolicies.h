@@ -0,0 +1,40 @@
+#pragma once
+#include "neuralNetwork.h"
+
+// Resolves an activation or error function to its compile-time policy from activations.h.
+// Custom std::function pairs are wrapped in adapter policies.
+struct customActivationPolicy {
+    const activationFunction* function;
+
+    float f(const float z) const { return function->f(z); }
+    float fPrime(const float z, const float) const { return function->fPrime(z); }
+};
+
+struct customErrorPolicy {
+    const errorFunction* function;
+
+    float f(const float a, const float t, const int n) const { return function->f(a, t, n); }
+    float fPrime(const float a, const float t, const int n) const { return function->fPrime(a, t, n); }
+};
+
+template <typename Visitor>
+void withActivationPolicy(const activationFunction& activation, Visitor visitor) {
+    switch (activation.kind) {
+        case activationKind::sigmoid: visitor(sigmoidPolicy<expAccuracy::exact>()); break;
+        case activationKind::fastSigmoid: visitor(sigmoidPolicy<expAccuracy::fast>()); break;
+        case activationKind::approximateSigmoid: visitor(sigmoidPolicy<expAccuracy::fastest>()); break;
+        case activationKind::tanh: visitor(tanhPolicy()); break;
+        case activationKind::relu: visitor(reluPolicy()); break;
+        default: visitor(customActivationPolicy{&activation}); break;
+    }
+}
+
+template <typename Visitor>
+void withErrorPolicy(const errorFunction& error, Visitor visitor) {
+    switch (error.kind) {
+        case errorKind::mse: visitor(msePolicy()); break;
+        case errorKind::crossEntropy: visitor(crossEntropyPolicy()); break;
+        case errorKind::softmaxCrossEntropy: visitor(softmaxCrossEntropyPolicy()); break;
+        default: visitor(customErrorPolicy{&error}); break;
+    }
+}
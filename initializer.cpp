@@ -0,0 +1,107 @@
+#include "initializer.h"
+#include <random>
+#include <cmath>
+#include <algorithm>
+
+#define INITIALIZER_TARGETS "avx512f", "avx2", "default"
+#define BLOCKS_PER_PASS 256
+
+// Philox4x32-10 on consecutive counters { block, stream, 0 }, each giving four 32 bit values.
+// The rounds only use 32x32->64 bit products, so the loop over blocks vectorizes.
+__attribute__((target_clones(INITIALIZER_TARGETS)))
+static void philoxBlocks(uint64_t seed, uint32_t stream, uint64_t firstBlock, int blocks, uint32_t* __restrict out) {
+    for (int b = 0; b < blocks; b++) {
+        const uint64_t block = firstBlock + b;
+        uint32_t c0 = (uint32_t)block, c1 = (uint32_t)(block >> 32), c2 = stream, c3 = 0;
+        uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+
+        for (int round = 0; round < 10; round++) {
+            const uint64_t p0 = (uint64_t)0xD2511F53u * c0;
+            const uint64_t p1 = (uint64_t)0xCD9E8D57u * c2;
+
+            c0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+            c2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+            c1 = (uint32_t)p1;
+            c3 = (uint32_t)p0;
+
+            k0 += 0x9E3779B9u;
+            k1 += 0xBB67AE85u;
+        }
+
+        out[4 * b] = c0;
+        out[4 * b + 1] = c1;
+        out[4 * b + 2] = c2;
+        out[4 * b + 3] = c3;
+    }
+}
+
+// Uniform in (-limit, limit), from the top 24 bits.
+__attribute__((target_clones(INITIALIZER_TARGETS)))
+static void toUniform(int n, const uint32_t* __restrict bits, float limit, float* __restrict out) {
+    for (int i = 0; i < n; i++) out[i] = limit * (((bits[i] >> 8) + 0.5f) * (2.0f / 16777216.0f) - 1.0f);
+}
+
+// Box-Muller on pairs of neighbouring values, each pair giving two independent normals.
+static void toNormal(int n, const uint32_t* bits, float deviation, float* out) {
+    for (int i = 0; i + 1 < n; i += 2) {
+        const float u1 = ((bits[i] >> 8) + 1.0f) * (1.0f / 16777216.0f);
+        const float theta = (bits[i + 1] >> 8) * (6.28318530718f / 16777216.0f);
+        const float radius = deviation * std::sqrt(-2.0f * std::log(u1));
+
+        out[i] = radius * std::cos(theta);
+        out[i + 1] = radius * std::sin(theta);
+    }
+}
+
+parameterInitializer::parameterInitializer(const initializerSettings& initializerConfiguration) : settings(initializerConfiguration), seed(initializerConfiguration.seed) {
+    if (seed == 0) {
+        std::random_device seedGenerator;
+        seed = ((uint64_t)seedGenerator() << 32) | seedGenerator();
+    }
+}
+
+uint64_t parameterInitializer::getSeed() const {
+    return seed;
+}
+
+void parameterInitializer::fill(int layer, bool biases, int fanIn, int fanOut, long begin, long count, float* values) const {
+    float limit = settings.gain;
+    bool normal = false;
+
+    if (biases) {
+        limit = settings.biasRange;
+    } else {
+        switch (settings.scheme) {
+            case initializationScheme::xavierUniform: limit = settings.gain * std::sqrt(6.0f / (fanIn + fanOut)); break;
+            case initializationScheme::xavierNormal: limit = settings.gain * std::sqrt(2.0f / (fanIn + fanOut)); normal = true; break;
+            case initializationScheme::heUniform: limit = settings.gain * std::sqrt(6.0f / fanIn); break;
+            case initializationScheme::heNormal: limit = settings.gain * std::sqrt(2.0f / fanIn); normal = true; break;
+            default: break;
+        }
+    }
+
+    if (limit == 0.0f) {
+        std::fill(values, values + count, 0.0f);
+        return;
+    }
+
+    const uint32_t stream = 2 * layer + biases;
+    uint32_t bits[4 * BLOCKS_PER_PASS];
+    float generated[4 * BLOCKS_PER_PASS];
+
+    // Whole blocks are generated around the requested range, so element i always comes from block i / 4.
+    for (long position = begin; position < begin + count;) {
+        const uint64_t firstBlock = position / 4;
+        const int skip = position % 4;
+        const int taken = (int)std::min<long>(4 * BLOCKS_PER_PASS - skip, begin + count - position);
+        const int blocks = (skip + taken + 3) / 4;
+
+        philoxBlocks(seed, stream, firstBlock, blocks, bits);
+
+        if (normal) toNormal(4 * blocks, bits, limit, generated);
+        else toUniform(4 * blocks, bits, limit, generated);
+
+        std::copy(generated + skip, generated + skip + taken, values + (position - begin));
+        position += taken;
+    }
+}
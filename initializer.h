@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+
+enum class initializationScheme { uniform, xavierUniform, xavierNormal, heUniform, heNormal };
+
+// Xavier scales weights by fan in and fan out, He by fan in alone: the uniform variants draw from
+// [-limit, limit] with limit = sqrt(6 / fans), the normal ones use a deviation of sqrt(2 / fans).
+struct initializerSettings {
+    initializationScheme scheme = initializationScheme::uniform;
+    // Multiplies the scheme's limit or deviation; plain uniform draws weights from [-gain, gain].
+    float gain = 1.0f;
+    // Biases are drawn from [-biasRange, biasRange], or all set to zero by 0.
+    float biasRange = 1.0f;
+    // 0 draws a fresh seed from std::random_device.
+    uint64_t seed = 0;
+};
+
+// Parameter initialization from counter-based random streams (Philox4x32-10). Every value is a
+// function of the seed, its layer and its index alone, so filling any split of the parameters on
+// any number of threads gives the same network, and a seed reproduces it exactly.
+class parameterInitializer {
+private:
+    initializerSettings settings;
+    uint64_t seed;
+
+public:
+    parameterInitializer(const initializerSettings& initializerConfiguration);
+
+    uint64_t getSeed() const;
+
+    // Fills values with elements [begin, begin + count) of a layer's weights (fanIn x fanOut of
+    // them) or of its biases.
+    void fill(int layer, bool biases, int fanIn, int fanOut, long begin, long count, float* values) const;
+};
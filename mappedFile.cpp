@@ -0,0 +1,69 @@
+#include "mappedFile.h"
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+mappedFile::mappedFile(const char* fileName, bool copyOnWrite) {
+    const int descriptor = open(fileName, O_RDONLY);
+    if (descriptor < 0) throw std::runtime_error(std::string("Can't open file ") + fileName);
+
+    struct stat fileStatus;
+    if (fstat(descriptor, &fileStatus) != 0 || fileStatus.st_size == 0) {
+        close(descriptor);
+        throw std::runtime_error(std::string("Can't map empty file ") + fileName);
+    }
+
+    mappingSize = fileStatus.st_size;
+    mapping = mmap(nullptr, mappingSize, copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        throw std::runtime_error(std::string("Can't map file ") + fileName);
+    }
+
+    madvise(mapping, mappingSize, MADV_WILLNEED);
+}
+
+mappedFile::~mappedFile() {
+    unmap();
+}
+
+mappedFile::mappedFile(mappedFile&& other) {
+    *this = std::move(other);
+}
+
+mappedFile& mappedFile::operator=(mappedFile&& other) {
+    if (this == &other) return *this;
+
+    unmap();
+
+    mapping = other.mapping;
+    mappingSize = other.mappingSize;
+    other.mapping = nullptr;
+    other.mappingSize = 0;
+
+    return *this;
+}
+
+void mappedFile::unmap() {
+    if (mapping) munmap(mapping, mappingSize);
+
+    mapping = nullptr;
+    mappingSize = 0;
+}
+
+unsigned char* mappedFile::getData() {
+    return (unsigned char*)mapping;
+}
+
+const unsigned char* mappedFile::getData() const {
+    return (const unsigned char*)mapping;
+}
+
+size_t mappedFile::getSize() const {
+    return mappingSize;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+
+// Private memory mapping of a whole file. A copy-on-write mapping may be modified in memory
+// without ever writing back to the file.
+class mappedFile {
+private:
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+
+    void unmap();
+
+public:
+    mappedFile(const char* fileName, bool copyOnWrite = false);
+    ~mappedFile();
+
+    mappedFile(const mappedFile&) = delete;
+    mappedFile& operator=(const mappedFile&) = delete;
+    mappedFile(mappedFile&& other);
+    mappedFile& operator=(mappedFile&& other);
+
+    unsigned char* getData();
+    const unsigned char* getData() const;
+    size_t getSize() const;
+};
@@ -0,0 +1,826 @@
+#include "kernels.h"
+#include "../metrics.h"
+#include <immintrin.h>
+#include <algorithm>
+#include <vector>
+#include <stdexcept>
+
+#define KC 256
+#define MC 96
+#define NC 2048
+
+struct kernelSet {
+    kernelIsa isa;
+    const char* name;
+    int mr;
+    int nr;
+    void (*microKernel)(int kc, const float* a, const float* b, float* c, int ldc, float alpha);
+    void (*gemvKernel)(int m, int n, float alpha, const float* A, int lda, const float* x, float* y);
+    void (*gemvTransposedKernel)(int m, int n, float alpha, const float* A, int lda, const float* x, float* y);
+    void (*axpyKernel)(int n, float alpha, const float* x, float* y);
+    void (*scaleKernel)(int n, float alpha, float* x);
+    void (*gemvInt8Kernel)(int m, int k, const int8_t* A, int lda, const uint8_t* x, int32_t* y);
+    void (*sparseGemmKernel)(int m, int n, const float* A, int lda, const int* offsets, const int* indices, const float* values, float* C, int ldc);
+    void (*sparseGemmTransposedKernel)(int m, int n, const float* A, int lda, const int* offsets, const int* indices, const float* values, float* C, int ldc);
+};
+
+static void scalarMicroKernel(int kc, const float* a, const float* b, float* c, int ldc, float alpha) {
+    float acc[4][8] = {};
+
+    for (int p = 0; p < kc; p++, a += 4, b += 8)
+        for (int i = 0; i < 4; i++)
+            for (int j = 0; j < 8; j++)
+                acc[i][j] += a[i] * b[j];
+
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 8; j++)
+            c[i * ldc + j] += alpha * acc[i][j];
+}
+
+static void scalarGemv(int m, int n, float alpha, const float* A, int lda, const float* x, float* y) {
+    for (int i = 0; i < m; i++) {
+        const float* row = A + (long)i * lda;
+        float sum = 0;
+        for (int j = 0; j < n; j++) sum += row[j] * x[j];
+        y[i] += alpha * sum;
+    }
+}
+
+static void scalarGemvTransposed(int m, int n, float alpha, const float* A, int lda, const float* x, float* y) {
+    for (int i = 0; i < m; i++) {
+        const float* row = A + (long)i * lda;
+        const float s = alpha * x[i];
+        for (int j = 0; j < n; j++) y[j] += s * row[j];
+    }
+}
+
+static void scalarAxpy(int n, float alpha, const float* x, float* y) {
+    for (int i = 0; i < n; i++) y[i] += alpha * x[i];
+}
+
+static void scalarScale(int n, float alpha, float* x) {
+    for (int i = 0; i < n; i++) x[i] *= alpha;
+}
+
+static void scalarGemvInt8(int m, int k, const int8_t* A, int lda, const uint8_t* x, int32_t* y) {
+    for (int i = 0; i < m; i++) {
+        const int8_t* row = A + (long)i * lda;
+        int32_t sum = 0;
+        for (int j = 0; j < k; j++) sum += (int32_t)x[j] * row[j];
+        y[i] = sum;
+    }
+}
+
+static void scalarSparseGemm(int m, int n, const float* A, int lda, const int* offsets, const int* indices, const float* values, float* C, int ldc) {
+    for (int i = 0; i < m; i++) {
+        const float* a = A + (long)i * lda;
+
+        for (int j = 0; j < n; j++) {
+            float sum = 0;
+            for (int p = offsets[j]; p < offsets[j + 1]; p++) sum += a[indices[p]] * values[p];
+            C[(long)i * ldc + j] += sum;
+        }
+    }
+}
+
+static void scalarSparseGemmTransposed(int m, int n, const float* A, int lda, const int* offsets, const int* indices, const float* values, float* C, int ldc) {
+    for (int i = 0; i < m; i++) {
+        float* c = C + (long)i * ldc;
+
+        for (int j = 0; j < n; j++) {
+            const float a = A[(long)i * lda + j];
+            if (a == 0.0f) continue;
+
+            for (int p = offsets[j]; p < offsets[j + 1]; p++) c[indices[p]] += a * values[p];
+        }
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void avx2MicroKernel(int kc, const float* a, const float* b, float* c, int ldc, float alpha) {
+    __m256 acc[6][2];
+    for (int i = 0; i < 6; i++) acc[i][0] = acc[i][1] = _mm256_setzero_ps();
+
+    for (int p = 0; p < kc; p++, a += 6, b += 16) {
+        const __m256 b0 = _mm256_loadu_ps(b);
+        const __m256 b1 = _mm256_loadu_ps(b + 8);
+        for (int i = 0; i < 6; i++) {
+            const __m256 ai = _mm256_broadcast_ss(a + i);
+            acc[i][0] = _mm256_fmadd_ps(ai, b0, acc[i][0]);
+            acc[i][1] = _mm256_fmadd_ps(ai, b1, acc[i][1]);
+        }
+    }
+
+    const __m256 alphaVec = _mm256_set1_ps(alpha);
+    for (int i = 0; i < 6; i++) {
+        float* row = c + (long)i * ldc;
+        _mm256_storeu_ps(row, _mm256_fmadd_ps(alphaVec, acc[i][0], _mm256_loadu_ps(row)));
+        _mm256_storeu_ps(row + 8, _mm256_fmadd_ps(alphaVec, acc[i][1], _mm256_loadu_ps(row + 8)));
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static float avx2HorizontalSum(__m256 v) {
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+    return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx2,fma")))
+static void avx2Gemv(int m, int n, float alpha, const float* A, int lda, const float* x, float* y) {
+    int i = 0;
+    for (; i + 4 <= m; i += 4) {
+        const float* r0 = A + (long)i * lda;
+        const float* r1 = r0 + lda;
+        const float* r2 = r1 + lda;
+        const float* r3 = r2 + lda;
+        __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps(), s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+
+        int j = 0;
+        for (; j + 8 <= n; j += 8) {
+            const __m256 xv = _mm256_loadu_ps(x + j);
+            s0 = _mm256_fmadd_ps(_mm256_loadu_ps(r0 + j), xv, s0);
+            s1 = _mm256_fmadd_ps(_mm256_loadu_ps(r1 + j), xv, s1);
+            s2 = _mm256_fmadd_ps(_mm256_loadu_ps(r2 + j), xv, s2);
+            s3 = _mm256_fmadd_ps(_mm256_loadu_ps(r3 + j), xv, s3);
+        }
+
+        float t0 = avx2HorizontalSum(s0), t1 = avx2HorizontalSum(s1), t2 = avx2HorizontalSum(s2), t3 = avx2HorizontalSum(s3);
+        for (; j < n; j++) {
+            t0 += r0[j] * x[j];
+            t1 += r1[j] * x[j];
+            t2 += r2[j] * x[j];
+            t3 += r3[j] * x[j];
+        }
+
+        y[i] += alpha * t0;
+        y[i + 1] += alpha * t1;
+        y[i + 2] += alpha * t2;
+        y[i + 3] += alpha * t3;
+    }
+
+    for (; i < m; i++) {
+        const float* row = A + (long)i * lda;
+        __m256 s = _mm256_setzero_ps();
+        int j = 0;
+        for (; j + 8 <= n; j += 8) s = _mm256_fmadd_ps(_mm256_loadu_ps(row + j), _mm256_loadu_ps(x + j), s);
+        float t = avx2HorizontalSum(s);
+        for (; j < n; j++) t += row[j] * x[j];
+        y[i] += alpha * t;
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void avx2GemvTransposed(int m, int n, float alpha, const float* A, int lda, const float* x, float* y) {
+    int i = 0;
+    for (; i + 4 <= m; i += 4) {
+        const float* r0 = A + (long)i * lda;
+        const float* r1 = r0 + lda;
+        const float* r2 = r1 + lda;
+        const float* r3 = r2 + lda;
+        const float x0 = alpha * x[i], x1 = alpha * x[i + 1], x2 = alpha * x[i + 2], x3 = alpha * x[i + 3];
+        const __m256 v0 = _mm256_set1_ps(x0), v1 = _mm256_set1_ps(x1), v2 = _mm256_set1_ps(x2), v3 = _mm256_set1_ps(x3);
+
+        int j = 0;
+        for (; j + 8 <= n; j += 8) {
+            __m256 yv = _mm256_loadu_ps(y + j);
+            yv = _mm256_fmadd_ps(v0, _mm256_loadu_ps(r0 + j), yv);
+            yv = _mm256_fmadd_ps(v1, _mm256_loadu_ps(r1 + j), yv);
+            yv = _mm256_fmadd_ps(v2, _mm256_loadu_ps(r2 + j), yv);
+            yv = _mm256_fmadd_ps(v3, _mm256_loadu_ps(r3 + j), yv);
+            _mm256_storeu_ps(y + j, yv);
+        }
+        for (; j < n; j++) y[j] += x0 * r0[j] + x1 * r1[j] + x2 * r2[j] + x3 * r3[j];
+    }
+
+    for (; i < m; i++) {
+        const float* row = A + (long)i * lda;
+        const float s = alpha * x[i];
+        const __m256 sv = _mm256_set1_ps(s);
+        int j = 0;
+        for (; j + 8 <= n; j += 8) _mm256_storeu_ps(y + j, _mm256_fmadd_ps(sv, _mm256_loadu_ps(row + j), _mm256_loadu_ps(y + j)));
+        for (; j < n; j++) y[j] += s * row[j];
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void avx2Axpy(int n, float alpha, const float* x, float* y) {
+    const __m256 alphaVec = _mm256_set1_ps(alpha);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_ps(y + i, _mm256_fmadd_ps(alphaVec, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+    for (; i < n; i++) y[i] += alpha * x[i];
+}
+
+__attribute__((target("avx2,fma")))
+static void avx2Scale(int n, float alpha, float* x) {
+    const __m256 alphaVec = _mm256_set1_ps(alpha);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_ps(x + i, _mm256_mul_ps(alphaVec, _mm256_loadu_ps(x + i)));
+    for (; i < n; i++) x[i] *= alpha;
+}
+
+__attribute__((target("avx2,fma")))
+static int32_t avx2HorizontalSumInt32(__m256i v) {
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+
+// x must stay below 128 so that a pair of u8 * s8 products can't saturate maddubs' int16 lanes.
+__attribute__((target("avx2,fma")))
+static void avx2GemvInt8(int m, int k, const int8_t* A, int lda, const uint8_t* x, int32_t* y) {
+    const __m256i ones = _mm256_set1_epi16(1);
+
+    for (int i = 0; i < m; i += 4) {
+        const int8_t* r0 = A + (long)i * lda;
+        const int8_t* r1 = i + 1 < m ? r0 + lda : r0;
+        const int8_t* r2 = i + 2 < m ? r1 + lda : r1;
+        const int8_t* r3 = i + 3 < m ? r2 + lda : r2;
+        __m256i s0 = _mm256_setzero_si256(), s1 = _mm256_setzero_si256(), s2 = _mm256_setzero_si256(), s3 = _mm256_setzero_si256();
+
+        int j = 0;
+        for (; j + 32 <= k; j += 32) {
+            const __m256i xv = _mm256_loadu_si256((const __m256i*)(x + j));
+            s0 = _mm256_add_epi32(s0, _mm256_madd_epi16(_mm256_maddubs_epi16(xv, _mm256_loadu_si256((const __m256i*)(r0 + j))), ones));
+            s1 = _mm256_add_epi32(s1, _mm256_madd_epi16(_mm256_maddubs_epi16(xv, _mm256_loadu_si256((const __m256i*)(r1 + j))), ones));
+            s2 = _mm256_add_epi32(s2, _mm256_madd_epi16(_mm256_maddubs_epi16(xv, _mm256_loadu_si256((const __m256i*)(r2 + j))), ones));
+            s3 = _mm256_add_epi32(s3, _mm256_madd_epi16(_mm256_maddubs_epi16(xv, _mm256_loadu_si256((const __m256i*)(r3 + j))), ones));
+        }
+
+        int32_t t[4] = { avx2HorizontalSumInt32(s0), avx2HorizontalSumInt32(s1), avx2HorizontalSumInt32(s2), avx2HorizontalSumInt32(s3) };
+        for (; j < k; j++) {
+            t[0] += (int32_t)x[j] * r0[j];
+            t[1] += (int32_t)x[j] * r1[j];
+            t[2] += (int32_t)x[j] * r2[j];
+            t[3] += (int32_t)x[j] * r3[j];
+        }
+
+        for (int r = 0; r < 4 && i + r < m; r++) y[i + r] = t[r];
+    }
+}
+
+// Gathers from four rows of A share each load of indices and values.
+__attribute__((target("avx2,fma")))
+static void avx2SparseGemm(int m, int n, const float* A, int lda, const int* offsets, const int* indices, const float* values, float* C, int ldc) {
+    for (int i = 0; i < m; i += 4) {
+        const float* r0 = A + (long)i * lda;
+        const float* r1 = A + (long)std::min(i + 1, m - 1) * lda;
+        const float* r2 = A + (long)std::min(i + 2, m - 1) * lda;
+        const float* r3 = A + (long)std::min(i + 3, m - 1) * lda;
+
+        for (int j = 0; j < n; j++) {
+            __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps(), s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+
+            int p = offsets[j];
+            for (; p + 8 <= offsets[j + 1]; p += 8) {
+                const __m256i index = _mm256_loadu_si256((const __m256i*)(indices + p));
+                const __m256 value = _mm256_loadu_ps(values + p);
+                s0 = _mm256_fmadd_ps(_mm256_i32gather_ps(r0, index, 4), value, s0);
+                s1 = _mm256_fmadd_ps(_mm256_i32gather_ps(r1, index, 4), value, s1);
+                s2 = _mm256_fmadd_ps(_mm256_i32gather_ps(r2, index, 4), value, s2);
+                s3 = _mm256_fmadd_ps(_mm256_i32gather_ps(r3, index, 4), value, s3);
+            }
+
+            float t[4] = { avx2HorizontalSum(s0), avx2HorizontalSum(s1), avx2HorizontalSum(s2), avx2HorizontalSum(s3) };
+            for (; p < offsets[j + 1]; p++) {
+                t[0] += r0[indices[p]] * values[p];
+                t[1] += r1[indices[p]] * values[p];
+                t[2] += r2[indices[p]] * values[p];
+                t[3] += r3[indices[p]] * values[p];
+            }
+
+            for (int r = 0; r < 4 && i + r < m; r++) C[(long)(i + r) * ldc + j] += t[r];
+        }
+    }
+}
+
+__attribute__((target("avx2,fma,avxvnni")))
+static void avxVnniGemvInt8(int m, int k, const int8_t* A, int lda, const uint8_t* x, int32_t* y) {
+    for (int i = 0; i < m; i += 4) {
+        const int8_t* r0 = A + (long)i * lda;
+        const int8_t* r1 = i + 1 < m ? r0 + lda : r0;
+        const int8_t* r2 = i + 2 < m ? r1 + lda : r1;
+        const int8_t* r3 = i + 3 < m ? r2 + lda : r2;
+        __m256i s0 = _mm256_setzero_si256(), s1 = _mm256_setzero_si256(), s2 = _mm256_setzero_si256(), s3 = _mm256_setzero_si256();
+
+        int j = 0;
+        for (; j + 32 <= k; j += 32) {
+            const __m256i xv = _mm256_loadu_si256((const __m256i*)(x + j));
+            s0 = _mm256_dpbusd_avx_epi32(s0, xv, _mm256_loadu_si256((const __m256i*)(r0 + j)));
+            s1 = _mm256_dpbusd_avx_epi32(s1, xv, _mm256_loadu_si256((const __m256i*)(r1 + j)));
+            s2 = _mm256_dpbusd_avx_epi32(s2, xv, _mm256_loadu_si256((const __m256i*)(r2 + j)));
+            s3 = _mm256_dpbusd_avx_epi32(s3, xv, _mm256_loadu_si256((const __m256i*)(r3 + j)));
+        }
+
+        int32_t t[4] = { avx2HorizontalSumInt32(s0), avx2HorizontalSumInt32(s1), avx2HorizontalSumInt32(s2), avx2HorizontalSumInt32(s3) };
+        for (; j < k; j++) {
+            t[0] += (int32_t)x[j] * r0[j];
+            t[1] += (int32_t)x[j] * r1[j];
+            t[2] += (int32_t)x[j] * r2[j];
+            t[3] += (int32_t)x[j] * r3[j];
+        }
+
+        for (int r = 0; r < 4 && i + r < m; r++) y[i + r] = t[r];
+    }
+}
+
+__attribute__((target("avx512f")))
+static void avx512MicroKernel(int kc, const float* a, const float* b, float* c, int ldc, float alpha) {
+    __m512 acc[8][2];
+    for (int i = 0; i < 8; i++) acc[i][0] = acc[i][1] = _mm512_setzero_ps();
+
+    for (int p = 0; p < kc; p++, a += 8, b += 32) {
+        const __m512 b0 = _mm512_loadu_ps(b);
+        const __m512 b1 = _mm512_loadu_ps(b + 16);
+        for (int i = 0; i < 8; i++) {
+            const __m512 ai = _mm512_set1_ps(a[i]);
+            acc[i][0] = _mm512_fmadd_ps(ai, b0, acc[i][0]);
+            acc[i][1] = _mm512_fmadd_ps(ai, b1, acc[i][1]);
+        }
+    }
+
+    const __m512 alphaVec = _mm512_set1_ps(alpha);
+    for (int i = 0; i < 8; i++) {
+        float* row = c + (long)i * ldc;
+        _mm512_storeu_ps(row, _mm512_fmadd_ps(alphaVec, acc[i][0], _mm512_loadu_ps(row)));
+        _mm512_storeu_ps(row + 16, _mm512_fmadd_ps(alphaVec, acc[i][1], _mm512_loadu_ps(row + 16)));
+    }
+}
+
+// Reductions within the 512-bit register. GCC's _mm512_reduce_add_* and the unmasked shuffles
+// take an undefined register as the pass-through source, which -Wmaybe-uninitialized reports at
+// every use, so the shuffles here are the masked forms with every lane selected.
+__attribute__((target("avx512f")))
+static float avx512HorizontalSum(__m512 v) {
+    const __mmask16 all = 0xFFFF;
+    v = _mm512_add_ps(v, _mm512_mask_shuffle_f32x4(v, all, v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm512_add_ps(v, _mm512_mask_shuffle_f32x4(v, all, v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm512_add_ps(v, _mm512_mask_permute_ps(v, all, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm512_add_ps(v, _mm512_mask_permute_ps(v, all, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm512_cvtss_f32(v);
+}
+
+__attribute__((target("avx512f")))
+static int32_t avx512HorizontalSumInt32(__m512i v) {
+    const __mmask16 all = 0xFFFF;
+    v = _mm512_add_epi32(v, _mm512_mask_shuffle_i32x4(v, all, v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm512_add_epi32(v, _mm512_mask_shuffle_i32x4(v, all, v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm512_add_epi32(v, _mm512_mask_shuffle_epi32(v, all, v, (_MM_PERM_ENUM)_MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm512_add_epi32(v, _mm512_mask_shuffle_epi32(v, all, v, (_MM_PERM_ENUM)_MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm512_cvtsi512_si32(v);
+}
+
+__attribute__((target("avx512f")))
+static void avx512Gemv(int m, int n, float alpha, const float* A, int lda, const float* x, float* y) {
+    int i = 0;
+    for (; i + 4 <= m; i += 4) {
+        const float* r0 = A + (long)i * lda;
+        const float* r1 = r0 + lda;
+        const float* r2 = r1 + lda;
+        const float* r3 = r2 + lda;
+        __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps(), s2 = _mm512_setzero_ps(), s3 = _mm512_setzero_ps();
+
+        int j = 0;
+        for (; j + 16 <= n; j += 16) {
+            const __m512 xv = _mm512_loadu_ps(x + j);
+            s0 = _mm512_fmadd_ps(_mm512_loadu_ps(r0 + j), xv, s0);
+            s1 = _mm512_fmadd_ps(_mm512_loadu_ps(r1 + j), xv, s1);
+            s2 = _mm512_fmadd_ps(_mm512_loadu_ps(r2 + j), xv, s2);
+            s3 = _mm512_fmadd_ps(_mm512_loadu_ps(r3 + j), xv, s3);
+        }
+        if (j < n) {
+            const __mmask16 tail = (__mmask16)((1u << (n - j)) - 1);
+            const __m512 xv = _mm512_maskz_loadu_ps(tail, x + j);
+            s0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, r0 + j), xv, s0);
+            s1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, r1 + j), xv, s1);
+            s2 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, r2 + j), xv, s2);
+            s3 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, r3 + j), xv, s3);
+        }
+
+        y[i] += alpha * avx512HorizontalSum(s0);
+        y[i + 1] += alpha * avx512HorizontalSum(s1);
+        y[i + 2] += alpha * avx512HorizontalSum(s2);
+        y[i + 3] += alpha * avx512HorizontalSum(s3);
+    }
+
+    for (; i < m; i++) {
+        const float* row = A + (long)i * lda;
+        __m512 s = _mm512_setzero_ps();
+        int j = 0;
+        for (; j + 16 <= n; j += 16) s = _mm512_fmadd_ps(_mm512_loadu_ps(row + j), _mm512_loadu_ps(x + j), s);
+        if (j < n) {
+            const __mmask16 tail = (__mmask16)((1u << (n - j)) - 1);
+            s = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, row + j), _mm512_maskz_loadu_ps(tail, x + j), s);
+        }
+        y[i] += alpha * avx512HorizontalSum(s);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void avx512GemvTransposed(int m, int n, float alpha, const float* A, int lda, const float* x, float* y) {
+    int i = 0;
+    for (; i + 4 <= m; i += 4) {
+        const float* r0 = A + (long)i * lda;
+        const float* r1 = r0 + lda;
+        const float* r2 = r1 + lda;
+        const float* r3 = r2 + lda;
+        const __m512 v0 = _mm512_set1_ps(alpha * x[i]), v1 = _mm512_set1_ps(alpha * x[i + 1]);
+        const __m512 v2 = _mm512_set1_ps(alpha * x[i + 2]), v3 = _mm512_set1_ps(alpha * x[i + 3]);
+
+        for (int j = 0; j < n; j += 16) {
+            const __mmask16 mask = n - j >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (n - j)) - 1);
+            __m512 yv = _mm512_maskz_loadu_ps(mask, y + j);
+            yv = _mm512_fmadd_ps(v0, _mm512_maskz_loadu_ps(mask, r0 + j), yv);
+            yv = _mm512_fmadd_ps(v1, _mm512_maskz_loadu_ps(mask, r1 + j), yv);
+            yv = _mm512_fmadd_ps(v2, _mm512_maskz_loadu_ps(mask, r2 + j), yv);
+            yv = _mm512_fmadd_ps(v3, _mm512_maskz_loadu_ps(mask, r3 + j), yv);
+            _mm512_mask_storeu_ps(y + j, mask, yv);
+        }
+    }
+
+    for (; i < m; i++) {
+        const float* row = A + (long)i * lda;
+        const __m512 sv = _mm512_set1_ps(alpha * x[i]);
+        for (int j = 0; j < n; j += 16) {
+            const __mmask16 mask = n - j >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (n - j)) - 1);
+            _mm512_mask_storeu_ps(y + j, mask, _mm512_fmadd_ps(sv, _mm512_maskz_loadu_ps(mask, row + j), _mm512_maskz_loadu_ps(mask, y + j)));
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+static void avx512Axpy(int n, float alpha, const float* x, float* y) {
+    const __m512 alphaVec = _mm512_set1_ps(alpha);
+    for (int i = 0; i < n; i += 16) {
+        const __mmask16 mask = n - i >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (n - i)) - 1);
+        _mm512_mask_storeu_ps(y + i, mask, _mm512_fmadd_ps(alphaVec, _mm512_maskz_loadu_ps(mask, x + i), _mm512_maskz_loadu_ps(mask, y + i)));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void avx512Scale(int n, float alpha, float* x) {
+    const __m512 alphaVec = _mm512_set1_ps(alpha);
+    for (int i = 0; i < n; i += 16) {
+        const __mmask16 mask = n - i >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (n - i)) - 1);
+        _mm512_mask_storeu_ps(x + i, mask, _mm512_mul_ps(alphaVec, _mm512_maskz_loadu_ps(mask, x + i)));
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void avx512GemvInt8(int m, int k, const int8_t* A, int lda, const uint8_t* x, int32_t* y) {
+    const __m512i ones = _mm512_set1_epi16(1);
+
+    for (int i = 0; i < m; i += 4) {
+        const int8_t* r0 = A + (long)i * lda;
+        const int8_t* r1 = i + 1 < m ? r0 + lda : r0;
+        const int8_t* r2 = i + 2 < m ? r1 + lda : r1;
+        const int8_t* r3 = i + 3 < m ? r2 + lda : r2;
+        __m512i s0 = _mm512_setzero_si512(), s1 = _mm512_setzero_si512(), s2 = _mm512_setzero_si512(), s3 = _mm512_setzero_si512();
+
+        for (int j = 0; j < k; j += 64) {
+            const __mmask64 mask = k - j >= 64 ? ~(__mmask64)0 : (((__mmask64)1 << (k - j)) - 1);
+            const __m512i xv = _mm512_maskz_loadu_epi8(mask, x + j);
+            s0 = _mm512_add_epi32(s0, _mm512_madd_epi16(_mm512_maddubs_epi16(xv, _mm512_maskz_loadu_epi8(mask, r0 + j)), ones));
+            s1 = _mm512_add_epi32(s1, _mm512_madd_epi16(_mm512_maddubs_epi16(xv, _mm512_maskz_loadu_epi8(mask, r1 + j)), ones));
+            s2 = _mm512_add_epi32(s2, _mm512_madd_epi16(_mm512_maddubs_epi16(xv, _mm512_maskz_loadu_epi8(mask, r2 + j)), ones));
+            s3 = _mm512_add_epi32(s3, _mm512_madd_epi16(_mm512_maddubs_epi16(xv, _mm512_maskz_loadu_epi8(mask, r3 + j)), ones));
+        }
+
+        const int32_t t[4] = { avx512HorizontalSumInt32(s0), avx512HorizontalSumInt32(s1), avx512HorizontalSumInt32(s2), avx512HorizontalSumInt32(s3) };
+        for (int r = 0; r < 4 && i + r < m; r++) y[i + r] = t[r];
+    }
+}
+
+__attribute__((target("avx512f")))
+static void avx512SparseGemm(int m, int n, const float* A, int lda, const int* offsets, const int* indices, const float* values, float* C, int ldc) {
+    for (int i = 0; i < m; i += 4) {
+        const float* r0 = A + (long)i * lda;
+        const float* r1 = A + (long)std::min(i + 1, m - 1) * lda;
+        const float* r2 = A + (long)std::min(i + 2, m - 1) * lda;
+        const float* r3 = A + (long)std::min(i + 3, m - 1) * lda;
+
+        for (int j = 0; j < n; j++) {
+            __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps(), s2 = _mm512_setzero_ps(), s3 = _mm512_setzero_ps();
+
+            for (int p = offsets[j]; p < offsets[j + 1]; p += 16) {
+                const __mmask16 mask = offsets[j + 1] - p >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (offsets[j + 1] - p)) - 1);
+                const __m512i index = _mm512_maskz_loadu_epi32(mask, indices + p);
+                const __m512 value = _mm512_maskz_loadu_ps(mask, values + p);
+                s0 = _mm512_fmadd_ps(_mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, index, r0, 4), value, s0);
+                s1 = _mm512_fmadd_ps(_mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, index, r1, 4), value, s1);
+                s2 = _mm512_fmadd_ps(_mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, index, r2, 4), value, s2);
+                s3 = _mm512_fmadd_ps(_mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, index, r3, 4), value, s3);
+            }
+
+            const float t[4] = { avx512HorizontalSum(s0), avx512HorizontalSum(s1), avx512HorizontalSum(s2), avx512HorizontalSum(s3) };
+            for (int r = 0; r < 4 && i + r < m; r++) C[(long)(i + r) * ldc + j] += t[r];
+        }
+    }
+}
+
+// The indices within a column are distinct, so each 16 wide gather-add-scatter is conflict free.
+__attribute__((target("avx512f")))
+static void avx512SparseGemmTransposed(int m, int n, const float* A, int lda, const int* offsets, const int* indices, const float* values, float* C, int ldc) {
+    for (int i = 0; i < m; i++) {
+        float* c = C + (long)i * ldc;
+
+        for (int j = 0; j < n; j++) {
+            const float a = A[(long)i * lda + j];
+            if (a == 0.0f) continue;
+
+            const __m512 scale = _mm512_set1_ps(a);
+            for (int p = offsets[j]; p < offsets[j + 1]; p += 16) {
+                const __mmask16 mask = offsets[j + 1] - p >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (offsets[j + 1] - p)) - 1);
+                const __m512i index = _mm512_maskz_loadu_epi32(mask, indices + p);
+                const __m512 value = _mm512_maskz_loadu_ps(mask, values + p);
+                const __m512 current = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, index, c, 4);
+                _mm512_mask_i32scatter_ps(c, mask, index, _mm512_fmadd_ps(scale, value, current), 4);
+            }
+        }
+    }
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static void avx512VnniGemvInt8(int m, int k, const int8_t* A, int lda, const uint8_t* x, int32_t* y) {
+    for (int i = 0; i < m; i += 4) {
+        const int8_t* r0 = A + (long)i * lda;
+        const int8_t* r1 = i + 1 < m ? r0 + lda : r0;
+        const int8_t* r2 = i + 2 < m ? r1 + lda : r1;
+        const int8_t* r3 = i + 3 < m ? r2 + lda : r2;
+        __m512i s0 = _mm512_setzero_si512(), s1 = _mm512_setzero_si512(), s2 = _mm512_setzero_si512(), s3 = _mm512_setzero_si512();
+
+        for (int j = 0; j < k; j += 64) {
+            const __mmask64 mask = k - j >= 64 ? ~(__mmask64)0 : (((__mmask64)1 << (k - j)) - 1);
+            const __m512i xv = _mm512_maskz_loadu_epi8(mask, x + j);
+            s0 = _mm512_dpbusd_epi32(s0, xv, _mm512_maskz_loadu_epi8(mask, r0 + j));
+            s1 = _mm512_dpbusd_epi32(s1, xv, _mm512_maskz_loadu_epi8(mask, r1 + j));
+            s2 = _mm512_dpbusd_epi32(s2, xv, _mm512_maskz_loadu_epi8(mask, r2 + j));
+            s3 = _mm512_dpbusd_epi32(s3, xv, _mm512_maskz_loadu_epi8(mask, r3 + j));
+        }
+
+        const int32_t t[4] = { avx512HorizontalSumInt32(s0), avx512HorizontalSumInt32(s1), avx512HorizontalSumInt32(s2), avx512HorizontalSumInt32(s3) };
+        for (int r = 0; r < 4 && i + r < m; r++) y[i + r] = t[r];
+    }
+}
+
+static const kernelSet scalarKernels = { kernelIsa::scalar, "scalar", 4, 8, scalarMicroKernel, scalarGemv, scalarGemvTransposed, scalarAxpy, scalarScale, scalarGemvInt8,
+                                         scalarSparseGemm, scalarSparseGemmTransposed };
+static const kernelSet avx2Kernels = { kernelIsa::avx2, "avx2", 6, 16, avx2MicroKernel, avx2Gemv, avx2GemvTransposed, avx2Axpy, avx2Scale, avx2GemvInt8,
+                                       avx2SparseGemm, scalarSparseGemmTransposed };
+static const kernelSet avx512Kernels = { kernelIsa::avx512, "avx512", 8, 32, avx512MicroKernel, avx512Gemv, avx512GemvTransposed, avx512Axpy, avx512Scale, avx512GemvInt8,
+                                         avx512SparseGemm, avx512SparseGemmTransposed };
+
+static bool isaSupported(kernelIsa isa) {
+    __builtin_cpu_init();
+
+    switch (isa) {
+        case kernelIsa::avx512: return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+        case kernelIsa::avx2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        default: return true;
+    }
+}
+
+static const kernelSet* selectKernels(kernelIsa isa) {
+    if (isa == kernelIsa::automatic) {
+        if (isaSupported(kernelIsa::avx512)) return &avx512Kernels;
+        if (isaSupported(kernelIsa::avx2)) return &avx2Kernels;
+        return &scalarKernels;
+    }
+
+    if (!isaSupported(isa)) return selectKernels(kernelIsa::automatic);
+
+    switch (isa) {
+        case kernelIsa::avx512: return &avx512Kernels;
+        case kernelIsa::avx2: return &avx2Kernels;
+        default: return &scalarKernels;
+    }
+}
+
+struct int8Kernel {
+    const char* name;
+    void (*gemvKernel)(int m, int k, const int8_t* A, int lda, const uint8_t* x, int32_t* y);
+};
+
+// VNNI dot products are an extension of the selected ISA rather than a separate kernel set.
+static int8Kernel selectInt8Kernel(const kernelSet* kernels) {
+    if (kernels->isa == kernelIsa::avx512 && __builtin_cpu_supports("avx512vnni")) return { "avx512-vnni", avx512VnniGemvInt8 };
+    if (kernels->isa != kernelIsa::scalar && __builtin_cpu_supports("avxvnni")) return { "avx-vnni", avxVnniGemvInt8 };
+    return { kernels->name, kernels->gemvInt8Kernel };
+}
+
+static const kernelSet* activeKernels = selectKernels(kernelIsa::automatic);
+static int8Kernel activeInt8Kernel = selectInt8Kernel(activeKernels);
+
+void setKernelIsa(kernelIsa isa) {
+    activeKernels = selectKernels(isa);
+    activeInt8Kernel = selectInt8Kernel(activeKernels);
+}
+
+kernelIsa getKernelIsa() {
+    return activeKernels->isa;
+}
+
+const char* getKernelIsaName() {
+    return activeKernels->name;
+}
+
+const char* getInt8KernelName() {
+    return activeInt8Kernel.name;
+}
+
+static void scaleOutput(int m, int n, float beta, float* C, int ldc) {
+    if (beta == 1.0f) return;
+
+    for (int i = 0; i < m; i++) {
+        float* row = C + (long)i * ldc;
+        if (beta == 0.0f) std::fill(row, row + n, 0.0f);
+        else for (int j = 0; j < n; j++) row[j] *= beta;
+    }
+}
+
+static void packA(bool transA, const float* A, int lda, int i0, int p0, int mc, int kc, int mr, float* out) {
+    for (int ir = 0; ir < mc; ir += mr) {
+        const int panelRows = std::min(mr, mc - ir);
+
+        for (int p = 0; p < kc; p++, out += mr) {
+            for (int i = 0; i < panelRows; i++) {
+                const int row = i0 + ir + i;
+                const int col = p0 + p;
+                out[i] = transA ? A[(long)col * lda + row] : A[(long)row * lda + col];
+            }
+            for (int i = panelRows; i < mr; i++) out[i] = 0;
+        }
+    }
+}
+
+static void packB(bool transB, const float* B, int ldb, int p0, int j0, int kc, int nc, int nr, float* out) {
+    for (int jr = 0; jr < nc; jr += nr) {
+        const int panelCols = std::min(nr, nc - jr);
+
+        for (int p = 0; p < kc; p++, out += nr) {
+            const int row = p0 + p;
+            if (!transB) {
+                const float* src = B + (long)row * ldb + j0 + jr;
+                std::copy(src, src + panelCols, out);
+            } else {
+                for (int j = 0; j < panelCols; j++) out[j] = B[(long)(j0 + jr + j) * ldb + row];
+            }
+            for (int j = panelCols; j < nr; j++) out[j] = 0;
+        }
+    }
+}
+
+void axpy(int n, float alpha, const float* x, float* y) {
+    if (n > 0) activeKernels->axpyKernel(n, alpha, x, y);
+}
+
+void axpy(float alpha, constMatrixView x, matrixView y) {
+    if (x.rows != y.rows || x.cols != y.cols) throw std::logic_error("Can't add matrices of different dimensions");
+
+    if (x.contiguous() && y.contiguous()) axpy(x.rows * x.cols, alpha, x.getDataPointer(), y.getDataPointer());
+    else for (int i = 0; i < x.rows; i++) axpy(x.cols, alpha, x.row(i).getDataPointer(), y.row(i).getDataPointer());
+}
+
+void copy(constMatrixView source, matrixView destination) {
+    if (source.rows != destination.rows || source.cols != destination.cols) throw std::logic_error("Can't copy between matrices of different dimensions");
+
+    for (int i = 0; i < source.rows; i++) {
+        const float* row = source.row(i).getDataPointer();
+        std::copy(row, row + source.cols, destination.row(i).getDataPointer());
+    }
+}
+
+void scale(int n, float alpha, float* x) {
+    if (n > 0) activeKernels->scaleKernel(n, alpha, x);
+}
+
+void gemvInt8(int m, int k, const int8_t* A, int lda, const uint8_t* x, int32_t* y) {
+    if (m <= 0) return;
+
+    NN_TIMED_SCOPE(gemvInt8);
+    NN_COUNT_WORK(gemvInt8, 2.0 * m * k, (double)m * k + k + 4.0 * m);
+
+    if (k <= 0) std::fill(y, y + m, 0);
+    else activeInt8Kernel.gemvKernel(m, k, A, lda, x, y);
+}
+
+void sparseGemm(int m, int n, const float* A, int lda, const int* offsets, const int* indices, const float* values, float* C, int ldc) {
+    if (m <= 0 || n <= 0) return;
+
+    NN_TIMED_SCOPE(sparseGemm);
+    NN_COUNT_WORK(sparseGemm, 2.0 * m * offsets[n], sizeof(float) * ((double)m * offsets[n] + 2.0 * offsets[n] + (double)m * n));
+    activeKernels->sparseGemmKernel(m, n, A, lda, offsets, indices, values, C, ldc);
+}
+
+void sparseGemmTransposed(int m, int n, const float* A, int lda, const int* offsets, const int* indices, const float* values, float* C, int ldc) {
+    if (m <= 0 || n <= 0) return;
+
+    NN_TIMED_SCOPE(sparseGemm);
+    NN_COUNT_WORK(sparseGemm, 2.0 * m * offsets[n], sizeof(float) * (2.0 * m * offsets[n] + 2.0 * offsets[n] + (double)m * n));
+    activeKernels->sparseGemmTransposedKernel(m, n, A, lda, offsets, indices, values, C, ldc);
+}
+
+void gemv(int m, int n, float alpha, const float* A, int lda, const float* x, float beta, float* y) {
+    if (m <= 0) return;
+
+    scaleOutput(1, m, beta, y, m);
+    if (n <= 0 || alpha == 0.0f) return;
+
+    NN_TIMED_SCOPE(gemv);
+    NN_COUNT_WORK(gemv, 2.0 * m * n, sizeof(float) * ((double)m * n + n + m));
+    activeKernels->gemvKernel(m, n, alpha, A, lda, x, y);
+}
+
+void gemvTransposed(int m, int n, float alpha, const float* A, int lda, const float* x, float beta, float* y) {
+    if (n <= 0) return;
+
+    scaleOutput(1, n, beta, y, n);
+    if (m <= 0 || alpha == 0.0f) return;
+
+    NN_TIMED_SCOPE(gemv);
+    NN_COUNT_WORK(gemv, 2.0 * m * n, sizeof(float) * ((double)m * n + n + m));
+    activeKernels->gemvTransposedKernel(m, n, alpha, A, lda, x, y);
+}
+
+void gemm(bool transA, bool transB, int m, int n, int k, float alpha, const float* A, int lda, const float* B, int ldb, float beta, float* C, int ldc) {
+    if (m <= 0 || n <= 0) return;
+
+    if (n == 1 && ldc == 1 && (transB || ldb == 1)) {
+        if (transA) gemvTransposed(k, m, alpha, A, lda, B, beta, C);
+        else gemv(m, k, alpha, A, lda, B, beta, C);
+        return;
+    }
+
+    if (m == 1 && (!transA || lda == 1)) {
+        if (transB) gemv(n, k, alpha, B, ldb, A, beta, C);
+        else gemvTransposed(k, n, alpha, B, ldb, A, beta, C);
+        return;
+    }
+
+    scaleOutput(m, n, beta, C, ldc);
+    if (k <= 0 || alpha == 0.0f) return;
+
+    NN_TIMED_SCOPE(gemm);
+    NN_COUNT_WORK(gemm, 2.0 * m * n * k, sizeof(float) * ((double)m * k + (double)k * n + (double)m * n));
+
+    const kernelSet& kernels = *activeKernels;
+    const int mr = kernels.mr;
+    const int nr = kernels.nr;
+
+    thread_local std::vector<float> packedA;
+    thread_local std::vector<float> packedB;
+    packedA.resize((size_t)MC * KC);
+    packedB.resize((size_t)NC * KC);
+
+    float tile[8 * 32];
+
+    for (int jc = 0; jc < n; jc += NC) {
+        const int nc = std::min(NC, n - jc);
+
+        for (int pc = 0; pc < k; pc += KC) {
+            const int kc = std::min(KC, k - pc);
+            packB(transB, B, ldb, pc, jc, kc, nc, nr, packedB.data());
+
+            for (int ic = 0; ic < m; ic += MC) {
+                const int mc = std::min(MC, m - ic);
+                packA(transA, A, lda, ic, pc, mc, kc, mr, packedA.data());
+
+                for (int jr = 0; jr < nc; jr += nr) {
+                    const int nrValid = std::min(nr, nc - jr);
+
+                    for (int ir = 0; ir < mc; ir += mr) {
+                        const int mrValid = std::min(mr, mc - ir);
+                        const float* a = packedA.data() + (long)ir * kc;
+                        const float* b = packedB.data() + (long)jr * kc;
+                        float* c = C + (long)(ic + ir) * ldc + jc + jr;
+
+                        if (mrValid == mr && nrValid == nr) {
+                            kernels.microKernel(kc, a, b, c, ldc, alpha);
+                            continue;
+                        }
+
+                        std::fill(tile, tile + mr * nr, 0.0f);
+                        kernels.microKernel(kc, a, b, tile, nr, alpha);
+
+                        for (int i = 0; i < mrValid; i++)
+                            for (int j = 0; j < nrValid; j++)
+                                c[(long)i * ldc + j] += tile[i * nr + j];
+                    }
+                }
+            }
+        }
+    }
+}
+
+void gemm(bool transA, bool transB, float alpha, constMatrixView A, constMatrixView B, float beta, matrixView C) {
+    const int m = transA ? A.cols : A.rows;
+    const int k = transA ? A.rows : A.cols;
+    const int n = transB ? B.rows : B.cols;
+
+    if ((transB ? B.cols : B.rows) != k) throw std::logic_error("Can't multiply matrices of m1.cols != m2.rows");
+    if (C.rows != m || C.cols != n) throw std::logic_error("Output matrix has wrong dimensions for product");
+
+    gemm(transA, transB, m, n, k, alpha, A.getDataPointer(), A.stride, B.getDataPointer(), B.stride, beta, C.getDataPointer(), C.stride);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "matrixView.h"
+#include <cstdint>
+
+enum class kernelIsa { automatic, scalar, avx2, avx512 };
+
+// Row-major C = alpha * op(A) * op(B) + beta * C, where op(A) is m x k and op(B) is k x n.
+void gemm(bool transA, bool transB, int m, int n, int k, float alpha, const float* A, int lda, const float* B, int ldb, float beta, float* C, int ldc);
+
+// The same product over views, which may be rows, columns or blocks of larger matrices.
+void gemm(bool transA, bool transB, float alpha, constMatrixView A, constMatrixView B, float beta, matrixView C);
+
+// y(m) = alpha * A(m x n) * x(n) + beta * y
+void gemv(int m, int n, float alpha, const float* A, int lda, const float* x, float beta, float* y);
+
+// y(n) = alpha * A(m x n)^T * x(m) + beta * y
+void gemvTransposed(int m, int n, float alpha, const float* A, int lda, const float* x, float beta, float* y);
+
+// C(m x n) += A(m x k) * X(k x n), with X given by the non-zeros of each column: column j holds
+// values[p] at row indices[p] for p in [offsets[j], offsets[j + 1]).
+void sparseGemm(int m, int n, const float* A, int lda, const int* offsets, const int* indices, const float* values, float* C, int ldc);
+
+// C(m x k) += A(m x n) * X(k x n)^T, with X compressed as above. Only the columns of C at row
+// indices of X are touched. The indices within a column must be distinct.
+void sparseGemmTransposed(int m, int n, const float* A, int lda, const int* offsets, const int* indices, const float* values, float* C, int ldc);
+
+// y(n) += alpha * x(n)
+void axpy(int n, float alpha, const float* x, float* y);
+
+// y += alpha * x, for views of the same dimensions
+void axpy(float alpha, constMatrixView x, matrixView y);
+
+// destination = source, for views of the same dimensions
+void copy(constMatrixView source, matrixView destination);
+
+// x(n) *= alpha
+void scale(int n, float alpha, float* x);
+
+// y(m) = A(m x k) * x(k) in int32, with x holding values in [0, 127]
+void gemvInt8(int m, int k, const int8_t* A, int lda, const uint8_t* x, int32_t* y);
+
+void setKernelIsa(kernelIsa isa);
+kernelIsa getKernelIsa();
+const char* getKernelIsaName();
+const char* getInt8KernelName();
@@ -1,77 +1,114 @@
 #include "matrix.h"
+#include "kernels.h"
 #include <iostream>
 #include <stdexcept>
+#include <algorithm>
 
-matrix::matrix(const int matrixRows, const int matrixColumns) {
+matrix::matrix(const int matrixRows, const int matrixColumns) : data(matrixRows * matrixColumns, 0.0f) {
     rows = matrixRows;
     cols = matrixColumns;
+}
 
-    for (int i = 0; i < rows * cols; i++) data.push_back(0);
+matrix::matrix(const matrix& other) : data(other.values(), other.values() + other.rows * other.cols) {
+    rows = other.rows;
+    cols = other.cols;
 }
 
-float& matrix::operator()(const int row, const int col) {
-    if (row * cols + col >= data.size()) throw std::logic_error("Value out of range");
-    return data[row * cols + col];
+matrix& matrix::operator=(const matrix& other) {
+    if (this == &other) return *this;
+
+    reshape(other.rows, other.cols);
+    std::copy(other.values(), other.values() + rows * cols, values());
+
+    return *this;
 }
 
-matrix matrix::operator+(matrix& other) {
-    if (rows != other.rows || cols != other.cols) throw std::logic_error("Can't add matrices of different dimensions");
+matrix& matrix::operator=(matrix&& other) {
+    if (this == &other) return *this;
 
-    matrix out(rows, cols);
+    if (external) return *this = (const matrix&)other;
 
-    for (int row = 0; row < rows; row++) {
-        for (int col = 0; col < cols; col++) {
-            out(row, col) = (*this)(row, col) + other(row, col);
-        }
-    }
+    data = std::move(other.data);
+    external = other.external;
+    rows = other.rows;
+    cols = other.cols;
 
-    return out;
+    return *this;
 }
 
-matrix matrix::operator*(const float scalar) {
-     matrix out(rows, cols);
+matrix matrix::wrap(float* memory, const int matrixRows, const int matrixColumns) {
+    matrix out;
 
-    for (int row = 0; row < rows; row++)
-        for (int col = 0; col < cols; col++)
-            out(row, col) = (*this)(row, col) * scalar;
+    out.external = memory;
+    out.rows = matrixRows;
+    out.cols = matrixColumns;
 
     return out;
 }
 
+void matrix::attach(float* memory, const int matrixRows, const int matrixColumns) {
+    std::vector<float>().swap(data);
+
+    external = memory;
+    rows = matrixRows;
+    cols = matrixColumns;
+}
+
+bool matrix::isView() const {
+    return external != nullptr;
+}
+
+void matrix::reshape(const int matrixRows, const int matrixColumns) {
+    if (external && matrixRows * matrixColumns != rows * cols) throw std::logic_error("Can't resize a matrix that wraps external memory");
+    if (!external && matrixRows * matrixColumns != data.size()) data.resize(matrixRows * matrixColumns);
+
+    rows = matrixRows;
+    cols = matrixColumns;
+}
 
-matrix matrix::operator*(matrix& other) {
+matrix matrix::operator*(const matrix& other) const {
     if (cols != other.rows) throw std::logic_error("Can't multiply matrices of m1.cols != m2.rows");
 
     matrix out(rows, other.cols);
 
-    for (int row = 0; row < out.rows; row++)
-        for (int col = 0; col < out.cols; col++)
-            for (int k = 0; k < cols; k++) 
-                out(row, col) += (*this)(row, k) * other(k, col);
+    out.multiply(*this, other);
 
     return out;
 }
 
-matrix matrix::operator-(matrix& other) {
-    return (other * -1.0f) + (*this);
+matrix& matrix::operator*=(const float scalar) {
+    scale(rows * cols, scalar, values());
+    return *this;
 }
 
-matrix matrix::operator-() {
-    return (*this) * -1.0f;
+void matrix::axpy(const float alpha, constMatrixView x) {
+    ::axpy(alpha, x, *this);
 }
 
-void matrix::applyFunction(std::function<float (float)> f) {
-    for (int i = 0; i < rows * cols; i++) data[i] = f(data[i]);
+void matrix::multiply(constMatrixView a, constMatrixView b, const float alpha, const float beta, const bool transposeA, const bool transposeB) {
+    gemm(transposeA, transposeB, alpha, a, b, beta, *this);
+}
+
+void matrix::resize(const int matrixRows, const int matrixColumns) {
+    reshape(matrixRows, matrixColumns);
+}
+
+void matrix::fill(const float value) {
+    std::fill(values(), values() + rows * cols, value);
 }
 
 float* matrix::getDataPointer() {
-    return data.data();
+    return values();
+}
+
+const float* matrix::getDataPointer() const {
+    return values();
 }
 
 void matrix::print() {
     for (int row = 0; row < rows; row++) {
         for (int col = 0; col < cols; col++)
-            std::cout << data[row * cols + col] << " ";
+            std::cout << values()[row * cols + col] << " ";
         std::cout << std::endl;
     }
 }
@@ -1,31 +1,183 @@
 #pragma once
+#include "matrixView.h"
 #include <vector>
-#include <functional>
+#include <stdexcept>
+#include <type_traits>
+
+class matrix;
+
+template <typename T> struct isMatrixExpression : std::false_type {};
+template <> struct isMatrixExpression<matrix> : std::true_type {};
+
+template <typename... T>
+using enableIfExpressions = std::enable_if_t<(isMatrixExpression<std::decay_t<T>>::value && ...), int>;
+
+struct addOperation { static float apply(const float a, const float b) { return a + b; } };
+struct subtractOperation { static float apply(const float a, const float b) { return a - b; } };
+
+// Elementwise expressions are evaluated lazily in one pass when assigned to a matrix.
+// They hold references to their operands, so they must not outlive the full expression.
+template <typename Left, typename Right, typename Operation>
+struct binaryExpression {
+    const Left& left;
+    const Right& right;
+    int rows;
+    int cols;
+
+    binaryExpression(const Left& leftOperand, const Right& rightOperand) : left(leftOperand), right(rightOperand) {
+        if (left.rows != right.rows || left.cols != right.cols) throw std::logic_error("Can't operate on matrices of different dimensions");
+        rows = left.rows;
+        cols = left.cols;
+    }
+
+    float operator[](const int i) const { return Operation::apply(left[i], right[i]); }
+};
+
+template <typename Inner>
+struct scaledExpression {
+    const Inner& inner;
+    float scalar;
+    int rows;
+    int cols;
+
+    scaledExpression(const Inner& innerOperand, const float scale) : inner(innerOperand), scalar(scale), rows(innerOperand.rows), cols(innerOperand.cols) {}
+
+    float operator[](const int i) const { return inner[i] * scalar; }
+};
+
+template <typename Left, typename Right, typename Operation>
+struct isMatrixExpression<binaryExpression<Left, Right, Operation>> : std::true_type {};
+template <typename Inner>
+struct isMatrixExpression<scaledExpression<Inner>> : std::true_type {};
 
 class matrix {
 private:
     std::vector<float> data;
+    float* external = nullptr;
+
+    float* values() { return external ? external : data.data(); }
+    const float* values() const { return external ? external : data.data(); }
+
+    void reshape(const int matrixRows, const int matrixColumns);
 
 public:
-    int rows;
-    int cols;
+    int rows = 0;
+    int cols = 0;
 
     matrix() {};
     matrix(const int matrixRows, const int matrixColumns);
-    
-    float& operator()(const int row, const int col);
 
-    matrix operator+(matrix& other);
+    // Copies always own their storage; assigning into a matrix that wraps external memory writes through to it.
+    matrix(const matrix& other);
+    matrix(matrix&& other) = default;
+    matrix& operator=(const matrix& other);
+    matrix& operator=(matrix&& other);
+
+    template <typename Expression, enableIfExpressions<Expression> = 0>
+    matrix(const Expression& expression) : data(expression.rows * expression.cols), rows(expression.rows), cols(expression.cols) {
+        for (int i = 0; i < rows * cols; i++) data[i] = expression[i];
+    }
+
+    template <typename Expression, enableIfExpressions<Expression> = 0>
+    matrix& operator=(const Expression& expression) {
+        reshape(expression.rows, expression.cols);
+
+        float* out = values();
+        for (int i = 0; i < rows * cols; i++) out[i] = expression[i];
+
+        return *this;
+    }
+
+    // Non-owning matrix over rows * cols floats that must outlive it.
+    static matrix wrap(float* memory, const int matrixRows, const int matrixColumns);
+    // Turns this matrix into such a view, releasing any storage it owned.
+    void attach(float* memory, const int matrixRows, const int matrixColumns);
+    bool isView() const;
+
+    float& operator()(const int row, const int col) {
+        NN_CHECK_INDEX(row, col, rows, cols);
+        return values()[row * cols + col];
+    }
+
+    float operator()(const int row, const int col) const {
+        NN_CHECK_INDEX(row, col, rows, cols);
+        return values()[row * cols + col];
+    }
+
+    float& operator[](const int i) { return values()[i]; }
+    float operator[](const int i) const { return values()[i]; }
+
+    operator matrixView() { return matrixView(values(), rows, cols); }
+    operator constMatrixView() const { return constMatrixView(values(), rows, cols); }
 
-    matrix operator*(const float scalar);
-    matrix operator*(matrix& other);
+    matrixView row(const int index) { return matrixView(*this).row(index); }
+    constMatrixView row(const int index) const { return constMatrixView(*this).row(index); }
+    matrixView column(const int index) { return matrixView(*this).column(index); }
+    constMatrixView column(const int index) const { return constMatrixView(*this).column(index); }
+    matrixView block(const int firstRow, const int firstColumn, const int blockRows, const int blockColumns) { return matrixView(*this).block(firstRow, firstColumn, blockRows, blockColumns); }
+    constMatrixView block(const int firstRow, const int firstColumn, const int blockRows, const int blockColumns) const { return constMatrixView(*this).block(firstRow, firstColumn, blockRows, blockColumns); }
 
-    matrix operator-(matrix& other);
-    matrix operator-();
+    matrix operator*(const matrix& other) const;
 
-    void applyFunction(std::function<float (float)> f);
+    template <typename Expression, enableIfExpressions<Expression> = 0>
+    matrix& operator+=(const Expression& other) {
+        if (rows != other.rows || cols != other.cols) throw std::logic_error("Can't add matrices of different dimensions");
+        float* out = values();
+        for (int i = 0; i < rows * cols; i++) out[i] += other[i];
+        return *this;
+    }
+
+    template <typename Expression, enableIfExpressions<Expression> = 0>
+    matrix& operator-=(const Expression& other) {
+        if (rows != other.rows || cols != other.cols) throw std::logic_error("Can't subtract matrices of different dimensions");
+        float* out = values();
+        for (int i = 0; i < rows * cols; i++) out[i] -= other[i];
+        return *this;
+    }
+
+    matrix& operator*=(const float scalar);
+
+    // this += alpha * x
+    void axpy(const float alpha, constMatrixView x);
+    // this = alpha * op(a) * op(b) + beta * this
+    void multiply(constMatrixView a, constMatrixView b, const float alpha = 1.0f, const float beta = 0.0f, const bool transposeA = false, const bool transposeB = false);
+
+    template <typename Function>
+    void applyFunction(Function f) {
+        float* out = values();
+        for (int i = 0; i < rows * cols; i++) out[i] = f(out[i]);
+    }
+
+    void resize(const int matrixRows, const int matrixColumns);
+    void fill(const float value);
 
     float* getDataPointer();
+    const float* getDataPointer() const;
 
     void print();
 };
+
+template <typename Left, typename Right, enableIfExpressions<Left, Right> = 0>
+binaryExpression<Left, Right, addOperation> operator+(const Left& left, const Right& right) {
+    return binaryExpression<Left, Right, addOperation>(left, right);
+}
+
+template <typename Left, typename Right, enableIfExpressions<Left, Right> = 0>
+binaryExpression<Left, Right, subtractOperation> operator-(const Left& left, const Right& right) {
+    return binaryExpression<Left, Right, subtractOperation>(left, right);
+}
+
+template <typename Inner, enableIfExpressions<Inner> = 0>
+scaledExpression<Inner> operator*(const Inner& inner, const float scalar) {
+    return scaledExpression<Inner>(inner, scalar);
+}
+
+template <typename Inner, enableIfExpressions<Inner> = 0>
+scaledExpression<Inner> operator*(const float scalar, const Inner& inner) {
+    return scaledExpression<Inner>(inner, scalar);
+}
+
+template <typename Inner, enableIfExpressions<Inner> = 0>
+scaledExpression<Inner> operator-(const Inner& inner) {
+    return scaledExpression<Inner>(inner, -1.0f);
+}
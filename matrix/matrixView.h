@@ -0,0 +1,65 @@
+#pragma once
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+// Element access through operator() is only bounds checked in builds without NDEBUG, so release
+// kernels and training loops don't pay a branch per element.
+#ifdef NDEBUG
+#define NN_CHECK_INDEX(row, col, rows, cols)
+#else
+#define NN_CHECK_INDEX(row, col, rows, cols) checkMatrixIndex(row, col, rows, cols)
+#endif
+
+inline void checkMatrixIndex(const int row, const int col, const int rows, const int cols) {
+    if (row < 0 || row >= rows || col < 0 || col >= cols) throw std::logic_error("Value out of range");
+}
+
+// A non-owning window over row-major floats whose rows are `stride` elements apart: a whole
+// matrix, a row, a column, a block of one, or any external buffer such as a mapped dataset or
+// model. The memory must outlive the view. T is float or const float.
+template <typename T>
+class basicMatrixView {
+private:
+    T* values = nullptr;
+
+public:
+    int rows = 0;
+    int cols = 0;
+    int stride = 0;
+
+    basicMatrixView() {};
+    basicMatrixView(T* data, const int viewRows, const int viewColumns) : values(data), rows(viewRows), cols(viewColumns), stride(viewColumns) {};
+    basicMatrixView(T* data, const int viewRows, const int viewColumns, const int rowStride) : values(data), rows(viewRows), cols(viewColumns), stride(rowStride) {};
+
+    // A writable view can be passed wherever a read-only one is expected.
+    template <typename U, std::enable_if_t<std::is_same<const U, T>::value && !std::is_same<U, T>::value, int> = 0>
+    basicMatrixView(const basicMatrixView<U>& other) : values(other.getDataPointer()), rows(other.rows), cols(other.cols), stride(other.stride) {};
+
+    T& operator()(const int row, const int col) const {
+        NN_CHECK_INDEX(row, col, rows, cols);
+        return values[(long)row * stride + col];
+    }
+
+    T* getDataPointer() const { return values; }
+
+    // True when the rows follow each other with no gaps, so the view is one run of rows * cols floats.
+    bool contiguous() const { return stride == cols || rows <= 1; }
+
+    basicMatrixView row(const int index) const { return block(index, 0, 1, cols); }
+    basicMatrixView column(const int index) const { return block(0, index, rows, 1); }
+
+    basicMatrixView block(const int firstRow, const int firstColumn, const int blockRows, const int blockColumns) const {
+        if (firstRow < 0 || firstColumn < 0 || blockRows < 0 || blockColumns < 0 || firstRow + blockRows > rows || firstColumn + blockColumns > cols)
+            throw std::logic_error("Block out of range");
+
+        return basicMatrixView(values + (long)firstRow * stride + firstColumn, blockRows, blockColumns, stride);
+    }
+
+    void fill(const float value) const {
+        for (int i = 0; i < rows; i++) std::fill(values + (long)i * stride, values + (long)i * stride + cols, value);
+    }
+};
+
+typedef basicMatrixView<float> matrixView;
+typedef basicMatrixView<const float> constMatrixView;
@@ -0,0 +1,75 @@
+#include "sparseColumns.h"
+
+bool sparseColumns::compress(constMatrixView dense, bool transposed, float maxDensity) {
+    const float* data = dense.getDataPointer();
+    const long size = (long)dense.rows * dense.cols;
+
+    // Deciding costs one vectorizable pass, so a batch that stays dense pays little for the check.
+    long count = 0;
+    for (int row = 0; row < dense.rows; row++) {
+        const float* denseRow = data + (long)row * dense.stride;
+        for (int col = 0; col < dense.cols; col++) count += denseRow[col] != 0.0f;
+    }
+
+    if (size == 0 || count > maxDensity * size) {
+        clear();
+        return false;
+    }
+
+    rows = transposed ? dense.cols : dense.rows;
+    cols = transposed ? dense.rows : dense.cols;
+
+    const long entryStride = transposed ? 1 : dense.stride;
+    const long columnStride = transposed ? dense.stride : 1;
+
+    // Every entry is written and whether it's non-zero only decides if the cursor moves past it,
+    // since on typical inputs a branch would be taken at random. That needs one slot of slack.
+    offsets.resize(cols + 1);
+    indices.resize(count + 1);
+    values.resize(count + 1);
+
+    int position = 0;
+    offsets[0] = 0;
+
+    for (int j = 0; j < cols; j++) {
+        const float* column = data + j * columnStride;
+
+        for (int i = 0; i < rows; i++) {
+            const float value = column[i * entryStride];
+
+            indices[position] = i;
+            values[position] = value;
+            position += value != 0.0f;
+        }
+
+        offsets[j + 1] = position;
+    }
+
+    return true;
+}
+
+void sparseColumns::clear() {
+    offsets.clear();
+    rows = 0;
+    cols = 0;
+}
+
+bool sparseColumns::compressed() const {
+    return !offsets.empty();
+}
+
+int sparseColumns::nonZeros() const {
+    return offsets.empty() ? 0 : offsets.back();
+}
+
+const int* sparseColumns::getOffsets() const {
+    return offsets.data();
+}
+
+const int* sparseColumns::getIndices() const {
+    return indices.data();
+}
+
+const float* sparseColumns::getValues() const {
+    return values.data();
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "matrix.h"
+#include <vector>
+
+// The non-zero entries of a dense matrix, stored column by column (compressed sparse columns).
+// For a batch of layer inputs each column is one example, so this is the per-example index list
+// of the non-zero inputs. Rebuilding it reuses the buffers, which stop allocating once they have
+// seen the densest batch.
+class sparseColumns {
+private:
+    std::vector<int> offsets;
+    std::vector<int> indices;
+    std::vector<float> values;
+
+public:
+    int rows = 0;
+    int cols = 0;
+
+    // Compresses dense (or dense^T when transposed) unless more than maxDensity of its entries are
+    // non-zero, in which case it clears itself and returns false.
+    bool compress(constMatrixView dense, bool transposed, float maxDensity);
+    void clear();
+
+    // False after clear or a compress that fell back to dense.
+    bool compressed() const;
+    int nonZeros() const;
+
+    const int* getOffsets() const;
+    const int* getIndices() const;
+    const float* getValues() const;
+};
@@ -0,0 +1,43 @@
+#include "workspace.h"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+void workspace::alignedDelete::operator()(float* memory) const {
+    std::free(memory);
+}
+
+size_t workspace::footprint(size_t rows, size_t cols) {
+    const size_t alignedFloats = WORKSPACE_ALIGNMENT / sizeof(float);
+    return (rows * cols + alignedFloats - 1) / alignedFloats * alignedFloats;
+}
+
+void workspace::reserve(size_t floats) {
+    if (floats <= capacity) return;
+
+    float* grown = (float*)std::aligned_alloc(WORKSPACE_ALIGNMENT, footprint(floats, 1) * sizeof(float));
+    if (!grown) throw std::bad_alloc();
+
+    std::memset(grown, 0, footprint(floats, 1) * sizeof(float));
+
+    memory.reset(grown);
+    capacity = floats;
+    used = 0;
+}
+
+void workspace::reset() {
+    used = 0;
+}
+
+void workspace::attach(matrix& target, int rows, int cols) {
+    const size_t floats = footprint(rows, cols);
+    if (used + floats > footprint(capacity, 1)) throw std::logic_error("Workspace is too small for the requested matrix");
+
+    target.attach(memory.get() + used, rows, cols);
+    used += floats;
+}
+
+size_t workspace::size() const {
+    return capacity;
+}
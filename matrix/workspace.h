@@ -0,0 +1,36 @@
+#pragma once
+#include "matrix.h"
+#include <memory>
+#include <cstddef>
+
+#define WORKSPACE_ALIGNMENT 64
+
+// 64-byte aligned float arena that matrices are carved from as views by bumping an offset.
+// Growing reallocates and invalidates every matrix attached before, so callers size it up front
+// with reserve and reset it before attaching again.
+class workspace {
+private:
+    struct alignedDelete {
+        void operator()(float* memory) const;
+    };
+
+    std::unique_ptr<float[], alignedDelete> memory;
+    size_t capacity = 0;
+    size_t used = 0;
+
+public:
+    workspace() {};
+    workspace(workspace&&) = default;
+    workspace& operator=(workspace&&) = default;
+
+    // Floats taken by a rows x cols matrix, padded so the next one starts aligned.
+    static size_t footprint(size_t rows, size_t cols);
+
+    // Makes room for `floats` in total, zero-filled when the arena has to grow.
+    void reserve(size_t floats);
+    void reset();
+
+    void attach(matrix& target, int rows, int cols);
+
+    size_t size() const;
+};
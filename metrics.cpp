@@ -0,0 +1,216 @@
+#include "metrics.h"
+#include <mutex>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <stdexcept>
+
+static const char* phaseNames[(int)metricPhase::count] = {
+    "feedforward", "forwardPass", "backpropagate", "activationGradients", "gradientDescent", "gradientReduction", "weightUpdate",
+    "evaluation", "shuffle", "batchAssembly", "batchWait", "gemm", "gemv", "gemvInt8", "sparseGemm", "checkpointSnapshot", "gradientAllReduce"
+};
+
+namespace metricsDetail {
+    std::atomic<bool> enabled{false};
+    std::atomic<bool> tracing{false};
+    phaseCounters phases[(int)metricPhase::count];
+    layerCounters layers[METRICS_MAX_LAYERS];
+    std::atomic<long> examples{0};
+    std::atomic<long> allocations{0};
+    std::atomic<bool> countingAllocations{false};
+}
+
+using namespace metricsDetail;
+
+struct traceEvent {
+    metricPhase phase;
+    long startNanoseconds;
+    long durationNanoseconds;
+};
+
+// Each thread appends to its own buffer, registered once, so recording only locks on first use.
+// startTrace and writeTrace clear the buffers under the lock, which is why they can't run while
+// traced work does.
+struct traceBuffer {
+    int thread;
+    std::vector<traceEvent> events;
+};
+
+static long nanosecondsSinceEpoch(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+static std::mutex stateMutex;
+// Read by training threads without the lock, so resetMetrics can move it while they run.
+static std::atomic<long> metricsStart{nanosecondsSinceEpoch(std::chrono::steady_clock::now())};
+static std::chrono::steady_clock::time_point lastReport = std::chrono::steady_clock::now();
+static metricsCallback callback;
+static double callbackInterval = 1.0;
+static std::vector<std::shared_ptr<traceBuffer>> traceBuffers;
+
+
+void setMetricsEnabled(bool enable) {
+    enabled.store(enable, std::memory_order_relaxed);
+}
+
+bool metricsEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+void resetMetrics() {
+    std::lock_guard<std::mutex> lock(stateMutex);
+
+    for (phaseCounters& phase : phases) {
+        phase.calls = 0;
+        phase.nanoseconds = 0;
+        phase.flops = 0;
+        phase.bytes = 0;
+    }
+
+    for (layerCounters& layer : layers) {
+        layer.flops = 0;
+        layer.bytes = 0;
+    }
+
+    examples = 0;
+    lastReport = std::chrono::steady_clock::now();
+    metricsStart.store(nanosecondsSinceEpoch(lastReport), std::memory_order_relaxed);
+}
+
+long getAllocationCount() {
+    return countingAllocations.load(std::memory_order_relaxed) ? allocations.load(std::memory_order_relaxed) : -1;
+}
+
+metricsSnapshot getMetrics() {
+    metricsSnapshot snapshot;
+
+    snapshot.elapsedSeconds = (nanosecondsSinceEpoch(std::chrono::steady_clock::now()) - metricsStart.load(std::memory_order_relaxed)) * 1e-9;
+    snapshot.examples = examples.load(std::memory_order_relaxed);
+    snapshot.examplesPerSecond = snapshot.elapsedSeconds > 0 ? snapshot.examples / snapshot.elapsedSeconds : 0;
+    snapshot.allocations = getAllocationCount();
+
+    for (int phase = 0; phase < (int)metricPhase::count; phase++) {
+        snapshot.phases.push_back({ phaseNames[phase], phases[phase].calls.load(std::memory_order_relaxed), phases[phase].nanoseconds.load(std::memory_order_relaxed) * 1e-9,
+                                    phases[phase].flops.load(std::memory_order_relaxed), phases[phase].bytes.load(std::memory_order_relaxed) });
+    }
+
+    int usedLayers = 0;
+    for (int layer = 0; layer < METRICS_MAX_LAYERS; layer++)
+        if (layers[layer].flops.load(std::memory_order_relaxed) > 0) usedLayers = layer + 1;
+
+    for (int layer = 0; layer < usedLayers; layer++)
+        snapshot.layers.push_back({ layers[layer].flops.load(std::memory_order_relaxed), layers[layer].bytes.load(std::memory_order_relaxed) });
+
+    return snapshot;
+}
+
+std::string metricsToJson(const metricsSnapshot& snapshot) {
+    std::ostringstream json;
+
+    json << "{\"elapsed_seconds\": " << snapshot.elapsedSeconds << ", \"examples\": " << snapshot.examples
+         << ", \"examples_per_second\": " << snapshot.examplesPerSecond << ", \"allocations\": " << snapshot.allocations << ", \"phases\": {";
+
+    bool first = true;
+    for (const phaseMetrics& phase : snapshot.phases) {
+        if (phase.calls == 0) continue;
+
+        json << (first ? "" : ", ") << "\"" << phase.name << "\": {\"calls\": " << phase.calls << ", \"seconds\": " << phase.seconds;
+        if (phase.flops > 0) json << ", \"flops\": " << phase.flops << ", \"bytes\": " << phase.bytes << ", \"gflops\": " << (phase.seconds > 0 ? phase.flops / phase.seconds * 1e-9 : 0);
+        json << "}";
+        first = false;
+    }
+
+    json << "}, \"layers\": [";
+    for (int layer = 0; layer < snapshot.layers.size(); layer++)
+        json << (layer ? ", " : "") << "{\"flops\": " << snapshot.layers.at(layer).flops << ", \"bytes\": " << snapshot.layers.at(layer).bytes << "}";
+    json << "]}";
+
+    return json.str();
+}
+
+void setMetricsCallback(metricsCallback metricsReport, double intervalSeconds) {
+    std::lock_guard<std::mutex> lock(stateMutex);
+
+    callback = metricsReport;
+    callbackInterval = intervalSeconds;
+    lastReport = std::chrono::steady_clock::now();
+
+    if (callback) enabled = true;
+}
+
+void writeMetricsJsonLines(const char* fileName, double intervalSeconds) {
+    std::shared_ptr<std::ofstream> file = std::make_shared<std::ofstream>(fileName, std::ofstream::app);
+    if (!*file) throw std::runtime_error(std::string("Can't open metrics file ") + fileName);
+
+    setMetricsCallback([file](const metricsSnapshot& snapshot) {
+        *file << metricsToJson(snapshot) << std::endl;
+    }, intervalSeconds);
+}
+
+void reportMetrics() {
+    if (!enabled.load(std::memory_order_relaxed)) return;
+
+    std::unique_lock<std::mutex> lock(stateMutex, std::try_to_lock);
+    if (!lock.owns_lock() || !callback) return;
+
+    const auto now = std::chrono::steady_clock::now();
+    if (std::chrono::duration<double>(now - lastReport).count() < callbackInterval) return;
+    lastReport = now;
+
+    metricsCallback report = callback;
+    lock.unlock();
+
+    report(getMetrics());
+}
+
+void startTrace() {
+    std::lock_guard<std::mutex> lock(stateMutex);
+
+    for (std::shared_ptr<traceBuffer>& buffer : traceBuffers) buffer->events.clear();
+
+    enabled = true;
+    tracing = true;
+}
+
+void metricsDetail::recordTraceEvent(metricPhase phase, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    thread_local std::shared_ptr<traceBuffer> buffer;
+
+    if (!buffer) {
+        std::lock_guard<std::mutex> lock(stateMutex);
+
+        buffer = std::make_shared<traceBuffer>();
+        buffer->thread = traceBuffers.size();
+        buffer->events.reserve(1 << 16);
+        traceBuffers.push_back(buffer);
+    }
+
+    buffer->events.push_back({ phase, nanosecondsSinceEpoch(start) - metricsStart.load(std::memory_order_relaxed),
+                               std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() });
+}
+
+void writeTrace(const char* fileName) {
+    tracing = false;
+
+    std::ofstream file(fileName);
+    if (!file) throw std::runtime_error(std::string("Can't open trace file ") + fileName);
+
+    std::lock_guard<std::mutex> lock(stateMutex);
+
+    // Chrome's trace event format, with microsecond timestamps.
+    file << std::fixed << std::setprecision(3) << "{\"traceEvents\": [\n";
+
+    bool first = true;
+    for (const std::shared_ptr<traceBuffer>& buffer : traceBuffers) {
+        for (const traceEvent& event : buffer->events) {
+            file << (first ? "" : ",\n") << "{\"name\": \"" << phaseNames[(int)event.phase] << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->thread
+                 << ", \"ts\": " << event.startNanoseconds * 1e-3 << ", \"dur\": " << event.durationNanoseconds * 1e-3 << "}";
+            first = false;
+        }
+
+        buffer->events.clear();
+    }
+
+    file << "\n]}\n";
+}
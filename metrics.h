@@ -0,0 +1,166 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <functional>
+#include <atomic>
+#include <chrono>
+
+// Instrumentation of the training and inference hot paths. With NN_INSTRUMENTATION undefined the
+// NN_* macros expand to nothing and every query below reports zeros. When compiled in, recording
+// still costs a single relaxed load per scope until it's switched on with setMetricsEnabled,
+// setMetricsCallback, writeMetricsJsonLines or startTrace.
+
+enum class metricPhase {
+    feedforward,
+    forwardPass,
+    backpropagate,
+    activationGradients,
+    gradientDescent,
+    gradientReduction,
+    weightUpdate,
+    evaluation,
+    shuffle,
+    batchAssembly,
+    batchWait,
+    gemm,
+    gemv,
+    gemvInt8,
+    sparseGemm,
+    checkpointSnapshot,
+    gradientAllReduce,
+    count
+};
+
+#define METRICS_MAX_LAYERS 32
+
+struct phaseMetrics {
+    const char* name;
+    long calls;
+    double seconds;
+    double flops;
+    double bytes;
+};
+
+struct layerMetrics {
+    double flops;
+    double bytes;
+};
+
+struct metricsSnapshot {
+    double elapsedSeconds;
+    long examples;
+    double examplesPerSecond;
+    // -1 unless allocationCounter.cpp is linked in, as it is into the library built with
+    // NN_COUNT_ALLOCATIONS
+    long allocations;
+
+    std::vector<phaseMetrics> phases;
+    std::vector<layerMetrics> layers;
+};
+
+typedef std::function<void (const metricsSnapshot&)> metricsCallback;
+
+void setMetricsEnabled(bool enabled);
+bool metricsEnabled();
+void resetMetrics();
+metricsSnapshot getMetrics();
+std::string metricsToJson(const metricsSnapshot& snapshot);
+
+// The callback runs on the training thread between mini-batches, at most once per interval.
+void setMetricsCallback(metricsCallback callback, double intervalSeconds = 1.0);
+// Appends one JSON object per interval to fileName. Replaces any callback.
+void writeMetricsJsonLines(const char* fileName, double intervalSeconds = 1.0);
+void reportMetrics();
+
+// Records every timed scope as a Chrome trace event (chrome://tracing, Perfetto). Threads append
+// events without a lock, so call startTrace before the traced work starts and writeTrace once it
+// has finished, never while training or inference is running. resetMetrics may be called anytime.
+void startTrace();
+void writeTrace(const char* fileName);
+
+// Heap allocations through operator new since startup, or -1 when they aren't counted.
+long getAllocationCount();
+
+namespace metricsDetail {
+    struct phaseCounters {
+        std::atomic<long> calls{0};
+        std::atomic<long> nanoseconds{0};
+        std::atomic<double> flops{0};
+        std::atomic<double> bytes{0};
+    };
+
+    struct layerCounters {
+        std::atomic<double> flops{0};
+        std::atomic<double> bytes{0};
+    };
+
+    extern std::atomic<bool> enabled;
+    extern std::atomic<bool> tracing;
+    extern phaseCounters phases[(int)metricPhase::count];
+    extern layerCounters layers[METRICS_MAX_LAYERS];
+    extern std::atomic<long> examples;
+    // Maintained by the operator new in allocationCounter.cpp, when it's linked in.
+    extern std::atomic<long> allocations;
+    extern std::atomic<bool> countingAllocations;
+
+    void recordTraceEvent(metricPhase phase, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+    inline void add(std::atomic<double>& counter, double value) {
+        double current = counter.load(std::memory_order_relaxed);
+        while (!counter.compare_exchange_weak(current, current + value, std::memory_order_relaxed));
+    }
+
+    inline void count(metricPhase phase, double flops, double bytes) {
+        if (!enabled.load(std::memory_order_relaxed)) return;
+        add(phases[(int)phase].flops, flops);
+        add(phases[(int)phase].bytes, bytes);
+    }
+
+    inline void countLayer(int layer, double flops, double bytes) {
+        if (!enabled.load(std::memory_order_relaxed) || layer < 0 || layer >= METRICS_MAX_LAYERS) return;
+        add(layers[layer].flops, flops);
+        add(layers[layer].bytes, bytes);
+    }
+
+    inline void countExamples(long count) {
+        if (enabled.load(std::memory_order_relaxed)) examples.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    class scopedTimer {
+    private:
+        metricPhase phase;
+        bool active;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        scopedTimer(metricPhase timedPhase) : phase(timedPhase), active(enabled.load(std::memory_order_relaxed)) {
+            if (active) start = std::chrono::steady_clock::now();
+        }
+
+        ~scopedTimer() {
+            if (!active) return;
+
+            const auto end = std::chrono::steady_clock::now();
+            phases[(int)phase].calls.fetch_add(1, std::memory_order_relaxed);
+            phases[(int)phase].nanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), std::memory_order_relaxed);
+
+            if (tracing.load(std::memory_order_relaxed)) recordTraceEvent(phase, start, end);
+        }
+    };
+}
+
+#ifdef NN_INSTRUMENTATION
+#define NN_METRICS_CONCAT_(a, b) a##b
+#define NN_METRICS_CONCAT(a, b) NN_METRICS_CONCAT_(a, b)
+#define NN_TIMED_SCOPE(phase) metricsDetail::scopedTimer NN_METRICS_CONCAT(timedScope, __LINE__)(metricPhase::phase)
+#define NN_COUNT_WORK(phase, flops, bytes) metricsDetail::count(metricPhase::phase, flops, bytes)
+#define NN_COUNT_LAYER(layer, flops, bytes) metricsDetail::countLayer(layer, flops, bytes)
+#define NN_COUNT_EXAMPLES(count) metricsDetail::countExamples(count)
+#define NN_REPORT_METRICS() reportMetrics()
+#else
+#define NN_TIMED_SCOPE(phase)
+#define NN_COUNT_WORK(phase, flops, bytes)
+#define NN_COUNT_LAYER(layer, flops, bytes)
+#define NN_COUNT_EXAMPLES(count)
+#define NN_REPORT_METRICS()
+#endif
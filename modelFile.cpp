@@ -0,0 +1,152 @@
+#include "modelFile.h"
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <cstring>
+
+static size_t alignOffset(size_t offset, size_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+static size_t layoutTensors(const std::vector<int>& shape, size_t start, size_t alignment, std::vector<size_t>& weightsOffsets, std::vector<size_t>& biasesOffsets) {
+    size_t offset = start;
+
+    weightsOffsets.clear();
+    biasesOffsets.clear();
+
+    for (int layer = 1; layer < shape.size(); layer++) {
+        offset = alignOffset(offset, alignment);
+        weightsOffsets.push_back(offset);
+        offset += (size_t)shape.at(layer) * shape.at(layer - 1) * sizeof(float);
+    }
+
+    for (int layer = 1; layer < shape.size(); layer++) {
+        offset = alignOffset(offset, alignment);
+        biasesOffsets.push_back(offset);
+        offset += (size_t)shape.at(layer) * sizeof(float);
+    }
+
+    return offset;
+}
+
+uint64_t modelFile::checksum(const unsigned char* bytes, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+modelFile::modelFile(const char* fileName, const std::vector<int>& legacyShape, bool verifyChecksum) : fileName(fileName) {
+    file = std::make_shared<mappedFile>(fileName, true);
+
+    const unsigned char* bytes = file->getData();
+    const size_t size = file->getSize();
+
+    if (size < sizeof(modelFileHeader) || std::memcmp(bytes, MODEL_FILE_MAGIC, sizeof(MODEL_FILE_MAGIC)) != 0) {
+        if (legacyShape.size() < 2 || layoutTensors(legacyShape, 0, sizeof(float), weightsOffsets, biasesOffsets) != size)
+            throw std::runtime_error(std::string("Model file has no header and does not match the network shape: ") + fileName);
+
+        legacy = true;
+        description.shape = legacyShape;
+        return;
+    }
+
+    modelFileHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+
+    if (header.version != MODEL_FILE_VERSION) throw std::runtime_error(std::string("Unsupported model file version in ") + fileName);
+    if (header.dataType != (uint32_t)modelDataType::float32) throw std::runtime_error(std::string("Unsupported model data type in ") + fileName);
+    if (header.alignment == 0 || header.alignment % sizeof(float) != 0) throw std::runtime_error(std::string("Bad tensor alignment in ") + fileName);
+    if (header.layerCount < 2 || sizeof(header) + header.layerCount * sizeof(uint32_t) > header.headerSize || header.headerSize > size)
+        throw std::runtime_error(std::string("Truncated model file header in ") + fileName);
+
+    for (uint32_t layer = 0; layer < header.layerCount; layer++) {
+        uint32_t layerSize;
+        std::memcpy(&layerSize, bytes + sizeof(header) + layer * sizeof(uint32_t), sizeof(layerSize));
+        description.shape.push_back(layerSize);
+    }
+
+    description.activation = (activationKind)header.activation;
+    description.error = (errorKind)header.error;
+    description.regularization = (regularizationKind)header.regularization;
+
+    const size_t end = layoutTensors(description.shape, header.headerSize, header.alignment, weightsOffsets, biasesOffsets);
+    if (end != size || header.tensorBytes != size - header.headerSize) throw std::runtime_error(std::string("Model file size does not match its header in ") + fileName);
+
+    tensorsBegin = header.headerSize;
+    tensorBytes = header.tensorBytes;
+    expectedChecksum = header.checksum;
+
+    if (verifyChecksum) verify();
+}
+
+void modelFile::verify() const {
+    if (legacy) return;
+
+    if (checksum(file->getData() + tensorsBegin, tensorBytes) != expectedChecksum)
+        throw std::runtime_error("Model file checksum mismatch in " + fileName);
+}
+
+const modelDescription& modelFile::getDescription() const {
+    return description;
+}
+
+bool modelFile::isLegacy() const {
+    return legacy;
+}
+
+float* modelFile::getWeights(int layer) {
+    return (float*)(file->getData() + weightsOffsets.at(layer));
+}
+
+float* modelFile::getBiases(int layer) {
+    return (float*)(file->getData() + biasesOffsets.at(layer));
+}
+
+std::shared_ptr<mappedFile> modelFile::getMapping() {
+    return file;
+}
+
+void modelFile::write(const char* fileName, const modelDescription& description, const std::vector<matrix>& weights, const std::vector<matrix>& biases) {
+    const size_t headerSize = alignOffset(sizeof(modelFileHeader) + description.shape.size() * sizeof(uint32_t), MODEL_FILE_ALIGNMENT);
+
+    std::vector<size_t> weightsOffsets;
+    std::vector<size_t> biasesOffsets;
+    const size_t end = layoutTensors(description.shape, headerSize, MODEL_FILE_ALIGNMENT, weightsOffsets, biasesOffsets);
+
+    std::vector<unsigned char> bytes(end, 0);
+
+    for (int layer = 0; layer < weights.size(); layer++) {
+        std::memcpy(bytes.data() + weightsOffsets.at(layer), weights.at(layer).getDataPointer(), (size_t)weights.at(layer).rows * weights.at(layer).cols * sizeof(float));
+        std::memcpy(bytes.data() + biasesOffsets.at(layer), biases.at(layer).getDataPointer(), (size_t)biases.at(layer).rows * sizeof(float));
+    }
+
+    modelFileHeader header = {};
+    std::memcpy(header.magic, MODEL_FILE_MAGIC, sizeof(MODEL_FILE_MAGIC));
+    header.version = MODEL_FILE_VERSION;
+    header.headerSize = headerSize;
+    header.dataType = (uint32_t)modelDataType::float32;
+    header.alignment = MODEL_FILE_ALIGNMENT;
+    header.layerCount = description.shape.size();
+    header.activation = (uint32_t)description.activation;
+    header.error = (uint32_t)description.error;
+    header.regularization = (uint32_t)description.regularization;
+    header.tensorBytes = end - headerSize;
+    header.checksum = checksum(bytes.data() + headerSize, header.tensorBytes);
+
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    for (int layer = 0; layer < description.shape.size(); layer++) {
+        const uint32_t layerSize = description.shape.at(layer);
+        std::memcpy(bytes.data() + sizeof(header) + layer * sizeof(uint32_t), &layerSize, sizeof(layerSize));
+    }
+
+    std::ofstream outFile(fileName, std::ofstream::binary);
+    outFile.write((const char*)bytes.data(), bytes.size());
+    outFile.close();
+
+    if (!outFile) throw std::runtime_error(std::string("Can't write model file ") + fileName);
+}
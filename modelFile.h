@@ -0,0 +1,73 @@
+#pragma once
+#include "matrix/matrix.h"
+#include "activations.h"
+#include "mappedFile.h"
+#include <vector>
+#include <memory>
+#include <string>
+#include <cstdint>
+
+#define MODEL_FILE_MAGIC "NNMODEL"
+#define MODEL_FILE_VERSION 1
+#define MODEL_FILE_ALIGNMENT 64
+
+enum class modelDataType : uint32_t { float32 = 0 };
+
+// Fixed-size little-endian prefix of a model file. It is followed by layerCount uint32 layer
+// sizes, padding up to headerSize, and then every weight matrix and every bias vector (in layer
+// order) as row-major float32 tensors, each starting on a MODEL_FILE_ALIGNMENT boundary.
+// The checksum is FNV-1a over all bytes from headerSize to the end of the file.
+struct modelFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t dataType;
+    uint32_t alignment;
+    uint32_t layerCount;
+    uint32_t activation;
+    uint32_t error;
+    uint32_t regularization;
+    uint64_t tensorBytes;
+    uint64_t checksum;
+};
+
+struct modelDescription {
+    std::vector<int> shape;
+    activationKind activation = activationKind::custom;
+    errorKind error = errorKind::custom;
+    regularizationKind regularization = regularizationKind::custom;
+};
+
+// A validated, memory-mapped model file. Files without a header are read as the legacy format
+// (raw float32 weights followed by raw biases) when legacyShape accounts for their exact size.
+// The header and sizes are always checked; the checksum reads every tensor byte, so it is only
+// computed when verifyChecksum is set or verify() is called.
+class modelFile {
+private:
+    std::shared_ptr<mappedFile> file;
+    std::string fileName;
+    modelDescription description;
+    bool legacy = false;
+    size_t tensorsBegin = 0;
+    uint64_t tensorBytes = 0;
+    uint64_t expectedChecksum = 0;
+
+    std::vector<size_t> weightsOffsets;
+    std::vector<size_t> biasesOffsets;
+
+public:
+    modelFile(const char* fileName, const std::vector<int>& legacyShape, bool verifyChecksum = true);
+
+    // Throws if the tensors don't match the header's checksum. Legacy files have none to check.
+    void verify() const;
+
+    const modelDescription& getDescription() const;
+    bool isLegacy() const;
+
+    float* getWeights(int layer);
+    float* getBiases(int layer);
+    std::shared_ptr<mappedFile> getMapping();
+
+    static void write(const char* fileName, const modelDescription& description, const std::vector<matrix>& weights, const std::vector<matrix>& biases);
+    static uint64_t checksum(const unsigned char* bytes, size_t size);
+};
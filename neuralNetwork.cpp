@@ -1,47 +1,152 @@
 #include "neuralNetwork.h"
+#include "matrix/kernels.h"
+#include "modelFile.h"
+#include "functionPolicies.h"
+#include "metrics.h"
 #include <random>
 #include <iostream>
 #include <exception>
 #include <algorithm>
 #include <fstream>
 #include <cstring>
+#include <sstream>
 
-neuralNetwork::neuralNetwork(std::vector<int> networkShape, float networkLearningRate, activationFunction networkActivation, errorFunction networkError, regularizationFunction networkRegularization, float regularizationLambda) {
-    shape = networkShape;
+#define EVALUATION_BATCH_SIZE 256
+// Past this many examples per slice the dense first layer wins even on sparse inputs, as the GEMM
+// amortizes its packing while the gathers and scatters of the sparse path don't get any cheaper.
+#define SPARSE_MAX_BATCH 16
+
+neuralNetwork::neuralNetwork(std::vector<int> networkShape, float networkLearningRate, activationFunction networkActivation, errorFunction networkError, regularizationFunction networkRegularization, float regularizationLambda)
+    : neuralNetwork(networkShape, networkActivation, networkError, networkRegularization, true) {
     learningRate = networkLearningRate;
+    lambda = regularizationLambda;
+
+    initialize();
+}
+
+neuralNetwork::neuralNetwork(std::vector<int> networkShape, activationFunction networkActivation, errorFunction networkError, regularizationFunction networkRegularization, bool allocate) {
+    shape = networkShape;
+    learningRate = 0.005f;
     activation = networkActivation;
     error = networkError;
 
     regularization = networkRegularization;
-    lambda = regularizationLambda;
+    lambda = 0.01f;
+
+    setThreadCount(1);
+
+    if (allocate) allocateParameters();
+}
+
+neuralNetwork::neuralNetwork(const neuralNetwork& other) : workerStates(other.workerStates.size()), pool(std::make_shared<threadPool>(other.pool->size())), hogwild(other.hogwild), shape(other.shape),
+                                                           activation(other.activation), error(other.error), regularization(other.regularization),
+                                                           learningRate(other.learningRate), lambda(other.lambda), updateRule(other.updateRule),
+                                                           sparseInputDensity(other.sparseInputDensity), checkpointing(other.checkpointing),
+                                                           gradientBucketFloats(other.gradientBucketFloats),
+                                                           validation(other.validation), validationHistory(other.validationHistory), trainingHistory(other.trainingHistory), verbose(other.verbose) {
+    allocateParameters();
+
+    for (int layer = 0; layer < weights.size(); layer++) {
+        weights.at(layer) = other.weights.at(layer);
+        biases.at(layer) = other.biases.at(layer);
+    }
+}
+
+neuralNetwork& neuralNetwork::operator=(const neuralNetwork& other) {
+    if (this == &other) return *this;
+
+    *this = neuralNetwork(other);
+    return *this;
+}
 
-    nodesWithActivation.push_back(matrix(shape.at(0), 1));
+void neuralNetwork::allocateParameters() {
+    size_t required = 0;
+    for (int layer = 1; layer < shape.size(); layer++)
+        required += workspace::footprint(shape.at(layer), shape.at(layer - 1)) + workspace::footprint(shape.at(layer), 1);
+
+    parameters.reserve(required);
+    parameters.reset();
+
+    weights.assign(shape.size() - 1, matrix());
+    biases.assign(shape.size() - 1, matrix());
 
     for (int layer = 1; layer < shape.size(); layer++) {
-        nodes.push_back(matrix(shape.at(layer), 1));
-        nodesWithActivation.push_back(matrix(shape.at(layer), 1));
-        
-        biases.push_back(matrix(shape.at(layer), 1));
-        weights.push_back(matrix(shape.at(layer), shape.at(layer - 1)));
+        parameters.attach(weights.at(layer - 1), shape.at(layer), shape.at(layer - 1));
+        parameters.attach(biases.at(layer - 1), shape.at(layer), 1);
     }
+}
+
+void neuralNetwork::setOptimizer(const optimizerSettings& settings) {
+    updateRule = optimizer(settings);
+}
+
+void neuralNetwork::setCheckpointing(const checkpointSettings& settings) {
+    checkpointing = settings;
+}
+
+void neuralNetwork::setProcessGroup(std::shared_ptr<processGroup> processes, size_t bucketFloats) {
+    group = processes;
+    gradientBucketFloats = bucketFloats;
+}
+
+void neuralNetwork::setValidation(const validationSettings& settings) {
+    validation = settings;
+}
+
+void neuralNetwork::setVerbose(bool printProgress) {
+    verbose = printProgress;
+}
+
+const std::vector<validationResult>& neuralNetwork::getValidationHistory() const {
+    return validationHistory;
+}
+
+const std::vector<evaluationResult>& neuralNetwork::getTrainingHistory() const {
+    return trainingHistory;
+}
 
-    initParameters();
+void neuralNetwork::setSparseInputDensity(float maxDensity) {
+    sparseInputDensity = maxDensity;
 }
 
-void neuralNetwork::initParameters() {
+void neuralNetwork::setThreadCount(int threadCount, bool hogwildUpdates) {
+    pool = std::make_shared<threadPool>(threadCount);
+    workerStates.resize(threadCount);
+    hogwild = hogwildUpdates;
+}
+
+uint64_t neuralNetwork::initialize(const initializerSettings& settings) {
+    const parameterInitializer initializer(settings);
+
+    struct fillRange {
+        int layer;
+        bool biases;
+        long begin;
+        long count;
+    };
+
+    // Large layers are split so that every worker gets a share of the draws.
+    const long rangeSize = 1 << 16;
+    std::vector<fillRange> ranges;
     for (int layer = 1; layer < shape.size(); layer++) {
-        biases.at(layer - 1).applyFunction(getRandomNumber);
+        const long weightCount = (long)shape.at(layer) * shape.at(layer - 1);
 
-        weights.at(layer - 1).applyFunction(getRandomNumber);
+        for (long begin = 0; begin < weightCount; begin += rangeSize) ranges.push_back({ layer - 1, false, begin, std::min(rangeSize, weightCount - begin) });
+        ranges.push_back({ layer - 1, true, 0, shape.at(layer) });
     }
-}
-    
-float neuralNetwork::getRandomNumber(float param) {
-    std::random_device seedGenerator;
-    std::mt19937 generator(seedGenerator());
-    std::uniform_real_distribution<float> distribution(-1, 1);
 
-    return distribution(generator);
+    pool->run([&](int worker) {
+        for (int range = worker; range < ranges.size(); range += pool->size()) {
+            const fillRange& fill = ranges.at(range);
+            matrix& values = fill.biases ? biases.at(fill.layer) : weights.at(fill.layer);
+
+            initializer.fill(fill.layer, fill.biases, shape.at(fill.layer), shape.at(fill.layer + 1), fill.begin, fill.count, values.getDataPointer() + fill.begin);
+        }
+    });
+
+    updateRule.reset();
+
+    return initializer.getSeed();
 }
 
 float neuralNetwork::sigmoidF(const float x) {
@@ -49,7 +154,8 @@ float neuralNetwork::sigmoidF(const float x) {
 }
 
 float neuralNetwork::sigmoidFPrime(const float x) {
-    return (std::exp(-x)) / (std::pow(1 + std::exp(-x), 2)); 
+    const float s = sigmoidF(x);
+    return s * (1 - s);
 }
 
 float neuralNetwork::mseF(const float a, const float t, const int n) {
@@ -78,179 +184,893 @@ float neuralNetwork::L2FPrime(const float w, const int n, const float lambda) {
     return (lambda / n) * w;
 }
 
-matrix neuralNetwork::feedfoward(const matrix &input) {
-    if (input.cols != 1 || input.rows != shape.at(0)) throw std::logic_error("Bad input dimensions");
+void neuralNetwork::prepareState(networkState& batchState, int batchSize) {
+    if (batchState.nodesWithActivation.size() != shape.size()) {
+        batchState.nodes.assign(shape.size() - 1, matrix());
+        batchState.nodesWithActivation.assign(shape.size(), matrix());
+        batchState.deltas.assign(shape.size() - 1, matrix());
+
+        batchState.weightsGradients.assign(shape.size() - 1, matrix());
+        batchState.biasesGradients.assign(shape.size() - 1, matrix());
+        batchState.batchSize = 0;
+    }
 
-    matrix layerMatrix = input;
+    batchState.nodesWithActivation.at(0).resize(shape.at(0), batchSize);
+    batchState.targets.resize(shape.at(shape.size() - 1), batchSize);
 
-    nodesWithActivation.at(0) = input;
+    if (batchState.batchSize == batchSize) return;
+
+    // The arena only grows, so alternating between training and evaluation batch sizes just re-carves it.
+    size_t required = 0;
+    for (int layer = 1; layer < shape.size(); layer++)
+        required += 3 * workspace::footprint(shape.at(layer), batchSize) + workspace::footprint(shape.at(layer), shape.at(layer - 1)) + workspace::footprint(shape.at(layer), 1);
+    required += workspace::footprint(2, batchSize);
+
+    batchState.arena.reserve(required);
+    batchState.arena.reset();
 
     for (int layer = 1; layer < shape.size(); layer++) {
-        layerMatrix = weights.at(layer - 1) * layerMatrix + biases.at(layer - 1);
+        batchState.arena.attach(batchState.nodes.at(layer - 1), shape.at(layer), batchSize);
+        batchState.arena.attach(batchState.nodesWithActivation.at(layer), shape.at(layer), batchSize);
+        batchState.arena.attach(batchState.deltas.at(layer - 1), shape.at(layer), batchSize);
 
-        nodes.at(layer - 1) = layerMatrix;
+        batchState.arena.attach(batchState.weightsGradients.at(layer - 1), shape.at(layer), shape.at(layer - 1));
+        batchState.arena.attach(batchState.biasesGradients.at(layer - 1), shape.at(layer), 1);
+    }
 
-        layerMatrix.applyFunction(activation.f);
+    batchState.arena.attach(batchState.outputScratch, 2, batchSize);
+    batchState.predictions.resize(batchSize);
+    batchState.labels.resize(batchSize);
+    batchState.batchSize = batchSize;
+}
 
-        nodesWithActivation.at(layer) = layerMatrix;
+int exampleSource::size() const {
+    return examples.size();
+}
+
+int exampleSource::inputSize() const {
+    return examples.empty() ? 0 : examples.at(0).input.rows;
+}
+
+int exampleSource::targetSize() const {
+    return examples.empty() ? 0 : examples.at(0).target.rows;
+}
+
+void exampleSource::assembleBatch(const int* indices, int count, matrix& inputs, matrix& targets) const {
+    inputs.resize(inputSize(), count);
+    targets.resize(targetSize(), count);
+
+    for (int example = 0; example < count; example++) {
+        const trainingExample& current = examples.at(indices[example]);
+
+        if (current.input.rows != inputs.rows || current.input.cols != 1) throw std::logic_error("Example must be same dimensions as first layer in network.");
+        if (current.target.rows != targets.rows || current.target.cols != 1) throw std::logic_error("Example target must be same dimensions as last layer in network.");
+
+        copy(current.input, inputs.column(example));
+        copy(current.target, targets.column(example));
     }
+}
 
-    return layerMatrix;
+void neuralNetwork::checkSource(const dataSource& source) {
+    if (source.inputSize() != shape.at(0)) throw std::logic_error("Example must be same dimensions as first layer in network.");
+    if (source.targetSize() != shape.at(shape.size() - 1)) throw std::logic_error("Example target must be same dimensions as last layer in network.");
 }
 
-void neuralNetwork::train(std::vector<trainingExample> examples, int epochs, int miniBatchSize, bool shuffleData) {
-    if (miniBatchSize > examples.size()) throw std::logic_error("Minibatch size can't be bigger than number of examples");
+void neuralNetwork::packExamples(const dataSource& source, const int* indices, int count, networkState& batchState) {
+    prepareState(batchState, count);
 
-    std::random_device seedGenerator;
-    std::mt19937 generator(seedGenerator());
+    source.assembleBatch(indices, count, batchState.nodesWithActivation.at(0), batchState.targets);
+
+    if (sparseInputDensity > 0 && count <= SPARSE_MAX_BATCH) batchState.sparseInputs.compress(batchState.nodesWithActivation.at(0), false, sparseInputDensity);
+    else batchState.sparseInputs.clear();
+}
 
-    for (int epoch = 0; epoch < epochs; epoch++) { 
-        std::cout << "Epoch " << epoch + 1 << " of " << epochs << " ; cost=" << getCostOverExamples(examples) << std::endl;
+matrix neuralNetwork::feedfoward(constMatrixView input) const {
+    if (input.cols != 1 || input.rows != shape.at(0)) throw std::logic_error("Bad input dimensions");
 
-        if (shuffleData) std::shuffle(examples.begin(), examples.end(), generator); 
+    return feedfowardBatch(input);
+}
 
-        for (int miniBatchIter = 0; miniBatchIter <= examples.size() - miniBatchSize; miniBatchIter += miniBatchSize) {
-            std::vector<trainingExample> miniBatch(examples.begin() + miniBatchIter, examples.begin() + miniBatchIter + miniBatchSize);
+matrix neuralNetwork::feedfowardBatch(constMatrixView inputs) const {
+    if (inputs.rows != shape.at(0) || inputs.cols < 1) throw std::logic_error("Bad input dimensions");
 
-            gradientDescent(miniBatch);
+    return inferBatch(inputs, false);
+}
+
+void neuralNetwork::predict(const float* input, float* output) const {
+    predictBatch(input, 1, output);
+}
+
+void neuralNetwork::predict(const uint8_t* input, float* output, float inputScale) const {
+    predictBatch(input, 1, output, inputScale);
+}
+
+void neuralNetwork::predictBatch(const float* inputs, int count, float* outputs) const {
+    if (count < 1) return;
+
+    const matrix& out = inferBatch(constMatrixView(inputs, count, shape.at(0)), true);
+
+    for (int example = 0; example < count; example++)
+        for (int i = 0; i < out.rows; i++) outputs[(long)example * out.rows + i] = out(i, example);
+}
+
+void neuralNetwork::predictBatch(const uint8_t* inputs, int count, float* outputs, float inputScale) const {
+    if (count < 1) return;
+
+    thread_local matrix scaledInputs;
+    scaledInputs.resize(count, shape.at(0));
+
+    float* scaled = scaledInputs.getDataPointer();
+    for (long i = 0; i < (long)count * shape.at(0); i++) scaled[i] = inputs[i] * inputScale;
+
+    predictBatch(scaled, count, outputs);
+}
+
+void neuralNetwork::predictClasses(const float* inputs, int count, int* classes) const {
+    if (count < 1) return;
+
+    inferBatch(constMatrixView(inputs, count, shape.at(0)), true, classes);
+}
+
+void neuralNetwork::predictTopK(const float* inputs, int count, int k, int* classes, float* scores) const {
+    if (count < 1) return;
+    if (k < 1 || k > shape.back()) throw std::logic_error("k must be between 1 and the number of outputs");
+
+    const matrix& out = inferBatch(constMatrixView(inputs, count, shape.at(0)), true);
+
+    // Insertion into the k best so far; k is small next to the output count.
+    for (int example = 0; example < count; example++) {
+        int* bestClasses = classes + (long)example * k;
+        float* bestScores = scores + (long)example * k;
+        int found = 0;
+
+        for (int i = 0; i < out.rows; i++) {
+            const float score = out(i, example);
+            if (found == k && score <= bestScores[k - 1]) continue;
+
+            int position = found < k ? found++ : k - 1;
+            for (; position > 0 && bestScores[position - 1] < score; position--) {
+                bestScores[position] = bestScores[position - 1];
+                bestClasses[position] = bestClasses[position - 1];
+            }
+
+            bestScores[position] = score;
+            bestClasses[position] = i;
         }
     }
 }
 
-void neuralNetwork::gradientDescent(std::vector<trainingExample>& miniBatch) {
-    std::vector<matrix> weightsGradients;
-    std::vector<matrix> biasesGradients;
+const matrix& neuralNetwork::inferBatch(constMatrixView inputs, bool examplesAsRows, int* classes) const {
+    NN_TIMED_SCOPE(feedforward);
+
+    // Scratch belongs to the calling thread, which is what lets concurrent callers share the network.
+    thread_local std::vector<matrix> activations;
+    thread_local std::vector<float> outputScratch;
+    thread_local std::vector<int> outputClasses;
+    thread_local sparseColumns sparseInputs;
+    if (activations.size() < shape.size() - 1) activations.resize(shape.size() - 1);
+
+    const int batchSize = examplesAsRows ? inputs.rows : inputs.cols;
+    constMatrixView previousActivations = inputs;
+    const matrix* output = nullptr;
 
     for (int layer = 1; layer < shape.size(); layer++) {
-        biasesGradients.push_back(matrix(shape.at(layer), 1));
-        weightsGradients.push_back(matrix(shape.at(layer), shape.at(layer - 1)));
+        const matrix& layerBiases = biases.at(layer - 1);
+        matrix& layerActivations = activations.at(layer - 1);
+        layerActivations.resize(shape.at(layer), batchSize);
+
+        for (int i = 0; i < layerActivations.rows; i++) layerActivations.row(i).fill(layerBiases[i]);
+
+        // A single example goes through gemv, which beats gathering its non-zeros.
+        if (layer == 1 && batchSize > 1 && batchSize <= SPARSE_MAX_BATCH && sparseInputDensity > 0 && sparseInputs.compress(inputs, examplesAsRows, sparseInputDensity)) {
+            sparseGemm(layerActivations.rows, batchSize, weights.at(0).getDataPointer(), weights.at(0).cols, sparseInputs.getOffsets(), sparseInputs.getIndices(), sparseInputs.getValues(),
+                       layerActivations.getDataPointer(), layerActivations.cols);
+        } else {
+            layerActivations.multiply(weights.at(layer - 1), previousActivations, 1.0f, 1.0f, false, layer == 1 && examplesAsRows);
+        }
+        previousActivations = layerActivations;
+        output = &layerActivations;
+
+        if (layer < shape.size() - 1 || (!softmaxOutput() && !classes)) {
+            applyActivation(layerActivations, layerActivations);
+            continue;
+        }
+
+        outputScratch.resize(2 * batchSize);
+        outputClasses.resize(batchSize);
+        int* layerClasses = classes ? classes : outputClasses.data();
+
+        if (softmaxOutput()) {
+            softmaxCrossEntropyForward(layerActivations.getDataPointer(), layerActivations.getDataPointer(), nullptr, nullptr, nullptr, layerClasses,
+                                       layerActivations.rows, batchSize, outputScratch.data());
+        } else {
+            applyActivation(layerActivations, layerActivations);
+            columnArgmax(layerActivations.getDataPointer(), layerActivations.rows, batchSize, layerClasses, outputScratch.data());
+        }
     }
 
-    for (trainingExample& example : miniBatch) backpropagate(example, weightsGradients, biasesGradients);
+    return *output;
+}
+
+void neuralNetwork::forwardPass(networkState& batchState, bool outputDeltas) {
+    NN_TIMED_SCOPE(forwardPass);
+    const int batchSize = batchState.nodesWithActivation.at(0).cols;
+    const int outputLayer = shape.size() - 1;
 
     for (int layer = 1; layer < shape.size(); layer++) {
-        weights.at(layer - 1) = weightsGradients.at(layer - 1) * (-learningRate * (1.0f/miniBatch.size())) + weights.at(layer - 1);
-        biases.at(layer - 1) = biasesGradients.at(layer - 1) * (-learningRate * (1.0f/miniBatch.size())) + biases.at(layer - 1);
+        matrix& layerWeights = weights.at(layer - 1);
+        matrix& layerBiases = biases.at(layer - 1);
+        matrix& previousActivations = batchState.nodesWithActivation.at(layer - 1);
+        matrix& layerNodes = batchState.nodes.at(layer - 1);
+        matrix& layerActivations = batchState.nodesWithActivation.at(layer);
+
+        for (int i = 0; i < layerNodes.rows; i++) layerNodes.row(i).fill(layerBiases[i]);
+
+        if (layer == 1 && batchState.sparseInputs.compressed()) {
+            const sparseColumns& sparseInputs = batchState.sparseInputs;
+            sparseGemm(layerNodes.rows, batchSize, layerWeights.getDataPointer(), layerWeights.cols, sparseInputs.getOffsets(), sparseInputs.getIndices(), sparseInputs.getValues(),
+                       layerNodes.getDataPointer(), layerNodes.cols);
+        } else {
+            layerNodes.multiply(layerWeights, previousActivations, 1.0f, 1.0f);
+        }
+        NN_COUNT_LAYER(layer - 1, 2.0 * layerWeights.rows * layerWeights.cols * batchSize, sizeof(float) * ((double)layerWeights.rows * layerWeights.cols + (double)(layerNodes.rows + previousActivations.rows) * batchSize));
+
+        if (layer < outputLayer || !softmaxOutput()) {
+            applyActivation(layerNodes, layerActivations);
+            continue;
+        }
+
+        batchState.outputLoss = 0;
+        softmaxCrossEntropyForward(layerNodes.getDataPointer(), layerActivations.getDataPointer(), batchState.targets.getDataPointer(),
+                                   outputDeltas ? batchState.deltas.at(layer - 1).getDataPointer() : nullptr, &batchState.outputLoss,
+                                   batchState.predictions.data(), layerNodes.rows, batchSize, batchState.outputScratch.getDataPointer());
     }
 }
 
-void neuralNetwork::backpropagate(trainingExample& example, std::vector<matrix>& weightsGradients, std::vector<matrix>& biasesGradients) {
-    if (example.target.rows != shape.at(shape.size() - 1)) throw std::logic_error("Example target must be same dimensions as last layer in network.");
-    if (example.input.rows != shape.at(0)) throw std::logic_error("Example must be same dimensions as first layer in network.");
+void neuralNetwork::train(const std::vector<trainingExample>& examples, int epochs, int miniBatchSize, bool shuffleData) {
+    train(exampleSource(examples), epochs, miniBatchSize, shuffleData);
+}
+
+void neuralNetwork::train(const dataSource& source, int epochs, int miniBatchSize, bool shuffleData) {
+    if (miniBatchSize > source.size()) throw std::logic_error("Minibatch size can't be bigger than number of examples");
+    checkSource(source);
 
-    matrix networkOutput = feedfoward(example.input);
+    std::random_device seedGenerator;
+    unsigned int seed = seedGenerator();
+    std::mt19937 generator(seed);
 
-    std::vector<matrix> activationGradients = getActivationGradients(networkOutput, example.target);
+    if (group) {
+        group->broadcast(&seed, sizeof(seed));
+        generator.seed(seed);
 
-    for (int layer = 1; layer < shape.size(); layer++) {
-        for (int i = 0; i < shape.at(layer); i++) {
-            for (int j = 0; j < shape.at(layer - 1); j++) {
-                weightsGradients.at(layer - 1)(i, j) += activationGradients.at(layer - 1)(i, 0) * 
-                                                        activation.fPrime(nodes.at(layer - 1)(i, 0)) * 
-                                                        nodesWithActivation.at(layer - 1)(j, 0)  
-                                                        + regularization.fPrime(weights.at(layer - 1)(i, j), shape.at(shape.size() - 1), lambda);
+        for (int layer = 0; layer < weights.size(); layer++) {
+            group->broadcast(weights.at(layer).getDataPointer(), (size_t)weights.at(layer).rows * weights.at(layer).cols * sizeof(float));
+            group->broadcast(biases.at(layer).getDataPointer(), biases.at(layer).rows * sizeof(float));
+        }
+    }
+
+    std::vector<int> order(source.size());
+    for (int i = 0; i < order.size(); i++) order.at(i) = i;
+
+    updateRule.prepare(shape);
+
+    runEpochs(source, epochs, miniBatchSize, shuffleData, generator, order, 0, 0);
+}
+
+void neuralNetwork::resume(const dataSource& source, const char* checkpointFileName) {
+    const trainingSnapshot snapshot = readCheckpoint(checkpointFileName);
+
+    if (snapshot.shape != shape) throw std::logic_error("Checkpoint shape does not match the network shape");
+    if (snapshot.optimizerKind != (uint32_t)updateRule.getSettings().kind) throw std::logic_error("Checkpoint optimizer does not match the network optimizer");
+    if (snapshot.order.size() != source.size()) throw std::logic_error("Checkpoint was taken on a different number of examples");
+    checkSource(source);
+
+    const float* parameterValues = snapshot.parameters.data();
+    for (matrix& layerWeights : weights) {
+        std::memcpy(layerWeights.getDataPointer(), parameterValues, (size_t)layerWeights.rows * layerWeights.cols * sizeof(float));
+        parameterValues += (size_t)layerWeights.rows * layerWeights.cols;
+    }
+    for (matrix& layerBiases : biases) {
+        std::memcpy(layerBiases.getDataPointer(), parameterValues, layerBiases.rows * sizeof(float));
+        parameterValues += layerBiases.rows;
+    }
+
+    updateRule.prepare(shape);
+    updateRule.setState(snapshot.optimizerState, snapshot.optimizerSteps);
+
+    std::mt19937 generator;
+    std::istringstream(snapshot.generatorState) >> generator;
+    std::vector<int> order = snapshot.order;
+
+    runEpochs(source, snapshot.epochs, snapshot.miniBatchSize, snapshot.shuffleData, generator, order, snapshot.epoch, snapshot.batch);
+}
+
+void neuralNetwork::runEpochs(const dataSource& source, int epochs, int miniBatchSize, bool shuffleData, std::mt19937& generator, std::vector<int>& order, int firstEpoch, int firstBatch) {
+    const bool hogwildEpochs = hogwild && pool->size() > 1;
+    const int ranks = group ? group->getSize() : 1;
+    const int rank = group ? group->getRank() : 0;
+    if (hogwildEpochs && ranks > 1) throw std::logic_error("Hogwild updates can't be used with a process group");
+
+    // Rank r takes the r-th miniBatchSize examples of every ranks * miniBatchSize, so that a step
+    // over all ranks covers the same examples as one mini-batch of that size trained alone.
+    const int globalBatchSize = miniBatchSize * ranks;
+    if (globalBatchSize > order.size()) throw std::logic_error("Minibatch size times the number of ranks can't be bigger than number of examples");
+    std::vector<int> shardOrder(order.size() / globalBatchSize * miniBatchSize);
+
+    const int slices = hogwildEpochs ? 1 : std::min(pool->size(), miniBatchSize);
+    batchPipeline pipeline(source, miniBatchSize, slices, (miniBatchSize + slices - 1) / slices <= SPARSE_MAX_BATCH ? sparseInputDensity : 0.0f);
+
+    std::unique_ptr<checkpointWriter> writer;
+    if (!checkpointing.fileName.empty() && rank == 0) writer.reset(new checkpointWriter(checkpointing.fileName));
+
+    std::unique_ptr<gradientBuckets> buckets;
+    if (ranks > 1) buckets.reset(new gradientBuckets(*group, shape, gradientBucketFloats));
+
+    std::unique_ptr<backgroundValidator> validator;
+    if (validation.data && rank == 0) validator.reset(new backgroundValidator(validation, *this));
+    validationHistory.clear();
+    trainingHistory.clear();
+    trainingHistory.reserve(epochs);
+
+    // Rank 0's early stopping decision is passed on at every validation point, so all ranks stop at the same step.
+    auto validationPoint = [&](float epochProgress) {
+        char stop = 0;
+        if (validator) {
+            validator->offer(*this, epochProgress);
+            stop = validator->shouldStop();
+        }
+
+        if (ranks > 1) group->broadcast(&stop, sizeof(stop));
+        return stop != 0;
+    };
+
+    float epochProgress = firstEpoch;
+    bool stopEarly = false;
+
+    for (int epoch = firstEpoch; epoch < epochs && !stopEarly; epoch++) { 
+        const int epochFirstBatch = epoch == firstEpoch ? firstBatch : 0;
+
+        // A checkpoint taken mid-epoch already holds this epoch's order.
+        if (epochFirstBatch == 0) {
+            NN_REPORT_METRICS();
+
+            NN_TIMED_SCOPE(shuffle);
+            if (shuffleData) std::shuffle(order.begin(), order.end(), generator);
+        }
+
+        for (int batch = 0; batch < shardOrder.size() / miniBatchSize; batch++) {
+            const auto globalBatch = order.begin() + (long)batch * globalBatchSize + rank * miniBatchSize;
+            std::copy(globalBatch, globalBatch + miniBatchSize, shardOrder.begin() + (long)batch * miniBatchSize);
+        }
+        pipeline.startEpoch(shardOrder, epochFirstBatch);
+        for (networkState& workerState : workerStates) workerState.statistics = lossStatistics();
+
+        if (hogwildEpochs) {
+            hogwildEpoch(pipeline, epoch, epochs);
+        } else {
+            while (preparedBatch* batch = pipeline.acquire()) {
+                const int nextBatch = batch->index + 1;
+                const optimizerStep step = updateRule.beginStep(learningRate, epoch + (float)batch->index / pipeline.batchesPerEpoch(), epochs, batch->count * ranks);
+                gradientDescent(pipeline, *batch, step, buckets.get());
+                epochProgress = epoch + (float)nextBatch / pipeline.batchesPerEpoch();
+
+                if (writer && checkpointing.intervalBatches > 0 && nextBatch % checkpointing.intervalBatches == 0 && nextBatch < pipeline.batchesPerEpoch())
+                    snapshotTraining(*writer, generator, order, epochs, miniBatchSize, shuffleData, epoch, nextBatch);
+                NN_REPORT_METRICS();
+
+                if (validation.data && validation.intervalBatches > 0 && nextBatch % validation.intervalBatches == 0 && nextBatch < pipeline.batchesPerEpoch()) {
+                    stopEarly = validationPoint(epochProgress);
+                    if (stopEarly) break;
+                }
             }
+        }
+
+        if (stopEarly) break;
+        epochProgress = epoch + 1;
 
-            biasesGradients.at(layer - 1)(i, 0) += activationGradients.at(layer - 1)(i, 0) * activation.fPrime(nodes.at(layer - 1)(i, 0));
+        trainingHistory.push_back(finishEpoch());
+        if (verbose && rank == 0)
+            std::cout << "Epoch " << epoch + 1 << " of " << epochs << ": training cost " << trainingHistory.back().cost << ", accuracy " << trainingHistory.back().accuracy << "%" << std::endl;
+
+        if (writer) snapshotTraining(*writer, generator, order, epochs, miniBatchSize, shuffleData, epoch + 1, 0);
+        if (validation.data) stopEarly = validationPoint(epochProgress);
+    }
+
+    if (verbose && stopEarly && rank == 0) std::cout << "Stopping early after " << epochProgress << " epochs" << std::endl;
+
+    if (writer) writer->flush();
+
+    if (validator) {
+        validator->finish(*this, epochProgress);
+        validationHistory = validator->getHistory();
+    }
+
+    // Only rank 0 may have gone back to its best parameters.
+    if (validation.data && ranks > 1) {
+        for (int layer = 0; layer < weights.size(); layer++) {
+            group->broadcast(weights.at(layer).getDataPointer(), (size_t)weights.at(layer).rows * weights.at(layer).cols * sizeof(float));
+            group->broadcast(biases.at(layer).getDataPointer(), biases.at(layer).rows * sizeof(float));
         }
     }
+
+    NN_REPORT_METRICS();
 }
 
-std::vector<matrix> neuralNetwork::getActivationGradients(matrix& networkOutput, matrix& target) {
-    std::vector<matrix> activationGradients;
+void neuralNetwork::snapshotTraining(checkpointWriter& writer, const std::mt19937& generator, const std::vector<int>& order, int epochs, int miniBatchSize, bool shuffleData, int epoch, int batch) {
+    NN_TIMED_SCOPE(checkpointSnapshot);
+
+    trainingSnapshot* snapshot = writer.acquire();
+    if (!snapshot) return;
+
+    size_t parameterCount = 0;
+    for (int layer = 0; layer < weights.size(); layer++) parameterCount += (size_t)weights.at(layer).rows * weights.at(layer).cols + biases.at(layer).rows;
+
+    snapshot->parameters.resize(parameterCount);
+    float* parameterValues = snapshot->parameters.data();
+    for (const matrix& layerWeights : weights) {
+        std::memcpy(parameterValues, layerWeights.getDataPointer(), (size_t)layerWeights.rows * layerWeights.cols * sizeof(float));
+        parameterValues += (size_t)layerWeights.rows * layerWeights.cols;
+    }
+    for (const matrix& layerBiases : biases) {
+        std::memcpy(parameterValues, layerBiases.getDataPointer(), layerBiases.rows * sizeof(float));
+        parameterValues += layerBiases.rows;
+    }
+
+    std::ostringstream generatorState;
+    generatorState << generator;
+
+    snapshot->shape = shape;
+    snapshot->optimizerKind = (uint32_t)updateRule.getSettings().kind;
+    updateRule.getState(snapshot->optimizerState);
+    snapshot->optimizerSteps = updateRule.getStepCount();
+    snapshot->generatorState = generatorState.str();
+    snapshot->order = order;
+    snapshot->epochs = epochs;
+    snapshot->miniBatchSize = miniBatchSize;
+    snapshot->shuffleData = shuffleData;
+    snapshot->epoch = epoch;
+    snapshot->batch = batch;
+
+    writer.submit(snapshot);
+}
+
+void neuralNetwork::loadSlice(preparedBatch& batch, int slice, networkState& batchState) {
+    prepareState(batchState, batch.inputs.at(slice).cols);
+
+    std::swap(batchState.nodesWithActivation.at(0), batch.inputs.at(slice));
+    std::swap(batchState.targets, batch.targets.at(slice));
+    std::swap(batchState.sparseInputs, batch.sparseInputs.at(slice));
+}
+
+void neuralNetwork::gradientDescent(batchPipeline& pipeline, preparedBatch& batch, const optimizerStep& step, gradientBuckets* buckets) {
+    NN_TIMED_SCOPE(gradientDescent);
+    const int activeWorkers = batch.inputs.size();
+    NN_COUNT_EXAMPLES(batch.count);
+
+    // Layers are updated output first, as their gradients arrive from the other ranks.
+    if (activeWorkers == 1) {
+        networkState& gradients = workerStates.at(0);
+        loadSlice(batch, 0, gradients);
+        pipeline.release(&batch);
+
+        if (buckets) buckets->begin(gradients.weightsGradients, gradients.biasesGradients);
+        backpropagate(gradients, buckets);
+
+        for (int layer = shape.size() - 1; layer > 0; layer--) {
+            if (buckets) buckets->waitForLayer(layer - 1);
+            applyGradients(gradients, step, 0, shape.at(layer), layer);
+        }
+        return;
+    }
+
+    pool->run([&](int worker) {
+        if (worker < activeWorkers) loadSlice(batch, worker, workerStates.at(worker));
+    });
+    pipeline.release(&batch);
+
+    pool->run([&](int worker) {
+        if (worker < activeWorkers) backpropagate(workerStates.at(worker));
+    });
+
+    if (buckets) {
+        pool->run([&](int worker) {
+            reduceGradients(worker, activeWorkers);
+        });
+
+        networkState& gradients = workerStates.at(0);
+        buckets->begin(gradients.weightsGradients, gradients.biasesGradients);
+        for (int layer = shape.size() - 1; layer > 0; layer--) buckets->layerReady(layer - 1);
+
+        for (int layer = shape.size() - 1; layer > 0; layer--) {
+            buckets->waitForLayer(layer - 1);
+
+            pool->run([&](int worker) {
+                const int rowBegin = worker * shape.at(layer) / pool->size();
+                const int rowEnd = (worker + 1) * shape.at(layer) / pool->size();
 
-    for (int layer = 1; layer < shape.size(); layer++) activationGradients.push_back(matrix(shape.at(layer), 1));
+                applyGradients(gradients, step, rowBegin, rowEnd, layer);
+            });
+        }
+        return;
+    }
+
+    pool->run([&](int worker) {
+        reduceGradients(worker, activeWorkers);
 
-    for (int node = 0; node < shape.at(shape.size() - 1); node++) 
-        activationGradients.at(shape.size() - 2)(node, 0) = error.fPrime(networkOutput(node, 0), target(node, 0), shape.at(shape.size() - 1)); 
+        for (int layer = 1; layer < shape.size(); layer++) {
+            const int rowBegin = worker * shape.at(layer) / pool->size();
+            const int rowEnd = (worker + 1) * shape.at(layer) / pool->size();
 
-    for (int layer = shape.size() - 2; layer > 0; layer--) {
-        for (int node = 0; node < shape.at(layer); node++) {
-            for (int k = 0; k < shape.at(layer + 1); k++) {
-                activationGradients.at(layer - 1)(node, 0) += activationGradients.at(layer)(k, 0)
-                                                            * activation.fPrime(nodes.at(layer)(k, 0)) 
-                                                            * weights.at(layer)(k, node); 
+            applyGradients(workerStates.at(0), step, rowBegin, rowEnd, layer);
+        }
+    });
+}
+
+void neuralNetwork::reduceGradients(int worker, int activeWorkers) {
+    NN_TIMED_SCOPE(gradientReduction);
+    for (int layer = 1; layer < shape.size(); layer++) {
+        const int rowBegin = worker * shape.at(layer) / pool->size();
+        const int rowEnd = (worker + 1) * shape.at(layer) / pool->size();
+        const int rowSize = shape.at(layer - 1);
+
+        for (int stride = 1; stride < activeWorkers; stride *= 2) {
+            for (int target = 0; target + stride < activeWorkers; target += 2 * stride) {
+                float* weightsTarget = workerStates.at(target).weightsGradients.at(layer - 1).getDataPointer();
+                float* weightsSource = workerStates.at(target + stride).weightsGradients.at(layer - 1).getDataPointer();
+                float* biasesTarget = workerStates.at(target).biasesGradients.at(layer - 1).getDataPointer();
+                float* biasesSource = workerStates.at(target + stride).biasesGradients.at(layer - 1).getDataPointer();
+
+                axpy((rowEnd - rowBegin) * rowSize, 1.0f, weightsSource + rowBegin * rowSize, weightsTarget + rowBegin * rowSize);
+                axpy(rowEnd - rowBegin, 1.0f, biasesSource + rowBegin, biasesTarget + rowBegin);
             }
         }
     }
+}
+
+void neuralNetwork::applyGradients(networkState& gradients, const optimizerStep& step, int rowBegin, int rowEnd, int layer) {
+    NN_TIMED_SCOPE(weightUpdate);
+
+    matrix& layerWeights = weights.at(layer - 1);
+    matrix& layerBiases = biases.at(layer - 1);
+    matrix& weightsGradients = gradients.weightsGradients.at(layer - 1);
+    matrix& biasesGradients = gradients.biasesGradients.at(layer - 1);
+
+    const int rowSize = layerWeights.cols;
+    const int outputs = shape.at(shape.size() - 1);
+
+    float* layerWeightsBegin = layerWeights.getDataPointer() + rowBegin * rowSize;
+    float* weightsGradientsBegin = weightsGradients.getDataPointer() + rowBegin * rowSize;
+    const int weightCount = (rowEnd - rowBegin) * rowSize;
+
+    // Weight decay is a per-batch term. L2 goes through the fused update; other regularizations
+    // add their derivative, scaled back up by the batch size, to the summed gradient first.
+    float decay = 0;
+    if (regularization.kind == regularizationKind::L2) {
+        decay = lambda / outputs;
+    } else {
+        for (int i = 0; i < weightCount; i++)
+            weightsGradientsBegin[i] += regularization.fPrime(layerWeightsBegin[i], outputs, lambda) / step.gradientScale;
+    }
+
+    updateRule.update(step, layer - 1, rowBegin * rowSize, weightCount, layerWeightsBegin, weightsGradientsBegin, decay);
+    updateRule.update(step, layer - 1, layerWeights.rows * rowSize + rowBegin, rowEnd - rowBegin, layerBiases.getDataPointer() + rowBegin, biasesGradients.getDataPointer() + rowBegin, 0.0f);
+}
+
+void neuralNetwork::hogwildEpoch(batchPipeline& pipeline, int epoch, int epochs) {
+    pool->run([&](int worker) {
+        networkState& workerState = workerStates.at(worker);
+
+        while (preparedBatch* batch = pipeline.acquire()) {
+            const optimizerStep step = updateRule.beginStep(learningRate, epoch + (float)batch->index / pipeline.batchesPerEpoch(), epochs, batch->count);
+            NN_COUNT_EXAMPLES(batch->count);
+
+            loadSlice(*batch, 0, workerState);
+            pipeline.release(batch);
+
+            backpropagate(workerState);
+
+            for (int layer = 1; layer < shape.size(); layer++) applyGradients(workerState, step, 0, shape.at(layer), layer);
+            if (worker == 0) NN_REPORT_METRICS();
+        }
+    });
+}
+
+void neuralNetwork::backpropagate(networkState& batchState, gradientBuckets* buckets) {
+    NN_TIMED_SCOPE(backpropagate);
+    const int batchSize = batchState.nodesWithActivation.at(0).cols;
+
+    forwardPass(batchState, true);
+    recordStatistics(batchState);
+
+    getActivationGradients(batchState);
+
+    for (int layer = shape.size() - 1; layer > 0; layer--) {
+        matrix& layerDeltas = batchState.deltas.at(layer - 1);
+        matrix& previousActivations = batchState.nodesWithActivation.at(layer - 1);
+        matrix& weightsGradients = batchState.weightsGradients.at(layer - 1);
+        matrix& biasesGradients = batchState.biasesGradients.at(layer - 1);
+
+        for (int i = 0; i < weightsGradients.rows; i++) {
+            float biasGradient = 0;
+            for (int example = 0; example < batchSize; example++) biasGradient += layerDeltas(i, example);
+            biasesGradients(i, 0) = biasGradient;
+        }
+
+        // Decay is added to every weight by the update, so the sparse path only has to fill in the columns of non-zero inputs.
+        if (layer == 1 && batchState.sparseInputs.compressed()) {
+            const sparseColumns& sparseInputs = batchState.sparseInputs;
+            weightsGradients.fill(0);
+            sparseGemmTransposed(weightsGradients.rows, batchSize, layerDeltas.getDataPointer(), layerDeltas.cols, sparseInputs.getOffsets(), sparseInputs.getIndices(), sparseInputs.getValues(),
+                                 weightsGradients.getDataPointer(), weightsGradients.cols);
+        } else {
+            weightsGradients.multiply(layerDeltas, previousActivations, 1.0f, 0.0f, false, true);
+        }
+        NN_COUNT_LAYER(layer - 1, 2.0 * weightsGradients.rows * weightsGradients.cols * batchSize, sizeof(float) * ((double)weightsGradients.rows * weightsGradients.cols + (double)(layerDeltas.rows + previousActivations.rows) * batchSize));
+
+        if (buckets) buckets->layerReady(layer - 1);
+    }
+}
+
+void neuralNetwork::getActivationGradients(networkState& batchState) {
+    NN_TIMED_SCOPE(activationGradients);
+    const int outputLayer = shape.size() - 1;
+
+    applyOutputDeltas(batchState);
+
+    for (int layer = outputLayer - 1; layer > 0; layer--) {
+        matrix& nextWeights = weights.at(layer);
+        matrix& nextDeltas = batchState.deltas.at(layer);
+        matrix& layerDeltas = batchState.deltas.at(layer - 1);
+
+        layerDeltas.multiply(nextWeights, nextDeltas, 1.0f, 0.0f, true, false);
+        NN_COUNT_LAYER(layer, 2.0 * nextWeights.rows * nextWeights.cols * nextDeltas.cols, sizeof(float) * ((double)nextWeights.rows * nextWeights.cols + (double)(nextDeltas.rows + layerDeltas.rows) * nextDeltas.cols));
+
+        applyActivationPrime(batchState.nodes.at(layer - 1), batchState.nodesWithActivation.at(layer), layerDeltas);
+    }
+}
+
+void neuralNetwork::applyActivation(const matrix& layerNodes, matrix& layerActivations) const {
+    withActivationPolicy(activation, [&](auto policy) {
+        activationForward(policy, layerNodes.getDataPointer(), layerActivations.getDataPointer(), layerNodes.rows * layerNodes.cols);
+    });
+}
+
+void neuralNetwork::applyActivationPrime(const matrix& layerNodes, const matrix& layerActivations, matrix& layerDeltas) const {
+    withActivationPolicy(activation, [&](auto policy) {
+        activationBackward(policy, layerNodes.getDataPointer(), layerActivations.getDataPointer(), layerDeltas.getDataPointer(), layerNodes.rows * layerNodes.cols);
+    });
+}
+
+bool neuralNetwork::softmaxOutput() const {
+    return error.kind == errorKind::softmaxCrossEntropy;
+}
+
+void neuralNetwork::applyOutputDeltas(networkState& batchState) {
+    // The softmax forward pass already wrote them.
+    if (softmaxOutput()) return;
+
+    const int outputLayer = shape.size() - 1;
+
+    const matrix& outputNodes = batchState.nodes.at(outputLayer - 1);
+    const matrix& output = batchState.nodesWithActivation.at(outputLayer);
+    matrix& layerDeltas = batchState.deltas.at(outputLayer - 1);
+
+    withActivationPolicy(activation, [&](auto activationPolicy) {
+        withErrorPolicy(error, [&](auto errorPolicy) {
+            outputDeltas(activationPolicy, errorPolicy, outputNodes.getDataPointer(), output.getDataPointer(), batchState.targets.getDataPointer(),
+                         layerDeltas.getDataPointer(), output.rows * output.cols, output.rows);
+        });
+    });
+}
+
+float neuralNetwork::getError(const matrix& output, const matrix& targets) {
+    float sum = 0;
+
+    withErrorPolicy(error, [&](auto errorPolicy) {
+        sum = lossSum(errorPolicy, output.getDataPointer(), targets.getDataPointer(), output.rows * output.cols, output.rows);
+    });
 
-    return activationGradients;
+    return sum;
 }
 
 void neuralNetwork::save(const char* fileName) {
-    std::ofstream outFile;
+    modelDescription description;
+    description.shape = shape;
+    description.activation = activation.kind;
+    description.error = error.kind;
+    description.regularization = regularization.kind;
 
-    outFile.open(fileName, std::ofstream::binary);
+    modelFile::write(fileName, description, weights, biases);
+}
 
-    for (matrix& layerWeightMatrix : weights) 
-        outFile.write((char*)layerWeightMatrix.getDataPointer(), 
-                             layerWeightMatrix.rows * layerWeightMatrix.cols * sizeof(float));
+void neuralNetwork::checkModel(const modelFile& model) {
+    const modelDescription& description = model.getDescription();
 
-    for (matrix& layerBiasesMatrix : biases)
-        outFile.write((char*)layerBiasesMatrix.getDataPointer(),
-                             layerBiasesMatrix.rows * layerBiasesMatrix.cols * sizeof(float));
+    if (description.shape != shape) throw std::logic_error("Model file shape does not match the network shape");
+    if (model.isLegacy()) return;
 
-    outFile.close();
+    if (description.activation != activation.kind) throw std::logic_error("Model file activation does not match the network activation");
+    if (description.error != error.kind) throw std::logic_error("Model file error function does not match the network error function");
 }
 
 void neuralNetwork::load(const char *fileName) {
-    std::ifstream inFile;
+    modelFile model(fileName, shape);
+    copyParameters(model);
+}
+
+void neuralNetwork::copyParameters(modelFile& model) {
+    checkModel(model);
+
+    for (int layer = 0; layer < weights.size(); layer++) {
+        std::memcpy(weights.at(layer).getDataPointer(), model.getWeights(layer), weights.at(layer).rows * weights.at(layer).cols * sizeof(float));
+        std::memcpy(biases.at(layer).getDataPointer(), model.getBiases(layer), biases.at(layer).rows * sizeof(float));
+    }
+}
+
+const std::vector<int>& neuralNetwork::getShape() const {
+    return shape;
+}
 
-    inFile.open(fileName, std::ifstream::binary);
+neuralNetwork neuralNetwork::fromFile(const char* fileName, bool mapped, bool verifyChecksum) {
+    modelFile model(fileName, {}, verifyChecksum);
+    const modelDescription& description = model.getDescription();
+
+    activationFunction fileActivation = sigmoid;
+    switch (description.activation) {
+        case activationKind::fastSigmoid: fileActivation = fastSigmoid; break;
+        case activationKind::approximateSigmoid: fileActivation = approximateSigmoid; break;
+        case activationKind::tanh: fileActivation = hyperbolicTangent; break;
+        case activationKind::relu: fileActivation = relu; break;
+        case activationKind::sigmoid: break;
+        default: throw std::logic_error("Model file uses a custom activation; construct the network and call load instead");
+    }
 
-    for (matrix& layerWeightMatrix : weights) {
-        const unsigned int dataSize = layerWeightMatrix.rows * layerWeightMatrix.cols * sizeof(float);
+    errorFunction fileError = mse;
+    switch (description.error) {
+        case errorKind::crossEntropy: fileError = crossEntropy; break;
+        case errorKind::softmaxCrossEntropy: fileError = softmaxCrossEntropy; break;
+        case errorKind::mse: break;
+        default: throw std::logic_error("Model file uses a custom error function; construct the network and call load instead");
+    }
 
-        inFile.read((char*) layerWeightMatrix.getDataPointer(), dataSize);
+    regularizationFunction fileRegularization = L2;
+    switch (description.regularization) {
+        case regularizationKind::L2: break;
+        default: throw std::logic_error("Model file uses a custom regularization; construct the network and call load instead");
     }
 
-    for (matrix& layerBiasesMatrix : biases) {
-        const unsigned int dataSize = layerBiasesMatrix.rows * layerBiasesMatrix.cols * sizeof(float);
+    neuralNetwork network(description.shape, fileActivation, fileError, fileRegularization, !mapped);
+
+    if (mapped) network.loadMapped(std::move(model));
+    else network.copyParameters(model);
+
+    return network;
+}
+
+void neuralNetwork::loadMapped(const char* fileName, bool verifyChecksum) {
+    loadMapped(modelFile(fileName, shape, verifyChecksum));
+}
+
+void neuralNetwork::loadMapped(modelFile&& model) {
+    checkModel(model);
 
-        inFile.read((char*) layerBiasesMatrix.getDataPointer(), dataSize);
+    std::vector<matrix> mappedWeights;
+    std::vector<matrix> mappedBiases;
+
+    for (int layer = 1; layer < shape.size(); layer++) {
+        mappedWeights.push_back(matrix::wrap(model.getWeights(layer - 1), shape.at(layer), shape.at(layer - 1)));
+        mappedBiases.push_back(matrix::wrap(model.getBiases(layer - 1), shape.at(layer), 1));
     }
 
-    inFile.close();
+    weights = std::move(mappedWeights);
+    biases = std::move(mappedBiases);
+    mappedParameters = model.getMapping();
 }
 
-int neuralNetwork::oneHotIndex(matrix& out) {
-    float largestVal = -100000;
+int neuralNetwork::oneHotIndex(constMatrixView out, int col) {
     int indexOfLargestVal = 0;
 
-    for (int i = 0; i < out.rows; i++) {
-        if (out(i, 0) > largestVal) {
-            largestVal = out(i, 0);
+    for (int i = 1; i < out.rows; i++)
+        if (out(i, col) > out(indexOfLargestVal, col))
             indexOfLargestVal = i;
-        }
-    }
 
     return indexOfLargestVal;
 }
 
-float neuralNetwork::getCostOverExamples(std::vector<trainingExample>& examples) {
-    float cost = 0;
-    
-    for (trainingExample& example : examples) {
-        matrix out = feedfoward(example.input);
+void neuralNetwork::recordStatistics(networkState& batchState) {
+    const matrix& out = batchState.nodesWithActivation.at(shape.size() - 1);
+    float* scratch = batchState.outputScratch.getDataPointer();
+    lossStatistics& statistics = batchState.statistics;
 
-        for (int i = 0; i < out.rows; i++) {
-            cost += error.f(out(i, 0), example.target(i, 0), out.rows);
-        }
+    // A softmax output layer already found its argmax and loss during the forward pass.
+    if (!softmaxOutput()) columnArgmax(out.getDataPointer(), out.rows, out.cols, batchState.predictions.data(), scratch);
+    columnArgmax(batchState.targets.getDataPointer(), out.rows, out.cols, batchState.labels.data(), scratch);
+
+    statistics.loss += softmaxOutput() ? batchState.outputLoss : getError(out, batchState.targets);
+    for (int example = 0; example < out.cols; example++)
+        if (batchState.predictions.at(example) == batchState.labels.at(example))
+            statistics.correct++;
+    statistics.examples += out.cols;
+}
+
+evaluationResult neuralNetwork::summarize(const lossStatistics& statistics) {
+    evaluationResult result;
+    result.cost = statistics.loss + statistics.examples * regularization.f(weights, shape.back(), lambda);
+    result.accuracy = statistics.examples > 0 ? ((float)statistics.correct / statistics.examples) * 100 : 0.0f;
 
-        cost += regularization.f(weights, out.rows, lambda);
+    return result;
+}
+
+lossStatistics neuralNetwork::workerStatistics() const {
+    lossStatistics statistics;
+    for (const networkState& workerState : workerStates) {
+        statistics.loss += workerState.statistics.loss;
+        statistics.correct += workerState.statistics.correct;
+        statistics.examples += workerState.statistics.examples;
     }
 
-    return cost;
+    return statistics;
 }
 
-float neuralNetwork::getAccuracyOverExamples(std::vector<trainingExample>& examples) {
-    int assertCount = 0;
-    for (trainingExample& example : examples) {
-        matrix out = feedfoward(example.input);
-        if (oneHotIndex(out) == oneHotIndex(example.target)) 
-            assertCount++;
+evaluationResult neuralNetwork::finishEpoch() {
+    lossStatistics statistics = workerStatistics();
+
+    if (group && group->getSize() > 1) {
+        double totals[3] = {statistics.loss, (double)statistics.correct, (double)statistics.examples};
+        group->allReduce(totals, 3);
+
+        statistics.loss = totals[0];
+        statistics.correct = (long)totals[1];
+        statistics.examples = (long)totals[2];
     }
-    return ((float)assertCount / examples.size()) * 100;
+
+    return summarize(statistics);
+}
+
+evaluationResult neuralNetwork::evaluate(const std::vector<trainingExample>& examples) {
+    return evaluate(exampleSource(examples));
+}
+
+evaluationResult neuralNetwork::evaluate(const dataSource& source) {
+    NN_TIMED_SCOPE(evaluation);
+    checkSource(source);
+
+    std::vector<int> sequence(source.size());
+    for (int i = 0; i < sequence.size(); i++) sequence.at(i) = i;
+
+    const int chunks = (source.size() + EVALUATION_BATCH_SIZE - 1) / EVALUATION_BATCH_SIZE;
+
+    pool->run([&](int worker) {
+        networkState& workerState = workerStates.at(worker);
+        workerState.statistics = lossStatistics();
+
+        for (int chunk = worker; chunk < chunks; chunk += pool->size()) {
+            const int begin = chunk * EVALUATION_BATCH_SIZE;
+            const int count = std::min<int>(EVALUATION_BATCH_SIZE, source.size() - begin);
+
+            packExamples(source, sequence.data() + begin, count, workerState);
+            forwardPass(workerState);
+            recordStatistics(workerState);
+        }
+    });
+
+    return summarize(workerStatistics());
+}
+
+float neuralNetwork::getCostOverExamples(const std::vector<trainingExample>& examples) {
+    return evaluate(examples).cost;
+}
+
+float neuralNetwork::getCostOverExamples(const dataSource& source) {
+    return evaluate(source).cost;
+}
+
+float neuralNetwork::getAccuracyOverExamples(const std::vector<trainingExample>& examples) {
+    return evaluate(examples).accuracy;
+}
+
+float neuralNetwork::getAccuracyOverExamples(const dataSource& source) {
+    return evaluate(source).accuracy;
 }
 
 void neuralNetwork::print() {
@@ -1,74 +1,222 @@
 #pragma once
 #include "matrix/matrix.h"
+#include "matrix/workspace.h"
+#include "matrix/sparseColumns.h"
+#include "threadPool.h"
+#include "activations.h"
+#include "dataset/dataSource.h"
+#include "dataset/batchPipeline.h"
+#include "mappedFile.h"
+#include "optimizer.h"
+#include "initializer.h"
+#include "checkpoint.h"
+#include "distributed/gradientBuckets.h"
+#include "validation.h"
 #include <vector>
 #include <functional>
+#include <memory>
+#include <random>
+
+class modelFile;
 
 struct activationFunction {
     std::function<float (const float)> f;
     std::function<float (const float)> fPrime;
+    activationKind kind = activationKind::custom;
 
     activationFunction() {};
-    activationFunction (std::function<float (const float)> activationF, std::function<float (const float)> activationFPrime) {
+    activationFunction (std::function<float (const float)> activationF, std::function<float (const float)> activationFPrime, activationKind functionKind = activationKind::custom) {
         f = activationF;
         fPrime = activationFPrime;
+        kind = functionKind;
     }
 };
 
 struct errorFunction {
     std::function<float (const float, const float, const int)> f;
     std::function<float (const float, const float, const int)> fPrime;
+    errorKind kind = errorKind::custom;
 
     errorFunction() {};
-    errorFunction (std::function<float (const float, const float, const int)> errorF, std::function<float (const float, const float, const int)> errorFPrime) {
+    errorFunction (std::function<float (const float, const float, const int)> errorF, std::function<float (const float, const float, const int)> errorFPrime, errorKind functionKind = errorKind::custom) {
         f = errorF;
         fPrime = errorFPrime;
+        kind = functionKind;
     }
 };
 
 struct regularizationFunction {
     std::function<float (std::vector<matrix>&, const int, const float)> f;
     std::function<float (const float, const int, const float)> fPrime;
+    regularizationKind kind = regularizationKind::custom;
 
     regularizationFunction() {};
-    regularizationFunction (std::function<float (std::vector<matrix>&, const int, const float)> regularizationF, std::function<float (const float, const int, const float)> regularizationFPrime) {
+    regularizationFunction (std::function<float (std::vector<matrix>&, const int, const float)> regularizationF, std::function<float (const float, const int, const float)> regularizationFPrime, regularizationKind functionKind = regularizationKind::custom) {
         f = regularizationF;
         fPrime = regularizationFPrime;
+        kind = functionKind;
     }
 };
 
+template <typename Policy>
+activationFunction policyActivation(activationKind kind) {
+    return activationFunction([](const float z) { return Policy().f(z); },
+                              [](const float z) { Policy policy; return policy.fPrime(z, policy.f(z)); }, kind);
+}
+
+template <typename Policy>
+errorFunction policyError(errorKind kind) {
+    return errorFunction([](const float a, const float t, const int n) { return Policy().f(a, t, n); },
+                         [](const float a, const float t, const int n) { return Policy().fPrime(a, t, n); }, kind);
+}
+
 struct trainingExample {
     matrix input;
     matrix target;
 
     trainingExample() {};
-    trainingExample(matrix trainingInput, matrix trainingTarget) {
-        input = trainingInput;
-        target = trainingTarget;
-    }
+    // Takes ownership of the matrices, so examples over wrapped memory stay views of it.
+    trainingExample(matrix trainingInput, matrix trainingTarget) : input(std::move(trainingInput)), target(std::move(trainingTarget)) {};
+};
+
+// Adapts a vector of trainingExamples to the dataSource interface without copying it.
+class exampleSource : public dataSource {
+private:
+    const std::vector<trainingExample>& examples;
+
+public:
+    exampleSource(const std::vector<trainingExample>& sourceExamples) : examples(sourceExamples) {};
+
+    int size() const override;
+    int inputSize() const override;
+    int targetSize() const override;
+
+    void assembleBatch(const int* indices, int count, matrix& inputs, matrix& targets) const override;
+};
+
+// Loss summed over examples, before regularization, and how many of them were classified correctly.
+struct lossStatistics {
+    double loss = 0;
+    long correct = 0;
+    long examples = 0;
+};
+
+struct evaluationResult {
+    float cost;
+    float accuracy;
+};
+
+struct networkState {
+    std::vector<matrix> nodes;
+    std::vector<matrix> nodesWithActivation;
+    std::vector<matrix> deltas;
+
+    std::vector<matrix> weightsGradients;
+    std::vector<matrix> biasesGradients;
+
+    matrix targets;
+    // The inputs again, compressed when they're sparse enough for the first layer to skip their zeros
+    sparseColumns sparseInputs;
+
+    // Softmax output layers only: per example argmax and the batch's summed loss, both produced by
+    // the forward pass, and the 2 x batch size scratch it needs.
+    std::vector<int> predictions;
+    float outputLoss = 0;
+    matrix outputScratch;
+
+    // The target classes of a batch, and the statistics of the batches forwarded since the last reset.
+    std::vector<int> labels;
+    lossStatistics statistics;
+
+    // Backs every matrix above except the inputs (nodesWithActivation[0]) and targets, which are
+    // swapped with the batch pipeline's buffers instead of copied.
+    workspace arena;
+    int batchSize = 0;
+
+    networkState() {};
+    // Scratch state isn't copied; a copy is carved out again the first time it's used.
+    networkState(const networkState&) {};
+    networkState& operator=(const networkState&) { return *this; }
+    networkState(networkState&&) = default;
+    networkState& operator=(networkState&&) = default;
 };
 
 class neuralNetwork {
+    friend class quantizedNetwork;
+    friend class backgroundValidator;
+
     private:
-        std::vector<matrix> nodes;
-        std::vector<matrix> nodesWithActivation;
+        networkState state;
+        std::vector<networkState> workerStates;
+
+        std::shared_ptr<threadPool> pool;
+        bool hogwild;
 
+        // Views into the parameters slab, or into the model file after loadMapped.
         std::vector<matrix> weights;
         std::vector<matrix> biases;
+        workspace parameters;
 
         std::vector<int> shape;
 
+        // Keeps the model file mapped while weights and biases are views into it.
+        std::shared_ptr<mappedFile> mappedParameters;
+
         activationFunction activation;
         errorFunction error;
         regularizationFunction regularization;
         float learningRate;
         float lambda;
+        optimizer updateRule;
+        float sparseInputDensity = 0.25f;
+        checkpointSettings checkpointing;
+        std::shared_ptr<processGroup> group;
+        size_t gradientBucketFloats = 1 << 20;
+        validationSettings validation;
+        std::vector<validationResult> validationHistory;
+        std::vector<evaluationResult> trainingHistory;
+        bool verbose = true;
+
+        // For fromFile: the parameters are left for a load to fill in, so they're neither drawn nor,
+        // when the file is mapped, allocated.
+        neuralNetwork(std::vector<int> networkShape, activationFunction networkActivation, errorFunction networkError, regularizationFunction networkRegularization, bool allocate);
 
-        void initParameters();
+        void allocateParameters();
+        void checkModel(const modelFile& model);
+        void copyParameters(modelFile& model);
 
-        static float getRandomNumber(float param);
-        void backpropagate(trainingExample& example, std::vector<matrix>& weightsDelta, std::vector<matrix>& biasesDelta);
-        void gradientDescent(std::vector<trainingExample>& miniBatch);
-        std::vector<matrix> getActivationGradients(matrix& networkOutput, matrix& target);
+        void prepareState(networkState& batchState, int batchSize);
+        void checkSource(const dataSource& source);
+        void packExamples(const dataSource& source, const int* indices, int count, networkState& batchState);
+        // With outputDeltas a softmax output layer also writes its deltas in the same pass.
+        void forwardPass(networkState& batchState, bool outputDeltas = false);
+        // With buckets, each layer is handed over as soon as its gradients are done, output layer first.
+        void backpropagate(networkState& batchState, gradientBuckets* buckets = nullptr);
+        // Adds the loss and correct predictions of the batch just forwarded to batchState.statistics.
+        void recordStatistics(networkState& batchState);
+        lossStatistics workerStatistics() const;
+        // Adds the regularization term, once for the whole set rather than per example.
+        evaluationResult summarize(const lossStatistics& statistics);
+        // The statistics of every worker's batches this epoch, summed over the process group.
+        evaluationResult finishEpoch();
+        void loadSlice(preparedBatch& batch, int slice, networkState& batchState);
+        void gradientDescent(batchPipeline& pipeline, preparedBatch& batch, const optimizerStep& step, gradientBuckets* buckets);
+        void hogwildEpoch(batchPipeline& pipeline, int epoch, int epochs);
+        // Trains from batch firstBatch of epoch firstEpoch, where order is that epoch's order if
+        // firstBatch > 0 and the previous epoch's otherwise.
+        void runEpochs(const dataSource& source, int epochs, int miniBatchSize, bool shuffleData, std::mt19937& generator, std::vector<int>& order, int firstEpoch, int firstBatch);
+        void snapshotTraining(checkpointWriter& writer, const std::mt19937& generator, const std::vector<int>& order, int epochs, int miniBatchSize, bool shuffleData, int epoch, int batch);
+        void reduceGradients(int worker, int activeWorkers);
+        void applyGradients(networkState& gradients, const optimizerStep& step, int rowBegin, int rowEnd, int layer);
+        void getActivationGradients(networkState& batchState);
+
+        void applyActivation(const matrix& layerNodes, matrix& layerActivations) const;
+        void applyActivationPrime(const matrix& layerNodes, const matrix& layerActivations, matrix& layerDeltas) const;
+        bool softmaxOutput() const;
+        // classes, if given, receives the argmax of each example's outputs.
+        const matrix& inferBatch(constMatrixView inputs, bool examplesAsRows, int* classes = nullptr) const;
+        void applyOutputDeltas(networkState& batchState);
+        float getError(const matrix& output, const matrix& targets);
 
         static float sigmoidF(const float x);
         static float sigmoidFPrime(const float x);
@@ -80,19 +228,97 @@ class neuralNetwork {
         static float L2FPrime(const float w, const int n, const float lambda);
 public:
         neuralNetwork(std::vector<int> networkShape, float networkLearningRate = 0.005f, activationFunction networkActivation = sigmoid, errorFunction networkError = mse, regularizationFunction networkRegularization = L2, float regularizationLambda = 0.01f);
-        matrix feedfoward(const matrix& input);
-        void train(std::vector<trainingExample> examples, int epochs, int miniBatchSize = 5, bool shuffleData = true);
+        neuralNetwork(const neuralNetwork& other);
+        neuralNetwork(neuralNetwork&& other) = default;
+        neuralNetwork& operator=(const neuralNetwork& other);
+        neuralNetwork& operator=(neuralNetwork&& other) = default;
+
+        matrix feedfoward(constMatrixView input) const;
+        matrix feedfowardBatch(constMatrixView inputs) const;
+
+        // Reentrant inference on raw buffers holding one example per row (count x inputs in,
+        // count x outputs out). Safe to call concurrently, but not while the network is training.
+        void predict(const float* input, float* output) const;
+        void predict(const uint8_t* input, float* output, float inputScale = 1.0f / 255) const;
+        void predictBatch(const float* inputs, int count, float* outputs) const;
+        void predictBatch(const uint8_t* inputs, int count, float* outputs, float inputScale = 1.0f / 255) const;
+        // The most likely class of each example, taken from the output layer as it's computed.
+        void predictClasses(const float* inputs, int count, int* classes) const;
+        // The k most likely classes of each example and their outputs, best first (count x k each).
+        void predictTopK(const float* inputs, int count, int k, int* classes, float* scores) const;
+        void train(const std::vector<trainingExample>& examples, int epochs, int miniBatchSize = 5, bool shuffleData = true);
+        void train(const dataSource& source, int epochs, int miniBatchSize = 5, bool shuffleData = true);
+        // Continues the train call recorded in a checkpoint, with the same data, exactly as it
+        // would have gone on. The optimizer and thread count must be set as they were.
+        void resume(const dataSource& source, const char* checkpointFileName);
+        void setThreadCount(int threadCount, bool hogwildUpdates = false);
+        // Batches of up to 16 examples whose inputs are at most maxDensity non-zero run the first
+        // layer on the non-zeros only. 0 always uses the dense path.
+        void setSparseInputDensity(float maxDensity);
+        // Replaces the update rule (plain SGD by default) and discards its accumulated state.
+        void setOptimizer(const optimizerSettings& settings);
+        // Makes train snapshot the parameters, optimizer state and data order between batches and
+        // write them in the background (hogwild training only at the end of each epoch).
+        void setCheckpointing(const checkpointSettings& settings);
+        // Trains data-parallel with the other ranks of processes, which all call train with the same
+        // arguments: rank 0's parameters and shuffle seed are sent to everyone, each rank trains
+        // on its share of every ranks * miniBatchSize examples and gradients are summed over the
+        // ring in buckets of about bucketFloats values. A step is the one a single process takes
+        // with the larger mini-batch, up to summation order. Only rank 0 reports the cost and
+        // writes checkpoints. nullptr trains alone again.
+        // Buckets are only all-reduced while backpropagation runs when a step runs on a single
+        // worker (one thread, or one example per mini-batch). With more workers their gradients are
+        // summed once they are all done, and the buckets overlap with the updates only.
+        // Copies of the network don't take the group along; only this one communicates over it.
+        void setProcessGroup(std::shared_ptr<processGroup> processes, size_t bucketFloats = 1 << 20);
+        // Makes train validate copies of the parameters on a background thread and apply the early
+        // stopping and best model policies to the results (on rank 0, for the whole group).
+        void setValidation(const validationSettings& settings);
+        // Turns train's progress lines on (the default) or off.
+        void setVerbose(bool printProgress);
+        // The validations of the last train call, in order.
+        const std::vector<validationResult>& getValidationHistory() const;
+        // The cost and accuracy of each epoch of the last train call, accumulated over its batches
+        // as they were trained on, so the parameters changed along the way.
+        const std::vector<evaluationResult>& getTrainingHistory() const;
+        // Redraws every weight and bias (uniform in [-1, 1] by default, with a fresh seed) and
+        // returns the seed used. A given seed gives the same parameters on any number of threads.
+        uint64_t initialize(const initializerSettings& settings = initializerSettings());
 
         void save(const char* fileName);
         void load(const char* fileName);
+        // Runs directly on the file's pages; updates made by training stay private to this process.
+        // Without verifyChecksum no tensor byte is read up front, so a large model starts in about
+        // the time it takes to map it, but a corrupted file is used as it is instead of rejected.
+        void loadMapped(const char* fileName, bool verifyChecksum = true);
+        void loadMapped(modelFile&& model);
+        // Builds a network with the shape and functions recorded in a (non-legacy) model file,
+        // which is parsed once; verifyChecksum is as for loadMapped.
+        static neuralNetwork fromFile(const char* fileName, bool mapped = false, bool verifyChecksum = true);
+
+        const std::vector<int>& getShape() const;
 
-        float getCostOverExamples(std::vector<trainingExample>& examples);
-        float getAccuracyOverExamples(std::vector<trainingExample>& examples);
+        float getCostOverExamples(const std::vector<trainingExample>& examples);
+        float getCostOverExamples(const dataSource& source);
+        float getAccuracyOverExamples(const std::vector<trainingExample>& examples);
+        float getAccuracyOverExamples(const dataSource& source);
+        // Cost and accuracy from a single forward pass over every example.
+        evaluationResult evaluate(const std::vector<trainingExample>& examples);
+        evaluationResult evaluate(const dataSource& source);
         void print();
 
-        static int oneHotIndex(matrix& out);
+        static int oneHotIndex(constMatrixView out, int col = 0);
+
+        inline static activationFunction sigmoid = activationFunction(sigmoidF, sigmoidFPrime, activationKind::sigmoid);
+        inline static activationFunction fastSigmoid = policyActivation<sigmoidPolicy<expAccuracy::fast>>(activationKind::fastSigmoid);
+        inline static activationFunction approximateSigmoid = policyActivation<sigmoidPolicy<expAccuracy::fastest>>(activationKind::approximateSigmoid);
+        inline static activationFunction hyperbolicTangent = policyActivation<tanhPolicy>(activationKind::tanh);
+        inline static activationFunction relu = policyActivation<reluPolicy>(activationKind::relu);
+
+        inline static errorFunction mse = errorFunction(mseF, mseFPrime, errorKind::mse);
+        inline static errorFunction crossEntropy = policyError<crossEntropyPolicy>(errorKind::crossEntropy);
+        // Makes the output layer a softmax, whatever the network's activation, trained on categorical cross-entropy.
+        inline static errorFunction softmaxCrossEntropy = policyError<softmaxCrossEntropyPolicy>(errorKind::softmaxCrossEntropy);
 
-        inline static activationFunction sigmoid = activationFunction(sigmoidF, sigmoidFPrime);
-        inline static errorFunction mse = errorFunction(mseF, mseFPrime);
-        inline static regularizationFunction L2 = regularizationFunction(L2F, L2FPrime);
+        inline static regularizationFunction L2 = regularizationFunction(L2F, L2FPrime, regularizationKind::L2);
 };
@@ -0,0 +1,167 @@
+#include "optimizer.h"
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#define OPTIMIZER_TARGETS "avx512f", "avx2", "default"
+
+__attribute__((target_clones(OPTIMIZER_TARGETS)))
+static void sgdUpdate(int n, float* __restrict w, const float* __restrict g, float gradientScale, float decay, float learningRate) {
+    for (int i = 0; i < n; i++) w[i] -= learningRate * (g[i] * gradientScale + decay * w[i]);
+}
+
+__attribute__((target_clones(OPTIMIZER_TARGETS)))
+static void momentumUpdate(int n, float* __restrict w, const float* __restrict g, float* __restrict v, float gradientScale, float decay, float learningRate, float momentum) {
+    for (int i = 0; i < n; i++) {
+        const float gradient = g[i] * gradientScale + decay * w[i];
+        v[i] = momentum * v[i] + gradient;
+        w[i] -= learningRate * v[i];
+    }
+}
+
+__attribute__((target_clones(OPTIMIZER_TARGETS)))
+static void nesterovUpdate(int n, float* __restrict w, const float* __restrict g, float* __restrict v, float gradientScale, float decay, float learningRate, float momentum) {
+    for (int i = 0; i < n; i++) {
+        const float gradient = g[i] * gradientScale + decay * w[i];
+        v[i] = momentum * v[i] + gradient;
+        w[i] -= learningRate * (gradient + momentum * v[i]);
+    }
+}
+
+__attribute__((target_clones(OPTIMIZER_TARGETS)))
+static void adamUpdate(int n, float* __restrict w, const float* __restrict g, float* __restrict m, float* __restrict v, float gradientScale, float decay, float decoupledDecay,
+                       float learningRate, float beta1, float beta2, float epsilon, float firstCorrection, float secondCorrection) {
+    for (int i = 0; i < n; i++) {
+        const float gradient = g[i] * gradientScale + decay * w[i];
+        m[i] = beta1 * m[i] + (1 - beta1) * gradient;
+        v[i] = beta2 * v[i] + (1 - beta2) * gradient * gradient;
+        w[i] -= learningRate * (m[i] * firstCorrection / (std::sqrt(v[i] * secondCorrection) + epsilon) + decoupledDecay * w[i]);
+    }
+}
+
+float learningRateSchedule::rate(float baseRate, float epochProgress, int totalEpochs) const {
+    float scheduled = baseRate;
+
+    switch (kind) {
+        case scheduleKind::step: scheduled = baseRate * std::pow(decay, std::floor(epochProgress / std::max(1, stepEpochs))); break;
+        case scheduleKind::exponential: scheduled = baseRate * std::pow(decay, epochProgress); break;
+        case scheduleKind::cosine: {
+            const float progress = std::min(1.0f, epochProgress / std::max(1, totalEpochs));
+            const float minimum = baseRate * minimumRate;
+            scheduled = minimum + (baseRate - minimum) * 0.5f * (1 + std::cos(progress * 3.14159265f));
+            break;
+        }
+        default: break;
+    }
+
+    if (epochProgress < warmupEpochs) scheduled *= epochProgress / warmupEpochs;
+
+    return scheduled;
+}
+
+optimizer::optimizer(const optimizerSettings& optimizerConfiguration) : settings(optimizerConfiguration) {}
+
+optimizer::optimizer(const optimizer& other) : settings(other.settings), state(other.state), weightCounts(other.weightCounts), steps(other.steps.load()) {}
+
+optimizer& optimizer::operator=(const optimizer& other) {
+    settings = other.settings;
+    state = other.state;
+    weightCounts = other.weightCounts;
+    steps = other.steps.load();
+
+    return *this;
+}
+
+int optimizer::stateSlots() const {
+    switch (settings.kind) {
+        case optimizerKind::momentum:
+        case optimizerKind::nesterov: return 1;
+        case optimizerKind::adam:
+        case optimizerKind::adamW: return 2;
+        default: return 0;
+    }
+}
+
+void optimizer::prepare(const std::vector<int>& shape) {
+    std::vector<int> counts;
+    for (int layer = 1; layer < shape.size(); layer++) counts.push_back(shape.at(layer) * shape.at(layer - 1));
+
+    if (counts == weightCounts && state.size() == counts.size()) return;
+
+    weightCounts = counts;
+    state.assign(counts.size(), std::vector<float>());
+    for (int layer = 1; layer < shape.size(); layer++)
+        state.at(layer - 1).assign((size_t)stateSlots() * (weightCounts.at(layer - 1) + shape.at(layer)), 0.0f);
+
+    steps = 0;
+}
+
+void optimizer::reset() {
+    for (std::vector<float>& layerState : state) std::fill(layerState.begin(), layerState.end(), 0.0f);
+    steps = 0;
+}
+
+const optimizerSettings& optimizer::getSettings() const {
+    return settings;
+}
+
+long optimizer::getStepCount() const {
+    return steps.load();
+}
+
+void optimizer::getState(std::vector<float>& values) const {
+    values.clear();
+    for (const std::vector<float>& layerState : state) values.insert(values.end(), layerState.begin(), layerState.end());
+}
+
+void optimizer::setState(const std::vector<float>& values, long stepCount) {
+    size_t total = 0;
+    for (const std::vector<float>& layerState : state) total += layerState.size();
+    if (values.size() != total) throw std::logic_error("Optimizer state does not match the optimizer and network shape");
+
+    size_t offset = 0;
+    for (std::vector<float>& layerState : state) {
+        std::copy(values.begin() + offset, values.begin() + offset + layerState.size(), layerState.begin());
+        offset += layerState.size();
+    }
+
+    steps = stepCount;
+}
+
+optimizerStep optimizer::beginStep(float baseRate, float epochProgress, int totalEpochs, int miniBatchSize) {
+    const long step = ++steps;
+
+    optimizerStep current;
+    current.learningRate = settings.schedule.rate(baseRate, epochProgress, totalEpochs);
+    current.gradientScale = 1.0f / miniBatchSize;
+    current.firstMomentCorrection = 1 / (1 - std::pow(settings.beta1, (float)step));
+    current.secondMomentCorrection = 1 / (1 - std::pow(settings.beta2, (float)step));
+
+    return current;
+}
+
+void optimizer::update(const optimizerStep& step, int layer, int offset, int count, float* parameters, const float* gradients, float decay) {
+    if (count <= 0) return;
+
+    std::vector<float>& layerState = state.at(layer);
+    const size_t slotSize = layerState.size() / std::max(1, stateSlots());
+
+    switch (settings.kind) {
+        case optimizerKind::momentum:
+            momentumUpdate(count, parameters, gradients, layerState.data() + offset, step.gradientScale, decay, step.learningRate, settings.momentum);
+            break;
+        case optimizerKind::nesterov:
+            nesterovUpdate(count, parameters, gradients, layerState.data() + offset, step.gradientScale, decay, step.learningRate, settings.momentum);
+            break;
+        case optimizerKind::adam:
+        case optimizerKind::adamW: {
+            const bool decoupled = settings.kind == optimizerKind::adamW;
+            adamUpdate(count, parameters, gradients, layerState.data() + offset, layerState.data() + slotSize + offset, step.gradientScale, decoupled ? 0.0f : decay, decoupled ? decay : 0.0f,
+                       step.learningRate, settings.beta1, settings.beta2, settings.epsilon, step.firstMomentCorrection, step.secondMomentCorrection);
+            break;
+        }
+        default:
+            sgdUpdate(count, parameters, gradients, step.gradientScale, decay, step.learningRate);
+            break;
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <vector>
+#include <atomic>
+
+enum class optimizerKind { sgd, momentum, nesterov, adam, adamW };
+enum class scheduleKind { constant, step, exponential, cosine };
+
+// Learning rate as a function of training progress in epochs (fractional within an epoch).
+// step multiplies by decay every stepEpochs, exponential by decay every epoch and cosine anneals
+// to minimumRate * base over the epochs of the train call. warmupEpochs ramps up linearly first.
+struct learningRateSchedule {
+    scheduleKind kind = scheduleKind::constant;
+    float decay = 0.5f;
+    int stepEpochs = 1;
+    float minimumRate = 0.0f;
+    float warmupEpochs = 0.0f;
+
+    float rate(float baseRate, float epochProgress, int totalEpochs) const;
+};
+
+struct optimizerSettings {
+    optimizerKind kind = optimizerKind::sgd;
+    float momentum = 0.9f;
+    float beta1 = 0.9f;
+    float beta2 = 0.999f;
+    float epsilon = 1e-8f;
+    learningRateSchedule schedule;
+};
+
+// Per batch constants shared by every fused update of that batch.
+struct optimizerStep {
+    float learningRate;
+    float gradientScale;
+    float firstMomentCorrection;
+    float secondMomentCorrection;
+};
+
+// Parameter update rules. The state of each layer (velocities or Adam moments) lives in one
+// contiguous buffer laid out like the layer's weights followed by its biases, so an update can be
+// split into disjoint element ranges across threads. Each range is updated in a single pass that
+// scales the summed gradient, adds weight decay, advances the state and writes the parameters.
+class optimizer {
+private:
+    optimizerSettings settings;
+    std::vector<std::vector<float>> state;
+    std::vector<int> weightCounts;
+    std::atomic<long> steps{0};
+
+    int stateSlots() const;
+
+public:
+    optimizer(const optimizerSettings& optimizerConfiguration = optimizerSettings());
+    optimizer(const optimizer& other);
+    optimizer& operator=(const optimizer& other);
+
+    // Sizes the state for a network of this shape, keeping it if the shape hasn't changed.
+    void prepare(const std::vector<int>& shape);
+    void reset();
+
+    const optimizerSettings& getSettings() const;
+    long getStepCount() const;
+
+    // Every layer's state in order, as checkpoints store it. setState expects the same layout for
+    // the shape given to prepare.
+    void getState(std::vector<float>& values) const;
+    void setState(const std::vector<float>& values, long stepCount);
+
+    optimizerStep beginStep(float baseRate, float epochProgress, int totalEpochs, int miniBatchSize);
+
+    // parameters[i] -= update(gradients[i] * gradientScale + decay * parameters[i]) for i in [0, count),
+    // where offset is the position of parameters[0] within the layer's weights, then biases.
+    // AdamW applies decay to the parameters directly instead of through the moments.
+    void update(const optimizerStep& step, int layer, int offset, int count, float* parameters, const float* gradients, float decay);
+};
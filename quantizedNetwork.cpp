@@ -0,0 +1,186 @@
+#include "quantizedNetwork.h"
+#include "functionPolicies.h"
+#include "matrix/kernels.h"
+#include <algorithm>
+#include <cmath>
+
+#define QUANTIZED_INPUT_MAX 127
+#define EVALUATION_BATCH_SIZE 256
+
+quantizedNetwork::quantizedNetwork(neuralNetwork& network, const dataSource& calibrationSource, int calibrationExamples) {
+    network.checkSource(calibrationSource);
+
+    shape = network.shape;
+    activation = network.activation;
+    softmaxOutput = network.softmaxOutput();
+
+    std::vector<float> minimums;
+    std::vector<float> maximums;
+    calibrate(network, calibrationSource, calibrationExamples, minimums, maximums);
+
+    int widestLayer = 0;
+    for (int layerSize : shape) widestLayer = std::max(widestLayer, layerSize);
+
+    for (int layer = 1; layer < shape.size(); layer++) {
+        quantizedLayer quantized;
+        quantized.inputs = shape.at(layer - 1);
+        quantized.outputs = shape.at(layer);
+
+        // The range always includes zero so the zero point is a valid quantized value.
+        const float minimum = std::min(minimums.at(layer - 1), 0.0f);
+        const float maximum = std::max(maximums.at(layer - 1), 0.0f);
+
+        quantized.inputScale = maximum > minimum ? (maximum - minimum) / QUANTIZED_INPUT_MAX : 1.0f;
+        quantized.inputZeroPoint = std::min<int>(QUANTIZED_INPUT_MAX, std::nearbyint(-minimum / quantized.inputScale));
+
+        quantizeWeights(network.weights.at(layer - 1), network.biases.at(layer - 1), quantized);
+        layers.push_back(std::move(quantized));
+    }
+
+    quantizedInputs.resize(widestLayer);
+    accumulators.resize(widestLayer);
+    layerOutputs.resize(widestLayer);
+}
+
+quantizedNetwork::quantizedNetwork(neuralNetwork& network, const std::vector<trainingExample>& calibrationExamples) : quantizedNetwork(network, exampleSource(calibrationExamples), calibrationExamples.size()) {}
+
+void quantizedNetwork::calibrate(neuralNetwork& network, const dataSource& source, int calibrationExamples, std::vector<float>& minimums, std::vector<float>& maximums) {
+    const int count = calibrationExamples > 0 ? std::min(calibrationExamples, source.size()) : source.size();
+    if (count < 1) throw std::logic_error("Calibration needs at least one example");
+
+    minimums.assign(shape.size() - 1, INFINITY);
+    maximums.assign(shape.size() - 1, -INFINITY);
+
+    // Spread the calibration examples evenly over the source so ordered datasets are represented.
+    std::vector<int> indices(count);
+    for (int i = 0; i < count; i++) indices.at(i) = (long)i * source.size() / count;
+
+    for (int begin = 0; begin < count; begin += EVALUATION_BATCH_SIZE) {
+        const int batchCount = std::min(EVALUATION_BATCH_SIZE, count - begin);
+
+        network.packExamples(source, indices.data() + begin, batchCount, network.state);
+        network.forwardPass(network.state);
+
+        for (int layer = 0; layer + 1 < shape.size(); layer++) {
+            const matrix& layerInputs = network.state.nodesWithActivation.at(layer);
+
+            for (int i = 0; i < layerInputs.rows * layerInputs.cols; i++) {
+                minimums.at(layer) = std::min(minimums.at(layer), layerInputs[i]);
+                maximums.at(layer) = std::max(maximums.at(layer), layerInputs[i]);
+            }
+        }
+    }
+}
+
+void quantizedNetwork::quantizeWeights(const matrix& layerWeights, const matrix& layerBiases, quantizedLayer& layer) {
+    layer.weights.resize((size_t)layer.outputs * layer.inputs);
+    layer.outputScales.resize(layer.outputs);
+    layer.zeroPointCorrections.resize(layer.outputs);
+    layer.biases.resize(layer.outputs);
+
+    for (int row = 0; row < layer.outputs; row++) {
+        float largest = 0;
+        for (int col = 0; col < layer.inputs; col++) largest = std::max(largest, std::abs(layerWeights(row, col)));
+
+        const float scale = largest > 0 ? largest / 127 : 1.0f;
+        int32_t rowSum = 0;
+
+        for (int col = 0; col < layer.inputs; col++) {
+            const int8_t q = std::max(-127, std::min(127, (int)std::nearbyint(layerWeights(row, col) / scale)));
+            layer.weights.at((size_t)row * layer.inputs + col) = q;
+            rowSum += q;
+        }
+
+        layer.outputScales.at(row) = scale * layer.inputScale;
+        layer.zeroPointCorrections.at(row) = rowSum * layer.inputZeroPoint;
+        layer.biases.at(row) = layerBiases(row, 0);
+    }
+}
+
+void quantizedNetwork::quantizeInputs(const quantizedLayer& layer, const float* values, int stride) {
+    const float inverseScale = 1 / layer.inputScale;
+    const float zeroPoint = layer.inputZeroPoint + 0.5f;
+
+    // Clamping before the truncating conversion rounds to nearest and keeps the loop vectorizable.
+    for (int i = 0; i < layer.inputs; i++) {
+        const float q = std::min(std::max(values[(long)i * stride] * inverseScale + zeroPoint, 0.0f), QUANTIZED_INPUT_MAX + 0.5f);
+        quantizedInputs[i] = (uint8_t)q;
+    }
+}
+
+const std::vector<float>& quantizedNetwork::forwardPass(const float* input, int stride) {
+    const float* values = input;
+
+    for (const quantizedLayer& layer : layers) {
+        quantizeInputs(layer, values, stride);
+        gemvInt8(layer.outputs, layer.inputs, layer.weights.data(), layer.inputs, quantizedInputs.data(), accumulators.data());
+
+        for (int row = 0; row < layer.outputs; row++)
+            layerOutputs[row] = layer.outputScales[row] * (accumulators[row] - layer.zeroPointCorrections[row]) + layer.biases[row];
+
+        if (softmaxOutput && &layer == &layers.back()) {
+            float scratch[2];
+            int prediction;
+            softmaxCrossEntropyForward(layerOutputs.data(), layerOutputs.data(), nullptr, nullptr, nullptr, &prediction, layer.outputs, 1, scratch);
+        } else {
+            withActivationPolicy(activation, [&](auto activationPolicy) {
+                activationForward(activationPolicy, layerOutputs.data(), layerOutputs.data(), layer.outputs);
+            });
+        }
+
+        values = layerOutputs.data();
+        stride = 1;
+    }
+
+    return layerOutputs;
+}
+
+matrix quantizedNetwork::feedfoward(constMatrixView input) {
+    if (input.cols != 1 || input.rows != shape.at(0)) throw std::logic_error("Bad input dimensions");
+
+    const std::vector<float>& outputs = forwardPass(input.getDataPointer(), input.stride);
+
+    matrix out(shape.at(shape.size() - 1), 1);
+    for (int i = 0; i < out.rows; i++) out(i, 0) = outputs[i];
+
+    return out;
+}
+
+float quantizedNetwork::getAccuracyOverExamples(const std::vector<trainingExample>& examples) {
+    return getAccuracyOverExamples(exampleSource(examples));
+}
+
+float quantizedNetwork::getAccuracyOverExamples(const dataSource& source) {
+    if (source.inputSize() != shape.at(0)) throw std::logic_error("Example must be same dimensions as first layer in network.");
+    if (source.targetSize() != shape.at(shape.size() - 1)) throw std::logic_error("Example target must be same dimensions as last layer in network.");
+
+    const int outputs = shape.at(shape.size() - 1);
+
+    std::vector<int> sequence(source.size());
+    for (int i = 0; i < sequence.size(); i++) sequence.at(i) = i;
+
+    matrix inputs;
+    matrix targets;
+    int assertCount = 0;
+
+    for (int begin = 0; begin < source.size(); begin += EVALUATION_BATCH_SIZE) {
+        const int count = std::min(EVALUATION_BATCH_SIZE, source.size() - begin);
+        source.assembleBatch(sequence.data() + begin, count, inputs, targets);
+
+        for (int example = 0; example < count; example++) {
+            const std::vector<float>& out = forwardPass(inputs.getDataPointer() + example, count);
+            const int prediction = std::max_element(out.begin(), out.begin() + outputs) - out.begin();
+
+            if (prediction == neuralNetwork::oneHotIndex(targets, example)) assertCount++;
+        }
+    }
+
+    return ((float)assertCount / source.size()) * 100;
+}
+
+size_t quantizedNetwork::getWeightBytes() const {
+    size_t bytes = 0;
+    for (const quantizedLayer& layer : layers) bytes += layer.weights.size() * sizeof(int8_t);
+
+    return bytes;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "neuralNetwork.h"
+#include <vector>
+#include <cstdint>
+
+struct quantizedLayer {
+    int inputs;
+    int outputs;
+
+    // Per output row symmetric int8 weights, so out[row] = outputScales[row] * (sum(weights[row] * q) - zeroPointCorrections[row]) + biases[row]
+    std::vector<int8_t> weights;
+    std::vector<float> outputScales;
+    std::vector<int32_t> zeroPointCorrections;
+    std::vector<float> biases;
+
+    // Asymmetric 7 bit inputs: x = inputScale * (q - inputZeroPoint), q in [0, 127]
+    float inputScale;
+    int inputZeroPoint;
+};
+
+// Int8 inference engine built from a trained network. Weights are quantized per output row,
+// layer inputs are quantized with ranges calibrated on an example set, products accumulate in
+// int32, and activations are applied in float between layers.
+class quantizedNetwork {
+    private:
+        std::vector<quantizedLayer> layers;
+        std::vector<int> shape;
+        activationFunction activation;
+        bool softmaxOutput;
+
+        std::vector<uint8_t> quantizedInputs;
+        std::vector<int32_t> accumulators;
+        std::vector<float> layerOutputs;
+
+        void calibrate(neuralNetwork& network, const dataSource& source, int calibrationExamples, std::vector<float>& minimums, std::vector<float>& maximums);
+        void quantizeWeights(const matrix& layerWeights, const matrix& layerBiases, quantizedLayer& layer);
+        void quantizeInputs(const quantizedLayer& layer, const float* values, int stride);
+        const std::vector<float>& forwardPass(const float* input, int stride);
+public:
+        quantizedNetwork(neuralNetwork& network, const dataSource& calibrationSource, int calibrationExamples = 1000);
+        quantizedNetwork(neuralNetwork& network, const std::vector<trainingExample>& calibrationExamples);
+
+        matrix feedfoward(constMatrixView input);
+
+        float getAccuracyOverExamples(const std::vector<trainingExample>& examples);
+        float getAccuracyOverExamples(const dataSource& source);
+
+        size_t getWeightBytes() const;
+};
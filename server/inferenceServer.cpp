@@ -0,0 +1,319 @@
+#include "../neuralNetwork.h"
+#include "protocol.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using serverClock = std::chrono::steady_clock;
+
+struct serverOptions {
+    std::string modelFile;
+    std::string socketPath = "/tmp/mnist-inference.sock";
+    std::vector<int> legacyShape;
+    int maxBatch = 32;
+    int maxWaitMicroseconds = 200;
+    int workers = 1;
+    bool mapped = false;
+    bool verifyChecksum = true;
+    double reportInterval = 5.0;
+};
+
+// Replies to one client may come from any batcher, so writes to its socket are serialized.
+struct connection {
+    int socket;
+    std::mutex writeMutex;
+
+    connection(int clientSocket) : socket(clientSocket) {}
+    ~connection() { close(socket); }
+};
+
+struct pendingRequest {
+    std::shared_ptr<connection> client;
+    uint64_t requestId;
+    std::vector<float> input;
+    serverClock::time_point arrival;
+};
+
+// Latencies of the requests answered since the last report, plus running totals.
+struct serverStatistics {
+    std::mutex mutex;
+    std::vector<double> latencies;
+    long intervalBatches = 0;
+    long totalRequests = 0;
+    long totalBatches = 0;
+    serverClock::time_point intervalStart = serverClock::now();
+    serverClock::time_point start = serverClock::now();
+
+    void record(const std::vector<double>& batchLatencies) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        latencies.insert(latencies.end(), batchLatencies.begin(), batchLatencies.end());
+        intervalBatches++;
+        totalRequests += batchLatencies.size();
+        totalBatches++;
+    }
+
+    std::string report() {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        const serverClock::time_point now = serverClock::now();
+        const double seconds = std::chrono::duration<double>(now - intervalStart).count();
+
+        std::ostringstream json;
+        json << "{\"requests\": " << latencies.size() << ", \"requests_per_second\": " << (seconds > 0 ? latencies.size() / seconds : 0)
+             << ", \"mean_batch\": " << (intervalBatches ? (double)latencies.size() / intervalBatches : 0)
+             << ", \"p50_us\": " << percentile(0.50) << ", \"p99_us\": " << percentile(0.99)
+             << ", \"total_requests\": " << totalRequests << ", \"total_batches\": " << totalBatches << "}";
+
+        latencies.clear();
+        intervalBatches = 0;
+        intervalStart = now;
+
+        return json.str();
+    }
+
+private:
+    double percentile(double fraction) {
+        if (latencies.empty()) return 0;
+
+        const size_t rank = std::min(latencies.size() - 1, (size_t)(fraction * latencies.size()));
+        std::nth_element(latencies.begin(), latencies.begin() + rank, latencies.end());
+        return latencies.at(rank);
+    }
+};
+
+// Requests from every connection wait here until a batcher takes them.
+class requestQueue {
+private:
+    std::mutex mutex;
+    std::condition_variable available;
+    std::deque<pendingRequest> requests;
+
+public:
+    void push(pendingRequest&& request) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            requests.push_back(std::move(request));
+        }
+        available.notify_one();
+    }
+
+    // Blocks for the first request, then keeps collecting until the batch is full or the oldest
+    // request has waited maxWait.
+    void takeBatch(std::vector<pendingRequest>& batch, int maxBatch, std::chrono::microseconds maxWait) {
+        batch.clear();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        available.wait(lock, [&] { return !requests.empty(); });
+
+        const serverClock::time_point deadline = requests.front().arrival + maxWait;
+        available.wait_until(lock, deadline, [&] { return requests.size() >= (size_t)maxBatch; });
+
+        const int count = std::min((int)requests.size(), maxBatch);
+        for (int i = 0; i < count; i++) {
+            batch.push_back(std::move(requests.front()));
+            requests.pop_front();
+        }
+
+        if (!requests.empty()) available.notify_one();
+    }
+};
+
+static void sendResponse(connection& client, uint64_t requestId, responseStatus status, const float* outputs, uint32_t outputSize) {
+    const responseHeader header = { requestId, status, outputSize };
+
+    std::lock_guard<std::mutex> lock(client.writeMutex);
+    if (writeFully(client.socket, &header, sizeof(header))) writeFully(client.socket, outputs, sizeof(float) * outputSize);
+}
+
+static void readRequests(std::shared_ptr<connection> client, requestQueue& queue, int inputSize) {
+    std::vector<uint8_t> bytes;
+
+    while (true) {
+        requestHeader header;
+        if (!readFully(client->socket, &header, sizeof(header))) break;
+
+        const bool isUint8 = header.format == requestFormat::uint8;
+        if (!isUint8 && header.format != requestFormat::float32) break;
+
+        pendingRequest request;
+        request.client = client;
+        request.requestId = header.requestId;
+        request.input.resize(header.inputSize);
+
+        bool received;
+        if (isUint8) {
+            bytes.resize(header.inputSize);
+            received = readFully(client->socket, bytes.data(), bytes.size());
+            for (uint32_t i = 0; i < header.inputSize; i++) request.input[i] = bytes[i] * (1.0f / 255);
+        } else {
+            received = readFully(client->socket, request.input.data(), sizeof(float) * header.inputSize);
+        }
+        if (!received) break;
+
+        request.arrival = serverClock::now();
+
+        if (header.inputSize != (uint32_t)inputSize) sendResponse(*client, header.requestId, responseStatus::badRequest, nullptr, 0);
+        else queue.push(std::move(request));
+    }
+}
+
+static void serveBatches(const neuralNetwork& network, requestQueue& queue, serverStatistics& statistics, const serverOptions& options) {
+    const int inputSize = network.getShape().front();
+    const int outputSize = network.getShape().back();
+
+    std::vector<pendingRequest> batch;
+    std::vector<float> inputs((size_t)options.maxBatch * inputSize);
+    std::vector<float> outputs((size_t)options.maxBatch * outputSize);
+    std::vector<double> latencies;
+
+    while (true) {
+        queue.takeBatch(batch, options.maxBatch, std::chrono::microseconds(options.maxWaitMicroseconds));
+
+        for (int i = 0; i < batch.size(); i++)
+            std::copy(batch[i].input.begin(), batch[i].input.end(), inputs.begin() + (size_t)i * inputSize);
+
+        network.predictBatch(inputs.data(), batch.size(), outputs.data());
+
+        latencies.clear();
+        for (int i = 0; i < batch.size(); i++) {
+            sendResponse(*batch[i].client, batch[i].requestId, responseStatus::ok, outputs.data() + (size_t)i * outputSize, outputSize);
+            latencies.push_back(std::chrono::duration<double, std::micro>(serverClock::now() - batch[i].arrival).count());
+        }
+
+        statistics.record(latencies);
+        batch.clear();
+    }
+}
+
+static void printUsage() {
+    std::cerr << "usage: inferenceServer --model file [--socket path] [--max-batch n] [--max-wait-us n] [--workers n]\n"
+                 "                       [--mapped] [--skip-checksum] [--shape 784,30,10] [--report-interval seconds]\n"
+                 "--shape is only needed for legacy model files without a header.\n"
+                 "--skip-checksum starts serving without reading the whole model first, but won't notice a corrupted file.\n";
+}
+
+static std::vector<int> parseShape(const std::string& text) {
+    std::vector<int> shape;
+    std::istringstream stream(text);
+
+    for (std::string layer; std::getline(stream, layer, ',');) shape.push_back(std::atoi(layer.c_str()));
+
+    return shape;
+}
+
+int main(int argc, char** argv) {
+    serverOptions options;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string argument = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if (argument == "--model" && hasValue) options.modelFile = argv[++i];
+        else if (argument == "--socket" && hasValue) options.socketPath = argv[++i];
+        else if (argument == "--max-batch" && hasValue) options.maxBatch = std::max(1, std::atoi(argv[++i]));
+        else if (argument == "--max-wait-us" && hasValue) options.maxWaitMicroseconds = std::max(0, std::atoi(argv[++i]));
+        else if (argument == "--workers" && hasValue) options.workers = std::max(1, std::atoi(argv[++i]));
+        else if (argument == "--shape" && hasValue) options.legacyShape = parseShape(argv[++i]);
+        else if (argument == "--report-interval" && hasValue) options.reportInterval = std::atof(argv[++i]);
+        else if (argument == "--mapped") options.mapped = true;
+        else if (argument == "--skip-checksum") options.verifyChecksum = false;
+        else {
+            printUsage();
+            return 2;
+        }
+    }
+
+    if (options.modelFile.empty()) {
+        printUsage();
+        return 2;
+    }
+
+    // Legacy files don't record their shape or functions, so those default to sigmoid and MSE.
+    neuralNetwork network = options.legacyShape.empty() ? neuralNetwork::fromFile(options.modelFile.c_str(), options.mapped, options.verifyChecksum) : neuralNetwork(options.legacyShape);
+    if (!options.legacyShape.empty()) {
+        if (options.mapped) network.loadMapped(options.modelFile.c_str(), options.verifyChecksum);
+        else network.load(options.modelFile.c_str());
+    }
+
+    const int inputSize = network.getShape().front();
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (options.socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << options.socketPath << "\n";
+        return 1;
+    }
+    std::strcpy(address.sun_path, options.socketPath.c_str());
+
+    const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(options.socketPath.c_str());
+    if (listener < 0 || bind(listener, (sockaddr*)&address, sizeof(address)) < 0 || listen(listener, 128) < 0) {
+        std::perror("Can't listen on socket");
+        return 1;
+    }
+
+    // Stop on SIGINT/SIGTERM with a final report. The signals are blocked before any thread starts
+    // so that only the waiting thread below receives them.
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    requestQueue queue;
+    serverStatistics statistics;
+
+    for (int worker = 0; worker < options.workers; worker++)
+        std::thread(serveBatches, std::cref(network), std::ref(queue), std::ref(statistics), std::cref(options)).detach();
+
+    if (options.reportInterval > 0) {
+        std::thread([&] {
+            while (true) {
+                std::this_thread::sleep_for(std::chrono::duration<double>(options.reportInterval));
+                std::cout << statistics.report() << std::endl;
+            }
+        }).detach();
+    }
+
+    std::thread([&] {
+        int received;
+        sigwait(&stopSignals, &received);
+
+        std::cout << statistics.report() << std::endl;
+        unlink(options.socketPath.c_str());
+        std::_Exit(0);
+    }).detach();
+
+    std::cerr << "Serving " << options.modelFile << " on " << options.socketPath << " (max batch " << options.maxBatch << ", max wait "
+              << options.maxWaitMicroseconds << "us, " << options.workers << " workers)\n";
+
+    while (true) {
+        const int clientSocket = accept(listener, nullptr, nullptr);
+        if (clientSocket < 0) {
+            if (errno == EINTR) continue;
+            std::perror("accept");
+            break;
+        }
+
+        std::thread(readRequests, std::make_shared<connection>(clientSocket), std::ref(queue), inputSize).detach();
+    }
+
+    unlink(options.socketPath.c_str());
+    return 1;
+}
@@ -0,0 +1,190 @@
+#include "protocol.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using clientClock = std::chrono::steady_clock;
+
+struct loadOptions {
+    std::string socketPath = "/tmp/mnist-inference.sock";
+    int connections = 4;
+    int requests = 20000;
+    int inflight = 8;
+    int inputSize = 784;
+    bool uint8Inputs = false;
+};
+
+// One connection keeps up to inflight requests outstanding: the sender blocks once that many are
+// unanswered and the receiver releases a slot per response.
+struct connectionLoad {
+    int socket = -1;
+    int requests = 0;
+    std::vector<clientClock::time_point> sendTimes;
+    std::vector<double> latencies;
+    long failures = 0;
+
+    std::mutex mutex;
+    std::condition_variable slotFreed;
+    int outstanding = 0;
+};
+
+static int connectToServer(const std::string& socketPath) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    const int clientSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (clientSocket < 0 || connect(clientSocket, (sockaddr*)&address, sizeof(address)) < 0) {
+        std::perror("Can't connect to server");
+        std::exit(1);
+    }
+
+    return clientSocket;
+}
+
+// MNIST shaped inputs: mostly blank pixels, drawn once and cycled through.
+static std::vector<uint8_t> makePixels(const loadOptions& options, int examples) {
+    std::mt19937 generator(1234);
+    std::vector<uint8_t> pixels((size_t)examples * options.inputSize);
+
+    for (uint8_t& pixel : pixels) pixel = generator() % 5 == 0 ? generator() % 256 : 0;
+
+    return pixels;
+}
+
+static void sendRequests(connectionLoad& load, const loadOptions& options, const std::vector<uint8_t>& pixels) {
+    const int examples = pixels.size() / options.inputSize;
+    std::vector<float> floatInput(options.inputSize);
+
+    for (int request = 0; request < load.requests; request++) {
+        {
+            std::unique_lock<std::mutex> lock(load.mutex);
+            load.slotFreed.wait(lock, [&] { return load.outstanding < options.inflight; });
+            load.outstanding++;
+        }
+
+        const uint8_t* example = pixels.data() + (size_t)(request % examples) * options.inputSize;
+        const requestHeader header = { (uint64_t)request, options.uint8Inputs ? requestFormat::uint8 : requestFormat::float32, (uint32_t)options.inputSize };
+
+        load.sendTimes[request] = clientClock::now();
+
+        bool sent = writeFully(load.socket, &header, sizeof(header));
+        if (options.uint8Inputs) {
+            sent = sent && writeFully(load.socket, example, options.inputSize);
+        } else {
+            for (int i = 0; i < options.inputSize; i++) floatInput[i] = example[i] * (1.0f / 255);
+            sent = sent && writeFully(load.socket, floatInput.data(), sizeof(float) * options.inputSize);
+        }
+
+        if (!sent) {
+            std::cerr << "Connection closed while sending\n";
+            std::exit(1);
+        }
+    }
+}
+
+static void receiveResponses(connectionLoad& load) {
+    std::vector<float> outputs;
+
+    for (int response = 0; response < load.requests; response++) {
+        responseHeader header;
+        if (!readFully(load.socket, &header, sizeof(header))) {
+            std::cerr << "Connection closed while receiving\n";
+            std::exit(1);
+        }
+
+        outputs.resize(header.outputSize);
+        if (!readFully(load.socket, outputs.data(), sizeof(float) * header.outputSize)) {
+            std::cerr << "Connection closed while receiving\n";
+            std::exit(1);
+        }
+
+        if (header.status != responseStatus::ok || header.requestId >= (uint64_t)load.requests) load.failures++;
+        else load.latencies.push_back(std::chrono::duration<double, std::micro>(clientClock::now() - load.sendTimes[header.requestId]).count());
+
+        {
+            std::lock_guard<std::mutex> lock(load.mutex);
+            load.outstanding--;
+        }
+        load.slotFreed.notify_one();
+    }
+}
+
+static double percentile(std::vector<double>& values, double fraction) {
+    if (values.empty()) return 0;
+
+    const size_t rank = std::min(values.size() - 1, (size_t)(fraction * values.size()));
+    std::nth_element(values.begin(), values.begin() + rank, values.end());
+    return values.at(rank);
+}
+
+static void printUsage() {
+    std::cerr << "usage: loadGenerator [--socket path] [--connections n] [--requests n] [--inflight n] [--inputs n] [--uint8]\n"
+                 "--requests is the total over all connections and --inflight the limit per connection.\n";
+}
+
+int main(int argc, char** argv) {
+    loadOptions options;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string argument = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if (argument == "--socket" && hasValue) options.socketPath = argv[++i];
+        else if (argument == "--connections" && hasValue) options.connections = std::max(1, std::atoi(argv[++i]));
+        else if (argument == "--requests" && hasValue) options.requests = std::max(1, std::atoi(argv[++i]));
+        else if (argument == "--inflight" && hasValue) options.inflight = std::max(1, std::atoi(argv[++i]));
+        else if (argument == "--inputs" && hasValue) options.inputSize = std::max(1, std::atoi(argv[++i]));
+        else if (argument == "--uint8") options.uint8Inputs = true;
+        else {
+            printUsage();
+            return 2;
+        }
+    }
+
+    const std::vector<uint8_t> pixels = makePixels(options, 256);
+    std::vector<connectionLoad> loads(options.connections);
+
+    for (int i = 0; i < options.connections; i++) {
+        loads[i].socket = connectToServer(options.socketPath);
+        loads[i].requests = options.requests / options.connections + (i < options.requests % options.connections);
+        loads[i].sendTimes.resize(loads[i].requests);
+        loads[i].latencies.reserve(loads[i].requests);
+    }
+
+    const clientClock::time_point start = clientClock::now();
+
+    std::vector<std::thread> threads;
+    for (connectionLoad& load : loads) {
+        threads.emplace_back(sendRequests, std::ref(load), std::cref(options), std::cref(pixels));
+        threads.emplace_back(receiveResponses, std::ref(load));
+    }
+    for (std::thread& thread : threads) thread.join();
+
+    const double seconds = std::chrono::duration<double>(clientClock::now() - start).count();
+
+    std::vector<double> latencies;
+    long failures = 0;
+    for (connectionLoad& load : loads) {
+        latencies.insert(latencies.end(), load.latencies.begin(), load.latencies.end());
+        failures += load.failures;
+        close(load.socket);
+    }
+
+    std::cout << "{\"requests\": " << latencies.size() << ", \"failures\": " << failures << ", \"seconds\": " << seconds
+              << ", \"requests_per_second\": " << latencies.size() / seconds << ", \"p50_us\": " << percentile(latencies, 0.50)
+              << ", \"p99_us\": " << percentile(latencies, 0.99) << ", \"p999_us\": " << percentile(latencies, 0.999) << "}" << std::endl;
+
+    return failures > 0;
+}
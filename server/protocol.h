@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <cerrno>
+#include <unistd.h>
+
+// Wire format shared by the inference server and the load generator. Every message is a fixed
+// header followed by its payload, in host byte order since both ends run on the same machine.
+// Requests are answered out of order, so clients match responses by requestId.
+
+enum class requestFormat : uint32_t { float32 = 0, uint8 = 1 };
+enum class responseStatus : uint32_t { ok = 0, badRequest = 1 };
+
+struct requestHeader {
+    uint64_t requestId;
+    requestFormat format;
+    // Number of input values that follow, 4 bytes each for float32 and 1 byte each for uint8.
+    uint32_t inputSize;
+};
+
+struct responseHeader {
+    uint64_t requestId;
+    responseStatus status;
+    // Number of float outputs that follow, 0 unless status is ok.
+    uint32_t outputSize;
+};
+
+inline bool readFully(int socket, void* buffer, size_t size) {
+    char* position = (char*)buffer;
+
+    while (size > 0) {
+        const ssize_t received = read(socket, position, size);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return false;
+
+        position += received;
+        size -= received;
+    }
+
+    return true;
+}
+
+inline bool writeFully(int socket, const void* buffer, size_t size) {
+    const char* position = (const char*)buffer;
+
+    while (size > 0) {
+        const ssize_t sent = write(socket, position, size);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+
+        position += sent;
+        size -= sent;
+    }
+
+    return true;
+}
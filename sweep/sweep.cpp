@@ -0,0 +1,93 @@
+#include "sweepRunner.h"
+#include "../dataset/idxDataset.h"
+#include "../dataset/subsetSource.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+static void printUsage() {
+    std::cerr << "usage: sweep images labels [--validation n] [--learning-rates 0.01,0.05] [--lambdas 0,0.01] [--batches 10,32]\n"
+                 "             [--hidden 30,100,64-32] [--trials n] [--eta n] [--min-epochs n] [--max-epochs n] [--workers n]\n"
+                 "             [--seed n] [--out leaderboard.json]\n"
+                 "The last --validation examples (10000 by default) are held out to rank the trials. Each --hidden\n"
+                 "entry is one shape's hidden layer sizes separated by '-'. --trials 0 tries every combination once.\n";
+}
+
+static std::vector<std::string> split(const std::string& text, char separator) {
+    std::vector<std::string> parts;
+    std::istringstream stream(text);
+
+    for (std::string part; std::getline(stream, part, separator);) parts.push_back(part);
+
+    return parts;
+}
+
+template <typename T>
+static std::vector<T> parseList(const std::string& text, char separator) {
+    std::vector<T> values;
+    for (const std::string& value : split(text, separator)) values.push_back((T)std::atof(value.c_str()));
+
+    return values;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        printUsage();
+        return 2;
+    }
+
+    searchSpace space;
+    sweepSettings settings;
+    settings.workers = std::max(1u, std::thread::hardware_concurrency());
+    int validationExamples = 10000;
+    std::string outputFile;
+
+    for (int i = 3; i < argc; i++) {
+        const std::string argument = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if (argument == "--validation" && hasValue) validationExamples = std::atoi(argv[++i]);
+        else if (argument == "--learning-rates" && hasValue) space.learningRates = parseList<float>(argv[++i], ',');
+        else if (argument == "--lambdas" && hasValue) space.lambdas = parseList<float>(argv[++i], ',');
+        else if (argument == "--batches" && hasValue) space.miniBatchSizes = parseList<int>(argv[++i], ',');
+        else if (argument == "--hidden" && hasValue) {
+            space.hiddenLayers.clear();
+            for (const std::string& shape : split(argv[++i], ',')) space.hiddenLayers.push_back(parseList<int>(shape, '-'));
+        }
+        else if (argument == "--trials" && hasValue) settings.trials = std::atoi(argv[++i]);
+        else if (argument == "--eta" && hasValue) settings.eta = std::atoi(argv[++i]);
+        else if (argument == "--min-epochs" && hasValue) settings.minEpochs = std::atoi(argv[++i]);
+        else if (argument == "--max-epochs" && hasValue) settings.maxEpochs = std::atoi(argv[++i]);
+        else if (argument == "--workers" && hasValue) settings.workers = std::max(1, std::atoi(argv[++i]));
+        else if (argument == "--seed" && hasValue) settings.seed = std::atoi(argv[++i]);
+        else if (argument == "--out" && hasValue) outputFile = argv[++i];
+        else {
+            printUsage();
+            return 2;
+        }
+    }
+
+    try {
+        // One mapping of the data backs every trial.
+        idxDataset data(argv[1], argv[2], 1.0f / 255, 10);
+        validationExamples = std::min(validationExamples, data.size() / 2);
+
+        subsetSource trainingData(data, 0, data.size() - validationExamples);
+        subsetSource validationData(data, data.size() - validationExamples, validationExamples);
+
+        sweepRunner runner(settings, trainingData, validationData);
+        const std::string json = runner.toJson(runner.run(space));
+
+        if (outputFile.empty()) std::cout << json;
+        else std::ofstream(outputFile) << json;
+    } catch (const std::exception& failure) {
+        std::cerr << failure.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
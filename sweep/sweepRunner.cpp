@@ -0,0 +1,154 @@
+#include "sweepRunner.h"
+#include "../neuralNetwork.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+struct sweepRunner::trial {
+    trialResult result;
+    std::unique_ptr<neuralNetwork> network;
+};
+
+sweepRunner::sweepRunner(const sweepSettings& sweepConfiguration, const dataSource& training, const dataSource& validation)
+    : settings(sweepConfiguration), trainingData(training), validationData(validation) {
+    if (settings.eta < 2 || settings.minEpochs < 1 || settings.maxEpochs < settings.minEpochs || settings.workers < 1) throw std::logic_error("Bad sweep configuration");
+
+    for (int epochs = settings.minEpochs; epochs < settings.maxEpochs; epochs *= settings.eta) rungEpochs.push_back(epochs);
+    rungEpochs.push_back(settings.maxEpochs);
+}
+
+sweepRunner::~sweepRunner() {}
+
+std::vector<trialConfiguration> sweepRunner::configurations(const searchSpace& space) const {
+    std::vector<trialConfiguration> all;
+
+    for (const std::vector<int>& hidden : space.hiddenLayers) {
+        for (int miniBatchSize : space.miniBatchSizes) {
+            for (float learningRate : space.learningRates) {
+                for (float lambda : space.lambdas) {
+                    trialConfiguration configuration = { learningRate, lambda, miniBatchSize, { trainingData.inputSize() } };
+                    configuration.shape.insert(configuration.shape.end(), hidden.begin(), hidden.end());
+                    configuration.shape.push_back(trainingData.targetSize());
+                    all.push_back(configuration);
+                }
+            }
+        }
+    }
+
+    if (settings.trials <= 0 || all.empty()) return all;
+
+    // Drawn without replacement, so no budget goes to running a configuration twice.
+    std::mt19937 generator(settings.seed);
+    std::shuffle(all.begin(), all.end(), generator);
+    if ((size_t)settings.trials < all.size()) all.resize(settings.trials);
+
+    return all;
+}
+
+std::vector<trialResult> sweepRunner::run(const searchSpace& space) {
+    trials.clear();
+    rungResults.assign(rungEpochs.size(), std::vector<std::pair<float, int>>());
+
+    workStealingScheduler scheduler(settings.workers);
+
+    for (const trialConfiguration& configuration : configurations(space)) {
+        trials.push_back(std::unique_ptr<trial>(new trial()));
+        trials.back()->result.id = trials.size() - 1;
+        trials.back()->result.configuration = configuration;
+
+        trial* current = trials.back().get();
+        scheduler.submit([this, &scheduler, current](int) { runRung(scheduler, *current); });
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    scheduler.run();
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    steals = scheduler.getStealCount();
+
+    std::vector<trialResult> results;
+    for (std::unique_ptr<trial>& finished : trials) {
+        results.push_back(finished->result);
+        finished->network.reset();
+    }
+
+    std::stable_sort(results.begin(), results.end(), [](const trialResult& a, const trialResult& b) {
+        return a.rung != b.rung ? a.rung > b.rung : a.accuracy > b.accuracy;
+    });
+
+    return results;
+}
+
+void sweepRunner::runRung(workStealingScheduler& scheduler, trial& current) {
+    trialResult& result = current.result;
+    const trialConfiguration& configuration = result.configuration;
+
+    if (!current.network) {
+        current.network.reset(new neuralNetwork(configuration.shape, configuration.learningRate, neuralNetwork::sigmoid, neuralNetwork::softmaxCrossEntropy, neuralNetwork::L2, configuration.lambda));
+        current.network->setVerbose(false);
+
+        initializerSettings initialization;
+        initialization.seed = settings.seed + result.id + 1;
+        current.network->initialize(initialization);
+    }
+
+    const int rung = result.rung;
+    const auto start = std::chrono::steady_clock::now();
+
+    current.network->train(trainingData, rungEpochs.at(rung) - result.epochs, configuration.miniBatchSize, true);
+    const float accuracy = current.network->getAccuracyOverExamples(validationData);
+
+    std::lock_guard<std::mutex> lock(stateMutex);
+    result.trainingSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.epochs = rungEpochs.at(rung);
+    result.accuracy = accuracy;
+
+    if (rung + 1 == rungEpochs.size()) {
+        current.network.reset();
+        return;
+    }
+
+    // Any trial of this rung now in its top 1 / eta and still waiting there is promoted.
+    std::vector<std::pair<float, int>>& ranking = rungResults.at(rung);
+    ranking.push_back({ accuracy, result.id });
+    std::stable_sort(ranking.begin(), ranking.end(), [](const std::pair<float, int>& a, const std::pair<float, int>& b) { return a.first > b.first; });
+
+    const int promotions = ranking.size() / settings.eta;
+    for (int place = 0; place < promotions; place++) {
+        trial& candidate = *trials.at(ranking.at(place).second);
+        if (candidate.result.rung != rung) continue;
+
+        candidate.result.rung++;
+        scheduler.submit([this, &scheduler, &candidate](int) { runRung(scheduler, candidate); });
+    }
+}
+
+std::string sweepRunner::toJson(const std::vector<trialResult>& results) const {
+    std::ostringstream json;
+
+    json << "{\n";
+    json << "  \"trials\": " << results.size() << ",\n";
+    json << "  \"workers\": " << settings.workers << ",\n";
+    json << "  \"seconds\": " << seconds << ",\n";
+    json << "  \"trials_per_hour\": " << (seconds > 0 ? results.size() * 3600.0 / seconds : 0) << ",\n";
+    json << "  \"steals\": " << steals << ",\n";
+    json << "  \"eta\": " << settings.eta << ",\n";
+    json << "  \"rung_epochs\": [";
+    for (int rung = 0; rung < rungEpochs.size(); rung++) json << (rung ? ", " : "") << rungEpochs.at(rung);
+    json << "],\n";
+    json << "  \"leaderboard\": [\n";
+
+    for (int i = 0; i < results.size(); i++) {
+        const trialResult& result = results.at(i);
+
+        json << "    {\"trial\": " << result.id << ", \"learning_rate\": " << result.configuration.learningRate << ", \"lambda\": " << result.configuration.lambda
+             << ", \"mini_batch_size\": " << result.configuration.miniBatchSize << ", \"shape\": [";
+        for (int layer = 0; layer < result.configuration.shape.size(); layer++) json << (layer ? ", " : "") << result.configuration.shape.at(layer);
+        json << "], \"epochs\": " << result.epochs << ", \"rung\": " << result.rung << ", \"accuracy\": " << result.accuracy
+             << ", \"training_seconds\": " << result.trainingSeconds << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    json << "  ]\n}\n";
+    return json.str();
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "workStealingScheduler.h"
+#include "../dataset/dataSource.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+// Values to try for each hyperparameter. Each entry of hiddenLayers is the hidden layer sizes of
+// one candidate shape, which gets the sources' input and output sizes around it.
+struct searchSpace {
+    std::vector<float> learningRates = { 0.05f };
+    std::vector<float> lambdas = { 0.01f };
+    std::vector<int> miniBatchSizes = { 10 };
+    std::vector<std::vector<int>> hiddenLayers = { { 30 } };
+};
+
+struct trialConfiguration {
+    float learningRate;
+    float lambda;
+    int miniBatchSize;
+    std::vector<int> shape;
+};
+
+// Asynchronous successive halving (ASHA): every trial first trains for minEpochs, rung 0. A trial
+// whose accuracy is in the top 1 / eta of the results its rung has had so far goes on to the next
+// rung, eta times as many epochs (up to maxEpochs), and the others stop where they are.
+struct sweepSettings {
+    // Distinct configurations drawn at random from the search space (every one of them if there
+    // are fewer), or 0 for every combination once.
+    int trials = 0;
+    unsigned int seed = 1;
+    int eta = 3;
+    int minEpochs = 1;
+    int maxEpochs = 9;
+    int workers = 1;
+};
+
+struct trialResult {
+    int id;
+    trialConfiguration configuration;
+    // The epochs trained and the rung reached, and the validation accuracy after them.
+    int epochs = 0;
+    int rung = 0;
+    float accuracy = 0;
+    double trainingSeconds = 0;
+};
+
+// Trains many single threaded networks at once, every one of them reading the same data sources.
+// Each rung of each trial is one task on a work-stealing scheduler, so short trials fill the gaps
+// left by long ones. Networks that could still be promoted are kept in memory until the end.
+class sweepRunner {
+private:
+    struct trial;
+
+    const sweepSettings settings;
+    const dataSource& trainingData;
+    const dataSource& validationData;
+
+    std::vector<std::unique_ptr<trial>> trials;
+    std::vector<int> rungEpochs;
+    // The (accuracy, trial) results recorded in each rung.
+    std::vector<std::vector<std::pair<float, int>>> rungResults;
+    std::mutex stateMutex;
+
+    double seconds = 0;
+    long steals = 0;
+
+    std::vector<trialConfiguration> configurations(const searchSpace& space) const;
+    void runRung(workStealingScheduler& scheduler, trial& current);
+
+public:
+    sweepRunner(const sweepSettings& sweepConfiguration, const dataSource& training, const dataSource& validation);
+    ~sweepRunner();
+
+    // Returns every trial's result, those that went furthest first and then by accuracy.
+    std::vector<trialResult> run(const searchSpace& space);
+    // The leaderboard and the sweep's throughput, as JSON.
+    std::string toJson(const std::vector<trialResult>& results) const;
+};
@@ -0,0 +1,118 @@
+#include "workStealingScheduler.h"
+#include <stdexcept>
+
+// The worker running the current task, or -1 outside of run.
+static thread_local int currentWorker = -1;
+
+workStealingScheduler::workStealingScheduler(int workerCount) {
+    if (workerCount < 1) throw std::logic_error("Scheduler needs at least one worker");
+
+    for (int worker = 0; worker < workerCount; worker++) queues.push_back(std::unique_ptr<workerQueue>(new workerQueue()));
+}
+
+int workStealingScheduler::size() const {
+    return queues.size();
+}
+
+long workStealingScheduler::getStealCount() const {
+    return steals.load();
+}
+
+void workStealingScheduler::submit(task newTask) {
+    int queue;
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        unfinished++;
+        submissions++;
+        queue = currentWorker >= 0 ? currentWorker : nextQueue++ % queues.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queues.at(queue)->mutex);
+        queues.at(queue)->tasks.push_back(std::move(newTask));
+    }
+    changed.notify_all();
+}
+
+bool workStealingScheduler::takeTask(int worker, task& next) {
+    {
+        workerQueue& own = *queues.at(worker);
+        std::lock_guard<std::mutex> lock(own.mutex);
+
+        if (!own.tasks.empty()) {
+            next = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    for (int offset = 1; offset < queues.size(); offset++) {
+        workerQueue& victim = *queues.at((worker + offset) % queues.size());
+        std::lock_guard<std::mutex> lock(victim.mutex);
+
+        if (!victim.tasks.empty()) {
+            next = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            steals++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void workStealingScheduler::workerLoop(int worker) {
+    currentWorker = worker;
+
+    while (true) {
+        long seenSubmissions;
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            if (unfinished == 0) break;
+            seenSubmissions = submissions;
+        }
+
+        task next;
+        if (takeTask(worker, next)) {
+            bool skip;
+            {
+                std::lock_guard<std::mutex> lock(stateMutex);
+                skip = failure != nullptr;
+            }
+
+            std::exception_ptr taskFailure;
+            if (!skip) {
+                try {
+                    next(worker);
+                } catch (...) {
+                    taskFailure = std::current_exception();
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(stateMutex);
+            if (taskFailure && !failure) failure = taskFailure;
+            if (--unfinished == 0) changed.notify_all();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(stateMutex);
+        changed.wait(lock, [&] { return unfinished == 0 || submissions != seenSubmissions; });
+    }
+
+    currentWorker = -1;
+}
+
+void workStealingScheduler::run() {
+    std::vector<std::thread> threads;
+    for (int worker = 1; worker < queues.size(); worker++) threads.push_back(std::thread(&workStealingScheduler::workerLoop, this, worker));
+
+    workerLoop(0);
+    for (std::thread& thread : threads) thread.join();
+
+    std::lock_guard<std::mutex> lock(stateMutex);
+    if (failure) {
+        std::exception_ptr firstFailure = failure;
+        failure = nullptr;
+        std::rethrow_exception(firstFailure);
+    }
+}
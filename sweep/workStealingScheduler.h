@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+
+// Runs tasks of uneven length on a fixed set of workers, the calling thread being worker 0. Each
+// worker has its own deque: tasks it submits go to the back and it takes its next task from there,
+// so a task's follow-up runs next on the same core, while an idle worker steals the oldest task
+// from the front of another worker's deque.
+class workStealingScheduler {
+public:
+    using task = std::function<void(int worker)>;
+
+private:
+    struct workerQueue {
+        std::mutex mutex;
+        std::deque<task> tasks;
+    };
+
+    std::vector<std::unique_ptr<workerQueue>> queues;
+
+    std::mutex stateMutex;
+    std::condition_variable changed;
+    long unfinished = 0;
+    long submissions = 0;
+    int nextQueue = 0;
+    std::exception_ptr failure;
+    std::atomic<long> steals{0};
+
+    bool takeTask(int worker, task& next);
+    void workerLoop(int worker);
+
+public:
+    workStealingScheduler(int workerCount);
+
+    workStealingScheduler(const workStealingScheduler&) = delete;
+    workStealingScheduler& operator=(const workStealingScheduler&) = delete;
+
+    int size() const;
+
+    // Queues on the submitting task's own worker, or round robin when called from outside a task.
+    void submit(task newTask);
+    // Returns once every submitted task and everything they submitted has run. After a task
+    // throws the remaining ones are dropped and the first failure is rethrown.
+    void run();
+
+    long getStealCount() const;
+};
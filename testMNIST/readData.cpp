@@ -1,42 +1,26 @@
 #include "readData.h"
-#include <fstream>
+#include "../dataset/idxDataset.h"
 #include <iostream>
+#include <algorithm>
 
 std::vector<trainingExample> readMNISTData(const char *imagesFilePath, const char *labelsFilePath, int numExamples) {
     std::vector<trainingExample> trainingExamples;
 
-    std::ifstream imagesFile;
-    imagesFile.open(imagesFilePath, std::ifstream::binary);
+    idxDataset dataset(imagesFilePath, labelsFilePath, 1.0f, LABEL_SIZE);
 
-    std::ifstream labelsFile;
-    labelsFile.open(labelsFilePath, std::ifstream::binary);
+    for (int i = 0; i < std::min(numExamples, dataset.size()); i++) trainingExamples.push_back(getExample(dataset, i));
 
-    imagesFile.seekg(IMAGES_FILE_METADATA_SIZE);
-    labelsFile.seekg(LABELS_FILE_METADATA_SIZE);
-
-    for (int i = 0; i < numExamples; i++) {
-        unsigned char imageData[IMAGE_SIZE];
-        imagesFile.read((char*) imageData, IMAGE_SIZE);
-
-        matrix image(IMAGE_SIZE, 1);
-        for (int j = 0; j < IMAGE_SIZE; j++) image(j, 0) = imageData[j];
-
-        char labelData;
-        labelsFile.read(&labelData, 1);
-
-        matrix label(LABEL_SIZE, 1);
-        label(labelData, 0) = 1;
+    return trainingExamples;
+}
 
-        trainingExamples.push_back(trainingExample(image, label));
-    }
+trainingExample getExample(const dataSource& dataset, int index) {
+    trainingExample example;
 
-    imagesFile.close();
-    labelsFile.close();
+    dataset.assembleBatch(&index, 1, example.input, example.target);
 
-    return trainingExamples;
+    return example;
 }
 
-
 void printExample(trainingExample& example) {
     std::cout << "Image of a " << neuralNetwork::oneHotIndex(example.target) << std::endl << std::endl;
 
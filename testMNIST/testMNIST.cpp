@@ -1,33 +1,84 @@
 #include <iostream>
+#include <chrono>
+#include <thread>
 #include "readData.h"
 #include "../neuralNetwork.h"
+#include "../dataset/idxDataset.h"
+#include "../dataset/subsetSource.h"
+#include "../quantizedNetwork.h"
+#include "../matrix/kernels.h"
+#include "../metrics.h"
 #define MAX_VALUE_OF_PIXEL 255
 
-float normalizeValue(float value) {
-    return value / MAX_VALUE_OF_PIXEL;
-}
-
 int main() {
-    std::vector<trainingExample> trainingExamples = readMNISTData("mnist60KTrainingImages.bytes", "mnist60KTrainingLabels.bytes", 60000);
-    std::vector<trainingExample> testingExamples = readMNISTData("mnist10KTestingImages.bytes", "mnist10KTestingLabels.bytes", 10000);
-    
-    for (trainingExample& t : trainingExamples) t.input.applyFunction(normalizeValue);
+    idxDataset trainingData("mnist60KTrainingImages.bytes", "mnist60KTrainingLabels.bytes", 1.0f / MAX_VALUE_OF_PIXEL, LABEL_SIZE);
+    idxDataset testingData("mnist10KTestingImages.bytes", "mnist10KTestingLabels.bytes", 1.0f / MAX_VALUE_OF_PIXEL, LABEL_SIZE);
+
+    // The last 10K training examples are held out for validation while training.
+    subsetSource fittingData(trainingData, 0, trainingData.size() - 10000);
+    subsetSource validationData(trainingData, trainingData.size() - 10000, 10000);
+
+    neuralNetwork nn({784, 30, 10}, 0.05f, nn.sigmoid, nn.softmaxCrossEntropy, nn.L2, 0.01f);
 
-    neuralNetwork nn({784, 30, 10}, 0.5f, nn.sigmoid, nn.mse, nn.L2, 0.01f);
+    optimizerSettings optimizer;
+    optimizer.kind = optimizerKind::nesterov;
+    optimizer.momentum = 0.9f;
+    optimizer.schedule.kind = scheduleKind::cosine;
+    nn.setOptimizer(optimizer);
 
     //nn.load("mnistTrained.net");
 
-    nn.train(trainingExamples, 5, 10, true);
-    std::cout << "Accuracy over testing data: " << nn.getAccuracyOverExamples(testingExamples) << std::endl << std::endl;
+    checkpointSettings checkpoints;
+    checkpoints.fileName = "mnistTraining.checkpoint";
+    checkpoints.intervalBatches = 1000;
+    nn.setCheckpointing(checkpoints);
+
+    validationSettings validation;
+    validation.data = &validationData;
+    validation.intervalBatches = 1000;
+    validation.metric = validationMetric::accuracy;
+    validation.patience = 5;
+    nn.setValidation(validation);
+
+    const int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    nn.setThreadCount(threadCount);
+
+    setMetricsEnabled(true);
+
+    auto trainingStart = std::chrono::steady_clock::now();
+    nn.train(fittingData, 2, 10, true);
+    //nn.resume(fittingData, "mnistTraining.checkpoint");
+    std::chrono::duration<double> trainingTime = std::chrono::steady_clock::now() - trainingStart;
+    std::cout << "Training time with " << threadCount << " threads: " << trainingTime.count() << "s" << std::endl;
+    std::cout << "Training metrics: " << metricsToJson(getMetrics()) << std::endl;
+
+    std::cout << "Accuracy over testing data: " << nn.getAccuracyOverExamples(testingData) << std::endl;
+
+    quantizedNetwork quantized(nn, trainingData);
+    std::cout << "Int8 accuracy over testing data: " << quantized.getAccuracyOverExamples(testingData) << std::endl;
+    std::cout << "Weight bytes: " << quantized.getWeightBytes() * sizeof(float) << " float, " << quantized.getWeightBytes() << " int8" << std::endl;
+
+    std::vector<trainingExample> latencyExamples;
+    for (int i = 0; i < 1000; i++) latencyExamples.push_back(getExample(testingData, i));
+
+    auto timeInference = [&](auto& network) {
+        auto start = std::chrono::steady_clock::now();
+        for (trainingExample& example : latencyExamples) network.feedfoward(example.input);
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / latencyExamples.size();
+    };
+
+    std::cout << "Latency per example: " << timeInference(nn) << "us float, " << timeInference(quantized) << "us int8 (" << getInt8KernelName() << ")" << std::endl << std::endl;
 
     nn.save("mnistTrained.net");
 
     while (true) {
         int index;
         std::cin >> index;
-        printExample(trainingExamples.at(index));
+        trainingExample example = getExample(trainingData, index);
+        printExample(example);
 
-        matrix out = nn.feedfoward(trainingExamples.at(index).input);
+        matrix out = nn.feedfoward(example.input);
         std::cout << "Prediction: " << neuralNetwork::oneHotIndex(out) << std::endl;
     }
 
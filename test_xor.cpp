@@ -1,5 +1,8 @@
 #include "neuralNetwork.h"
+#include "fixedNetwork.h"
 #include <iostream>
+#include <exception>
+#include <cmath>
 
 int main() {
     neuralNetwork nn({2, 3, 3, 1}, 0.4f, nn.sigmoid, nn.mse, nn.L2, 0.0002f);
@@ -17,16 +20,48 @@ int main() {
         std::cout << std::endl;
     }
 
-    //nn.train(examples, 10000, 1, true);
-    nn.load("trainedXOR.net");
+    // The first run, with no trained model around yet, trains one and saves it for the next.
+    try {
+        nn.load("trainedXOR.net");
+    } catch (const std::exception&) {
+        initializerSettings initialization;
+        initialization.seed = 1;
+        nn.initialize(initialization);
+
+        nn.setVerbose(false);
+        nn.train(examples, 10000, 1, false);
+        nn.save("trainedXOR.net");
+    }
+
+    // Fails when the trained network gets any of the four wrong, or the fixed one disagrees with it.
+    bool passed = true;
 
     for (trainingExample& example : examples) {
-        std::cout << "Input: " << example.input(0, 0) << ", " << example.input(1, 0) << "; Output:" << nn.feedfoward(example.input)(0, 0);
+        const float output = nn.feedfoward(example.input)(0, 0);
+        std::cout << "Input: " << example.input(0, 0) << ", " << example.input(1, 0) << "; Output:" << output;
         std::cout << std::endl;
+
+        if ((output > 0.5f) != (example.target(0, 0) > 0.5f)) {
+            std::cout << "FAIL wrong side of 0.5" << std::endl;
+            passed = false;
+        }
     }
 
-    //nn.save("trainedXOR.net");
     nn.print();
 
-    return 0;
+    fixedNetwork<2, 3, 3, 1> fixed(0.4f, neuralNetwork::sigmoid, neuralNetwork::mse, neuralNetwork::L2, 0.0002f);
+    fixed.load("trainedXOR.net");
+
+    for (trainingExample& example : examples) {
+        const float output = fixed.feedfoward(example.input)(0, 0);
+        std::cout << "Input: " << example.input(0, 0) << ", " << example.input(1, 0) << "; Fixed output:" << output;
+        std::cout << std::endl;
+
+        if (std::fabs(output - nn.feedfoward(example.input)(0, 0)) > 1e-5f) {
+            std::cout << "FAIL fixed output differs from the network's" << std::endl;
+            passed = false;
+        }
+    }
+
+    return passed ? 0 : 1;
 }
@@ -0,0 +1,95 @@
+#include "neuralNetwork.h"
+#include "metrics.h"
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Trains with the metrics callback firing after every mini-batch and checks that, once the first
+// epoch is done, no batch allocates on the heap. The counting operator new comes from
+// allocationCounter.cpp, linked into this test.
+
+#define EXAMPLES 256
+#define EPOCHS 4
+
+struct batchAllocations {
+    long examples;
+    long allocations;
+};
+
+static bool checkSteadyState(const std::vector<trainingExample>& examples, int threads, int miniBatchSize) {
+    neuralNetwork nn({64, 32, 10}, 0.1f, neuralNetwork::sigmoid, neuralNetwork::softmaxCrossEntropy);
+    nn.setThreadCount(threads);
+    nn.setVerbose(false);
+
+    struct recorder {
+        std::vector<batchAllocations> reports;
+        long lastCount;
+    } record;
+    record.reports.reserve(EXAMPLES * EPOCHS);
+    record.lastCount = getAllocationCount();
+
+    // The snapshot handed to the callback was built, and allocated, since the last report. Building
+    // another one here allocates just as much, so that's taken off. The callback only captures a
+    // pointer, so copying it doesn't allocate either.
+    recorder* recording = &record;
+    setMetricsCallback([recording](const metricsSnapshot& snapshot) {
+        const long count = getAllocationCount();
+        getMetrics();
+        const long snapshotAllocations = getAllocationCount() - count;
+
+        recording->reports.push_back({ snapshot.examples, count - recording->lastCount - snapshotAllocations });
+        recording->lastCount = getAllocationCount();
+    }, 0.0);
+
+    resetMetrics();
+    nn.train(examples, EPOCHS, miniBatchSize);
+    setMetricsCallback(nullptr);
+
+    int steadyReports = 0;
+    bool passed = true;
+
+    for (const batchAllocations& report : record.reports) {
+        if (report.examples <= EXAMPLES) continue;
+        steadyReports++;
+
+        if (report.allocations != 0) {
+            std::cout << "FAIL " << threads << " threads, mini-batch " << miniBatchSize << ": " << report.allocations << " allocations before example " << report.examples << std::endl;
+            passed = false;
+        }
+    }
+
+    if (steadyReports < (EPOCHS - 1) * (EXAMPLES / miniBatchSize)) {
+        std::cout << "FAIL " << threads << " threads: only " << steadyReports << " reports after the first epoch" << std::endl;
+        passed = false;
+    }
+
+    return passed;
+}
+
+int main() {
+    if (getAllocationCount() < 0) {
+        std::cout << "FAIL allocations aren't being counted" << std::endl;
+        return 1;
+    }
+
+    std::mt19937 generator(5);
+    std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+
+    std::vector<trainingExample> examples;
+    for (int i = 0; i < EXAMPLES; i++) {
+        matrix input(64, 1), output(10, 1);
+        for (int j = 0; j < 64; j++) input(j, 0) = distribution(generator);
+        output(i % 10, 0) = 1;
+        examples.push_back(trainingExample(input, output));
+    }
+
+    setMetricsEnabled(true);
+
+    bool passed = true;
+    passed &= checkSteadyState(examples, 1, 16);
+    passed &= checkSteadyState(examples, 4, 16);
+    passed &= checkSteadyState(examples, 1, 1);
+
+    if (passed) std::cout << "No allocations per batch after the first epoch" << std::endl;
+    return passed ? 0 : 1;
+}
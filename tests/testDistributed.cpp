@@ -0,0 +1,138 @@
+#include "neuralNetwork.h"
+#include "modelFile.h"
+#include "distributed/processGroup.h"
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+// Run through nnLaunch. Every rank trains the same network over the process group, with one
+// worker (buckets overlapping backpropagation) and with two, and checks that all ranks end up
+// with bit-identical parameters and training history that match training alone on the combined
+// mini-batch.
+
+#define EXAMPLES 96
+#define EPOCHS 3
+#define MINI_BATCH_SIZE 4
+#define TOLERANCE 1e-4f
+
+static std::vector<float> trainedParameters(neuralNetwork& nn, int rank) {
+    const std::string fileName = "/tmp/nn-distributed-test-" + std::to_string(getpid()) + "-" + std::to_string(rank) + ".net";
+    nn.save(fileName.c_str());
+
+    std::vector<float> parameters;
+    {
+        modelFile model(fileName.c_str(), nn.getShape());
+        const std::vector<int>& shape = nn.getShape();
+
+        for (int layer = 1; layer < shape.size(); layer++) {
+            const float* weights = model.getWeights(layer - 1);
+            const float* biases = model.getBiases(layer - 1);
+            parameters.insert(parameters.end(), weights, weights + shape.at(layer) * shape.at(layer - 1));
+            parameters.insert(parameters.end(), biases, biases + shape.at(layer));
+        }
+    }
+
+    std::remove(fileName.c_str());
+    return parameters;
+}
+
+static neuralNetwork seededNetwork(int threads) {
+    neuralNetwork nn({12, 16, 4}, 0.5f, neuralNetwork::sigmoid, neuralNetwork::softmaxCrossEntropy, neuralNetwork::L2, 0.01f);
+    nn.setThreadCount(threads);
+    nn.setVerbose(false);
+
+    initializerSettings initialization;
+    initialization.seed = 11;
+    nn.initialize(initialization);
+
+    return nn;
+}
+
+static bool checkTraining(const std::vector<trainingExample>& examples, std::shared_ptr<processGroup> group, int threads) {
+    const int rank = group->getRank();
+    const int ranks = group->getSize();
+
+    // Small buckets, so that a step's gradients are split over several of them.
+    neuralNetwork distributed = seededNetwork(threads);
+    distributed.setProcessGroup(group, 64);
+    distributed.train(examples, EPOCHS, MINI_BATCH_SIZE, false);
+    std::vector<float> parameters = trainedParameters(distributed, rank);
+
+    neuralNetwork alone = seededNetwork(threads);
+    alone.train(examples, EPOCHS, MINI_BATCH_SIZE * ranks, false);
+    const std::vector<float> expected = trainedParameters(alone, rank);
+
+    std::vector<float> rootParameters = parameters;
+    group->broadcast(rootParameters.data(), rootParameters.size() * sizeof(float));
+
+    float mismatches = 0, largestDifference = 0;
+    for (int i = 0; i < parameters.size(); i++) {
+        if (parameters.at(i) != rootParameters.at(i)) mismatches++;
+        largestDifference = std::max(largestDifference, std::fabs(parameters.at(i) - expected.at(i)));
+    }
+
+    // The epoch totals are reduced over every rank too, so each one reports the same history as
+    // training alone. A copy of the network keeps it.
+    const neuralNetwork copy = distributed;
+    const std::vector<evaluationResult>& history = copy.getTrainingHistory();
+    const std::vector<evaluationResult>& expectedHistory = alone.getTrainingHistory();
+    std::vector<evaluationResult> rootHistory = history;
+    group->broadcast(rootHistory.data(), rootHistory.size() * sizeof(evaluationResult));
+
+    if (history.size() != EPOCHS || expectedHistory.size() != EPOCHS) {
+        mismatches++;
+    } else {
+        for (int epoch = 0; epoch < EPOCHS; epoch++) {
+            if (history.at(epoch).cost != rootHistory.at(epoch).cost || history.at(epoch).accuracy != rootHistory.at(epoch).accuracy) mismatches++;
+            largestDifference = std::max(largestDifference, std::fabs(history.at(epoch).cost - expectedHistory.at(epoch).cost));
+            largestDifference = std::max(largestDifference, std::fabs(history.at(epoch).accuracy - expectedHistory.at(epoch).accuracy));
+        }
+    }
+
+    // Every rank learns how the others did, so they all pass or fail together.
+    float failures[2] = { mismatches, largestDifference > TOLERANCE ? 1.0f : 0.0f };
+    group->allReduce(failures, 2);
+
+    if (rank == 0) {
+        std::cout << ranks << " ranks, " << threads << " threads: " << failures[0] << " values differ between ranks, largest difference from training alone "
+                  << largestDifference << " on rank 0" << std::endl;
+    }
+
+    if (failures[0] > 0 || failures[1] > 0) {
+        std::cout << "FAIL rank " << rank << ": " << mismatches << " values differ from rank 0, largest difference from training alone " << largestDifference << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+int main() {
+    std::mt19937 generator(3);
+    std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+
+    std::vector<trainingExample> examples;
+    for (int i = 0; i < EXAMPLES; i++) {
+        matrix input(12, 1), output(4, 1);
+        for (int j = 0; j < 12; j++) input(j, 0) = distribution(generator);
+        output(i % 4, 0) = 1;
+        examples.push_back(trainingExample(input, output));
+    }
+
+    try {
+        std::shared_ptr<processGroup> group = std::make_shared<processGroup>(processGroupSettings::fromEnvironment());
+
+        bool passed = checkTraining(examples, group, 1);
+        passed &= checkTraining(examples, group, 2);
+
+        group->barrier();
+        return passed ? 0 : 1;
+    } catch (const std::exception& failure) {
+        std::cerr << failure.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,69 @@
+#include "neuralNetwork.h"
+#include "fixedNetwork.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unistd.h>
+
+// Saves a seeded neuralNetwork, loads the same model file into a fixedNetwork of that shape and
+// checks both give the same outputs. 784-30-10 has a first layer big enough for the cloned kernels
+// and a last one small enough to be inlined; 5-7-3 is inlined throughout.
+
+#define INPUTS_PER_NETWORK 20
+#define TOLERANCE 1e-5f
+
+template<int... Shape>
+static bool checkOutputs(const char* name, activationFunction activation, errorFunction error, std::mt19937& generator) {
+    const std::string fileName = "/tmp/nn-fixed-test-" + std::to_string(getpid()) + ".net";
+
+    neuralNetwork dynamic({Shape...}, 0.1f, activation, error);
+    initializerSettings initialization;
+    initialization.seed = 7;
+    dynamic.initialize(initialization);
+    dynamic.save(fileName.c_str());
+
+    fixedNetwork<Shape...> fixed(0.1f, activation, error);
+    fixed.load(fileName.c_str());
+    std::remove(fileName.c_str());
+
+    const int inputs = dynamic.getShape().front();
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    float largestDifference = 0;
+
+    for (int example = 0; example < INPUTS_PER_NETWORK; example++) {
+        matrix input(inputs, 1);
+        for (int i = 0; i < inputs; i++) input(i, 0) = distribution(generator);
+
+        const matrix expected = dynamic.feedfoward(input);
+        const matrix got = fixed.feedfoward(input);
+
+        for (int i = 0; i < expected.rows; i++) largestDifference = std::max(largestDifference, std::fabs(got(i, 0) - expected(i, 0)));
+    }
+
+    if (!(largestDifference <= TOLERANCE)) {
+        std::cout << "FAIL " << name << ": outputs differ by up to " << largestDifference << std::endl;
+        return false;
+    }
+
+    std::cout << name << ": largest difference " << largestDifference << std::endl;
+    return true;
+}
+
+int main() {
+    std::mt19937 generator(9);
+    bool passed = true;
+
+    try {
+        passed &= checkOutputs<784, 30, 10>("784-30-10 sigmoid, mse", neuralNetwork::sigmoid, neuralNetwork::mse, generator);
+        passed &= checkOutputs<784, 30, 10>("784-30-10 relu, softmax", neuralNetwork::relu, neuralNetwork::softmaxCrossEntropy, generator);
+        passed &= checkOutputs<5, 7, 3>("5-7-3 tanh, mse", neuralNetwork::hyperbolicTangent, neuralNetwork::mse, generator);
+    } catch (const std::exception& failure) {
+        std::cout << "FAIL " << failure.what() << std::endl;
+        return 1;
+    }
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+#include "matrix/kernels.h"
+#include <iostream>
+#include <random>
+#include <vector>
+#include <cmath>
+#include <cfloat>
+
+// Checks gemm on every kernel ISA the machine supports against a naive triple loop in double, for
+// both transposes, several alpha/beta pairs, shapes that leave tails on every blocking level
+// (MC = 96, KC = 256, NC = 2048 and the micro-kernel tile), padded strides, and the m == 1 and
+// n == 1 shapes that gemm hands to the gemv kernels.
+
+struct gemmShape {
+    int m;
+    int n;
+    int k;
+};
+
+struct scalars {
+    float alpha;
+    float beta;
+};
+
+static bool checkGemm(const char* isaName, bool transA, bool transB, const gemmShape& shape, int padding, const scalars& factors, std::mt19937& generator) {
+    const int m = shape.m, n = shape.n, k = shape.k;
+    const int aRows = transA ? k : m, aCols = transA ? m : k;
+    const int bRows = transB ? n : k, bCols = transB ? k : n;
+    const int lda = aCols + padding, ldb = bCols + padding, ldc = n + padding;
+
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    std::vector<float> A((size_t)aRows * lda), B((size_t)bRows * ldb), C((size_t)m * ldc);
+    for (float& value : A) value = distribution(generator);
+    for (float& value : B) value = distribution(generator);
+    for (float& value : C) value = distribution(generator);
+    const std::vector<float> original = C;
+
+    gemm(transA, transB, m, n, k, factors.alpha, A.data(), lda, B.data(), ldb, factors.beta, C.data(), ldc);
+
+    for (int i = 0; i < m; i++) {
+        for (int j = 0; j < n; j++) {
+            double product = 0, magnitude = 0;
+            for (int p = 0; p < k; p++) {
+                const double a = transA ? A[(size_t)p * lda + i] : A[(size_t)i * lda + p];
+                const double b = transB ? B[(size_t)j * ldb + p] : B[(size_t)p * ldb + j];
+                product += a * b;
+                magnitude += std::fabs(a * b);
+            }
+
+            const double c = original[(size_t)i * ldc + j];
+            const double expected = factors.alpha * product + factors.beta * c;
+            const double tolerance = (std::fabs(factors.alpha) * magnitude + std::fabs(factors.beta * c)) * (k + 2) * FLT_EPSILON + 1e-30;
+            const double got = C[(size_t)i * ldc + j];
+
+            if (!(std::fabs(got - expected) <= tolerance)) {
+                std::cout << "FAIL " << isaName << " transA " << transA << " transB " << transB << " m " << m << " n " << n << " k " << k << " padding " << padding
+                          << " alpha " << factors.alpha << " beta " << factors.beta << " at (" << i << ", " << j << "): got " << got << ", expected " << expected << std::endl;
+                return false;
+            }
+        }
+    }
+
+    // Padding between rows of C must be left alone.
+    for (int i = 0; i < m; i++) {
+        for (int j = n; j < ldc; j++) {
+            if (C[(size_t)i * ldc + j] != original[(size_t)i * ldc + j]) {
+                std::cout << "FAIL " << isaName << " wrote past the columns of C, m " << m << " n " << n << " k " << k << std::endl;
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+int main() {
+    const kernelIsa isas[] = { kernelIsa::scalar, kernelIsa::avx2, kernelIsa::avx512 };
+    const gemmShape shapes[] = { {1, 1, 1}, {1, 37, 19}, {29, 1, 45}, {1, 1, 300}, {5, 7, 3}, {13, 35, 9}, {97, 50, 257}, {100, 2049, 70}, {9, 33, 513}, {200, 65, 300} };
+    const scalars factors[] = { {1.0f, 0.0f}, {0.5f, 1.0f}, {-2.0f, 0.25f}, {0.0f, 0.5f} };
+
+    std::mt19937 generator(42);
+    int checks = 0, failures = 0;
+
+    for (kernelIsa isa : isas) {
+        setKernelIsa(isa);
+        if (getKernelIsa() != isa) {
+            std::cout << "Skipping an ISA this machine doesn't support, running on " << getKernelIsaName() << std::endl;
+            continue;
+        }
+
+        for (const gemmShape& shape : shapes)
+            for (int padding : {0, 3})
+                for (int transA = 0; transA < 2; transA++)
+                    for (int transB = 0; transB < 2; transB++)
+                        for (const scalars& factor : factors) {
+                            checks++;
+                            if (!checkGemm(getKernelIsaName(), transA, transB, shape, padding, factor, generator)) failures++;
+                        }
+    }
+
+    setKernelIsa(kernelIsa::automatic);
+
+    std::cout << checks - failures << " of " << checks << " gemm checks passed" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
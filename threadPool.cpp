@@ -0,0 +1,84 @@
+#include "threadPool.h"
+#include <stdexcept>
+
+threadPool::threadPool(int threadCount) {
+    if (threadCount < 1) throw std::logic_error("Thread pool needs at least one thread");
+
+    for (int worker = 1; worker < threadCount; worker++)
+        threads.push_back(std::thread(&threadPool::workerLoop, this, worker));
+}
+
+threadPool::~threadPool() {
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+
+    for (std::thread& thread : threads) thread.join();
+}
+
+int threadPool::size() {
+    return threads.size() + 1;
+}
+
+void threadPool::workerLoop(int worker) {
+    unsigned long seenGeneration = 0;
+
+    while (true) {
+        void (*currentInvoke)(void*, int);
+        void* currentTask;
+        {
+            std::unique_lock<std::mutex> lock(stateMutex);
+            workAvailable.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping) return;
+
+            seenGeneration = generation;
+            currentInvoke = invokeTask;
+            currentTask = task;
+        }
+
+        std::exception_ptr taskFailure;
+        try {
+            currentInvoke(currentTask, worker);
+        } catch (...) {
+            taskFailure = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> lock(stateMutex);
+        if (taskFailure && !failure) failure = taskFailure;
+        if (--pendingWorkers == 0) workFinished.notify_one();
+    }
+}
+
+void threadPool::runTask(void (*invoke)(void* task, int worker), void* workerTask) {
+    std::lock_guard<std::mutex> runLock(runMutex);
+
+    if (threads.empty()) {
+        invoke(workerTask, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        invokeTask = invoke;
+        task = workerTask;
+        pendingWorkers = threads.size();
+        failure = nullptr;
+        generation++;
+    }
+    workAvailable.notify_all();
+
+    std::exception_ptr callerFailure;
+    try {
+        invoke(workerTask, 0);
+    } catch (...) {
+        callerFailure = std::current_exception();
+    }
+
+    std::unique_lock<std::mutex> lock(stateMutex);
+    workFinished.wait(lock, [&] { return pendingWorkers == 0; });
+
+    if (callerFailure) std::rethrow_exception(callerFailure);
+    if (failure) std::rethrow_exception(failure);
+}
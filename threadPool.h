@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <type_traits>
+#include <exception>
+
+class threadPool {
+private:
+    std::vector<std::thread> threads;
+
+    std::mutex runMutex;
+    std::mutex stateMutex;
+    std::condition_variable workAvailable;
+    std::condition_variable workFinished;
+
+    void (*invokeTask)(void* task, int worker) = nullptr;
+    void* task = nullptr;
+    unsigned long generation = 0;
+    int pendingWorkers = 0;
+    bool stopping = false;
+    std::exception_ptr failure;
+
+    void workerLoop(int worker);
+    void runTask(void (*invoke)(void* task, int worker), void* workerTask);
+
+    template <typename Task>
+    static void invoke(void* workerTask, int worker) { (*static_cast<Task*>(workerTask))(worker); }
+
+public:
+    threadPool(int threadCount);
+    ~threadPool();
+
+    threadPool(const threadPool&) = delete;
+    threadPool& operator=(const threadPool&) = delete;
+
+    int size();
+
+    // Runs task(worker) once on every worker, worker 0 being the calling thread, and returns when all are done.
+    // The task is invoked in place, so running a lambda never allocates.
+    template <typename Task>
+    void run(Task&& workerTask) { runTask(invoke<std::remove_reference_t<Task>>, (void*)&workerTask); }
+};
@@ -0,0 +1,148 @@
+#include "validation.h"
+#include "neuralNetwork.h"
+#include <iostream>
+#include <cstring>
+
+static void copyParameters(const std::vector<matrix>& sourceWeights, const std::vector<matrix>& sourceBiases, std::vector<matrix>& weights, std::vector<matrix>& biases) {
+    for (int layer = 0; layer < weights.size(); layer++) {
+        std::memcpy(weights.at(layer).getDataPointer(), sourceWeights.at(layer).getDataPointer(), (size_t)weights.at(layer).rows * weights.at(layer).cols * sizeof(float));
+        std::memcpy(biases.at(layer).getDataPointer(), sourceBiases.at(layer).getDataPointer(), biases.at(layer).rows * sizeof(float));
+    }
+}
+
+backgroundValidator::backgroundValidator(const validationSettings& validationConfiguration, const neuralNetwork& model)
+    : settings(validationConfiguration), snapshot(new neuralNetwork(model)) {
+    worker = std::thread(&backgroundValidator::validate, this);
+}
+
+backgroundValidator::~backgroundValidator() {
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    changed.notify_all();
+
+    worker.join();
+}
+
+bool backgroundValidator::offer(const neuralNetwork& model, float epochProgress) {
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+
+        if (failure) std::rethrow_exception(failure);
+        if (busy) return false;
+    }
+
+    // The worker is idle until busy is set, so the snapshot can be written without the lock.
+    copyParameters(model.weights, model.biases, snapshot->weights, snapshot->biases);
+
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        snapshotProgress = epochProgress;
+        lastTakenProgress = epochProgress;
+        busy = true;
+    }
+    changed.notify_all();
+
+    return true;
+}
+
+bool backgroundValidator::shouldStop() const {
+    return stopRequested.load();
+}
+
+void backgroundValidator::finish(neuralNetwork& model, float epochProgress) {
+    bool validated;
+    {
+        std::unique_lock<std::mutex> lock(stateMutex);
+        changed.wait(lock, [&] { return !busy; });
+        validated = lastTakenProgress == epochProgress;
+    }
+
+    if (!validated) offer(model, epochProgress);
+
+    {
+        std::unique_lock<std::mutex> lock(stateMutex);
+        changed.wait(lock, [&] { return !busy; });
+        if (failure) std::rethrow_exception(failure);
+    }
+
+    if (!settings.keepBest || bestResult < 0 || bestResult == history.size() - 1) return;
+
+    const float* parameterValues = bestParameters.data();
+    for (int layer = 0; layer < model.weights.size(); layer++) {
+        matrix& layerWeights = model.weights.at(layer);
+        matrix& layerBiases = model.biases.at(layer);
+
+        std::memcpy(layerWeights.getDataPointer(), parameterValues, (size_t)layerWeights.rows * layerWeights.cols * sizeof(float));
+        parameterValues += (size_t)layerWeights.rows * layerWeights.cols;
+        std::memcpy(layerBiases.getDataPointer(), parameterValues, layerBiases.rows * sizeof(float));
+        parameterValues += layerBiases.rows;
+    }
+
+    if (snapshot->verbose) std::cout << "Keeping the parameters validated after " << history.at(bestResult).epochProgress << " epochs" << std::endl;
+}
+
+const std::vector<validationResult>& backgroundValidator::getHistory() const {
+    return history;
+}
+
+void backgroundValidator::validate() {
+    while (true) {
+        float epochProgress;
+        {
+            std::unique_lock<std::mutex> lock(stateMutex);
+            changed.wait(lock, [&] { return stopping || busy; });
+            if (stopping) return;
+
+            epochProgress = snapshotProgress;
+        }
+
+        try {
+            validationResult result;
+            result.epochProgress = epochProgress;
+            const evaluationResult evaluation = snapshot->evaluate(*settings.data);
+            result.cost = evaluation.cost;
+            result.accuracy = evaluation.accuracy;
+
+            record(result);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            failure = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            busy = false;
+        }
+        changed.notify_all();
+    }
+}
+
+void backgroundValidator::record(const validationResult& result) {
+    if (snapshot->verbose) std::cout << "Validation after " << result.epochProgress << " epochs ; cost=" << result.cost << " ; accuracy=" << result.accuracy << std::endl;
+
+    history.push_back(result);
+
+    // Lower is better for both: accuracy is compared negated.
+    auto score = [&](const validationResult& validated) { return settings.metric == validationMetric::cost ? validated.cost : -validated.accuracy; };
+
+    if (bestResult >= 0 && !(score(result) < score(history.at(bestResult)) - settings.minImprovement)) {
+        if (settings.patience > 0 && ++resultsSinceBest >= settings.patience) stopRequested = true;
+        return;
+    }
+
+    bestResult = history.size() - 1;
+    resultsSinceBest = 0;
+
+    if (!settings.keepBest) return;
+
+    bestParameters.clear();
+    for (int layer = 0; layer < snapshot->weights.size(); layer++) {
+        const matrix& layerWeights = snapshot->weights.at(layer);
+        const matrix& layerBiases = snapshot->biases.at(layer);
+
+        bestParameters.insert(bestParameters.end(), layerWeights.getDataPointer(), layerWeights.getDataPointer() + (size_t)layerWeights.rows * layerWeights.cols);
+        bestParameters.insert(bestParameters.end(), layerBiases.getDataPointer(), layerBiases.getDataPointer() + layerBiases.rows);
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "dataset/dataSource.h"
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+
+class neuralNetwork;
+
+enum class validationMetric { cost, accuracy };
+
+struct validationSettings {
+    // Held-out examples, which must outlive the train call. nullptr disables validation.
+    const dataSource* data = nullptr;
+    // A validation every this many mini-batches as well as at the end of every epoch, or 0 for
+    // epoch ends only.
+    int intervalBatches = 0;
+    validationMetric metric = validationMetric::cost;
+    // Stops training once this many validations in a row haven't beaten the best by more than
+    // minImprovement. 0 never stops early.
+    int patience = 0;
+    float minImprovement = 0.0f;
+    // Leaves the network with the best validated parameters rather than the last ones.
+    bool keepBest = true;
+};
+
+struct validationResult {
+    // Epochs trained when the parameters were taken, fractional within an epoch.
+    float epochProgress;
+    float cost;
+    float accuracy;
+};
+
+// Evaluates copies of a network's parameters on a thread of its own, so that training carries on
+// while they are validated. Parameters are only taken while the previous ones are done; offers
+// made before that are dropped rather than waited for.
+class backgroundValidator {
+private:
+    const validationSettings settings;
+    std::unique_ptr<neuralNetwork> snapshot;
+
+    std::vector<validationResult> history;
+    std::vector<float> bestParameters;
+    int bestResult = -1;
+    int resultsSinceBest = 0;
+    std::atomic<bool> stopRequested{false};
+
+    float snapshotProgress = 0.0f;
+    float lastTakenProgress = -1.0f;
+    bool busy = false;
+    bool stopping = false;
+    std::exception_ptr failure;
+
+    std::mutex stateMutex;
+    std::condition_variable changed;
+    std::thread worker;
+
+    void validate();
+    void record(const validationResult& result);
+
+public:
+    backgroundValidator(const validationSettings& validationConfiguration, const neuralNetwork& model);
+    ~backgroundValidator();
+
+    backgroundValidator(const backgroundValidator&) = delete;
+    backgroundValidator& operator=(const backgroundValidator&) = delete;
+
+    // Takes the model's parameters for validation unless the previous ones are still being
+    // evaluated. Rethrows a failed evaluation.
+    bool offer(const neuralNetwork& model, float epochProgress);
+    // True once the early stopping policy has given up on further improvement.
+    bool shouldStop() const;
+    // Waits for the evaluation in flight, validates the final parameters if they haven't been,
+    // and with keepBest puts the best parameters back into the model.
+    void finish(neuralNetwork& model, float epochProgress);
+
+    const std::vector<validationResult>& getHistory() const;
+};